@@ -11,6 +11,7 @@ uniform sampler2D tex;
 uniform sampler2D lutTexture;
 uniform sampler2D lutTexture2;
 uniform int use_texture;
+// 1 coverage glyphs, 2 signed distance field glyphs
 uniform int is_font;
 uniform int useLut;
 uniform int matte;
@@ -210,6 +211,12 @@ void main()
             //outColor = texture(tex, Texcoord) * Color;
             //outColor = sampleBlurred(tex, Texcoord) * Color;
             //outColor = texture(tex, Texcoord) * Color;
+        } else if(is_font == 2) {
+            // 0.5 is the outline, the edge is smoothed over about a screen pixel whatever the scale
+            float d = texture(tex, Texcoord).r;
+            float aa = fwidth(d) * 0.7;
+            float a = smoothstep(0.5 - aa, 0.5 + aa, d);
+            outColor = Color * vec4(a, a, a, a);
         } else {
             ivec2 texSize = textureSize(tex, 0);
             vec2 texCoord = uv_aa_linear(Texcoord, texSize, 1);
@@ -0,0 +1,128 @@
+//
+// Created by bison on 19-10-26.
+//
+
+// Advances a population of animation controllers (100k by default) and reports the cost of UpdateAnimations per
+// controller. The controllers play a mix of repeat types at a few frame rates, so some reach the end of their
+// animation every tick. --churn stops that many random controllers and starts as many new ones every tick to
+// exercise removal, the stopped handles are checked to no longer resolve. Animations are registered with made up
+// atlas ids, no files, window or GL context are needed.
+//
+//   animation_bench [--controllers N] [--frames N] [--churn N] [--frame-count N]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../game/animation/Animations.h"
+
+using namespace Game;
+
+#define ANIMATION_BENCH_ANIMATIONS 4
+
+int main(int argc, char** argv) {
+    u32 controllers = 100000;
+    i32 frames = 1000;
+    u32 churn = 0;
+    u32 frameCount = 8;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--controllers") == 0 && i + 1 < argc) {
+            controllers = (u32) std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--churn") == 0 && i + 1 < argc) {
+            churn = (u32) std::max(0, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--frame-count") == 0 && i + 1 < argc) {
+            frameCount = (u32) std::max(1, atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if(controllers > ANIMATION_MAX_CONTROLLERS) {
+        fprintf(stderr, "At most %u controllers\n", ANIMATION_MAX_CONTROLLERS);
+        return 1;
+    }
+
+    Animations anim;
+    InitAnimations(anim);
+    std::vector<u32> atlasIds(frameCount);
+    for(u32 i = 0; i < frameCount; ++i) {
+        atlasIds[i] = i;
+    }
+    const u32 fps[ANIMATION_BENCH_ANIMATIONS] = {6, 8, 12, 24};
+    u32 animations[ANIMATION_BENCH_ANIMATIONS];
+    for(u32 i = 0; i < ANIMATION_BENCH_ANIMATIONS; ++i) {
+        animations[i] = AddAnimation(anim, atlasIds.data(), (u16) frameCount, 32, 32, fps[i]);
+    }
+
+    // mostly looping like level sprites, a few play once or ping pong
+    std::mt19937 rng(1);
+    auto play = [&]() {
+        u32 r = rng() % 100;
+        RepeatType repeatType = r < 85 ? RepeatType::Restart : r < 90 ? RepeatType::Reverse : r < 95 ? RepeatType::Once
+                                                                                                      : RepeatType::ReverseOnce;
+        return PlayAnimation(anim, animations[rng() % ANIMATION_BENCH_ANIMATIONS], repeatType, false, rng());
+    };
+    std::vector<u32> handles(controllers);
+    for(auto& handle : handles) {
+        handle = play();
+    }
+
+    const float delta = 1.0f / 60.0f;
+    std::vector<u32> stopped;
+    stopped.reserve(churn);
+    u64 staleResolved = 0;
+    u64 restarted = 0;
+    double updateSeconds = 0;
+    double churnSeconds = 0;
+    for(i32 frame = 0; frame < frames; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        UpdateAnimations(anim, delta);
+        auto updated = std::chrono::steady_clock::now();
+        // controllers that played once and ended are replaced, plus churn random ones
+        stopped.clear();
+        for(u32 i = 0; i < churn; ++i) {
+            u32& handle = handles[rng() % controllers];
+            StopAnimation(anim, handle);
+            stopped.push_back(handle);
+            handle = play();
+        }
+        for(auto& handle : handles) {
+            if(!IsAnimationPlaying(anim, handle)) {
+                handle = play();
+                restarted++;
+            }
+        }
+        auto churned = std::chrono::steady_clock::now();
+        updateSeconds += std::chrono::duration<double>(updated - start).count();
+        churnSeconds += std::chrono::duration<double>(churned - updated).count();
+    }
+    // stops land in the next update, after it none of the stopped handles may resolve, even with their slots reused
+    UpdateAnimations(anim, delta);
+    for(auto& handle : handles) {
+        if(!IsAnimationPlaying(anim, handle)) {
+            handle = play();
+        }
+    }
+    for(u32 handle : stopped) {
+        staleResolved += IsAnimationPlaying(anim, handle) ? 1 : 0;
+    }
+
+    size_t live = GetAnimationControllerCount(anim);
+    printf("%u controllers, %u frames per animation, %d ticks, churn %u per tick\n", controllers, frameCount, frames, churn);
+    printf("    %-22s %10.1f us\n", "update/tick", updateSeconds * 1e6 / frames);
+    printf("    %-22s %10.2f ns\n", "update/controller", updateSeconds * 1e9 / ((double) frames * (double) live));
+    printf("    %-22s %10.1f us\n", "stop+play/tick", churnSeconds * 1e6 / frames);
+    printf("    %-22s %10llu\n", "ended and restarted", (unsigned long long) restarted);
+    printf("    %-22s %10zu\n", "live controllers", live);
+    printf("    %-22s %10llu\n", "stale handles live", (unsigned long long) staleResolved);
+    if(live != controllers || staleResolved != 0) {
+        fprintf(stderr, "Controller bookkeeping is off\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,489 @@
+//
+// Created by bison on 19-10-26.
+//
+
+// Runs the cpu side of the level pipeline (LoadLevelData, then one TickLevel and UpdateLevel every frame) on
+// synthetic maps without a window or GL context. Stage times come from the profiler zones inside them, allocations
+// are counted by AllocTracker (the target is built with CRAWLER_TRACK_ALLOCS). Results are printed and
+// optionally written as JSON for regression tracking. --check-allocs fails the run if a frame allocates
+// after warmup, the steady state frame is expected to be allocation free. The per-frame meshes and batches
+// come from the frame arena, --arena sets its size in MB, requests that don't fit show up as arena overflows.
+// Cell meshing is split over the job system, --workers sets its threads besides the main one (default one per
+// core, 0 meshes serially). Monster sprites are animated with --anim-frames frames per side (1 for still
+// sprites), every monster has its own controller.
+//
+//   crawler_bench [--map caves|corridors|rooms|all] [--size N | --size WxH] [--frames N] [--warmup N]
+//                 [--lights D] [--monsters D] [--objects D] [--anim-frames N] [--seed N] [--arena MB] [--workers N]
+//                 [--json file] [--check-allocs] [--verbose]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <SDL_log.h>
+#include <json.hpp>
+#include "../game/level/Level.h"
+#include "../util/Profiler.h"
+#include "../util/AllocTracker.h"
+#include "../util/FrameArena.h"
+#include "../util/JobSystem.h"
+
+using namespace Game;
+
+struct BenchConfig {
+    std::vector<std::string> maps;
+    i32 width = 64;
+    i32 height = 64;
+    i32 frames = 300;
+    i32 warmup = 10;
+    float lights = 0.02f;
+    float monsters = 0.02f;
+    float objects = 0.01f;
+    u32 animFrames = 8;
+    u32 seed = 1;
+    i32 arenaMB = 64;
+    u32 workers = JOB_WORKERS_PER_CORE;
+    std::string jsonFile;
+    bool checkAllocs = false;
+    bool verbose = false;
+};
+
+struct StageTime {
+    const char* name;
+    u64 ticks = 0;
+    u64 calls = 0;
+};
+
+struct StageTimes {
+    u64 firstFrame = 0;
+    // keyed by the zone name pointer, zone names are literals
+    std::vector<StageTime> stages;
+};
+
+typedef std::vector<u8> Map;
+
+static u8& cell(Map& map, i32 w, i32 x, i32 y) {
+    return map[(size_t) (y * w + x)];
+}
+
+// cellular automata caves, the classic 45% fill and 4-5 rule
+static Map generateCaves(i32 w, i32 h, std::mt19937& rng) {
+    Map map((size_t) (w * h), '#');
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for(i32 y = 1; y < h - 1; ++y) {
+        for(i32 x = 1; x < w - 1; ++x) {
+            cell(map, w, x, y) = uniform(rng) < 0.45f ? '#' : ' ';
+        }
+    }
+    Map next = map;
+    for(i32 i = 0; i < 5; ++i) {
+        for(i32 y = 1; y < h - 1; ++y) {
+            for(i32 x = 1; x < w - 1; ++x) {
+                i32 walls = 0;
+                for(i32 dy = -1; dy <= 1; ++dy) {
+                    for(i32 dx = -1; dx <= 1; ++dx) {
+                        walls += cell(map, w, x + dx, y + dy) == '#' ? 1 : 0;
+                    }
+                }
+                cell(next, w, x, y) = walls >= 5 ? '#' : ' ';
+            }
+        }
+        map.swap(next);
+    }
+    return map;
+}
+
+// one cell wide maze corridors, iterative recursive backtracker on the odd cells
+static Map generateCorridors(i32 w, i32 h, std::mt19937& rng) {
+    Map map((size_t) (w * h), '#');
+    std::vector<std::pair<i32, i32>> stack;
+    stack.emplace_back(1, 1);
+    cell(map, w, 1, 1) = ' ';
+    const i32 dirs[4][2] = {{2, 0}, {-2, 0}, {0, 2}, {0, -2}};
+    while(!stack.empty()) {
+        auto [x, y] = stack.back();
+        i32 options[4];
+        i32 count = 0;
+        for(i32 d = 0; d < 4; ++d) {
+            i32 nx = x + dirs[d][0];
+            i32 ny = y + dirs[d][1];
+            if(nx > 0 && nx < w - 1 && ny > 0 && ny < h - 1 && cell(map, w, nx, ny) == '#')
+                options[count++] = d;
+        }
+        if(count == 0) {
+            stack.pop_back();
+            continue;
+        }
+        i32 d = options[rng() % (u32) count];
+        cell(map, w, x + dirs[d][0] / 2, y + dirs[d][1] / 2) = ' ';
+        cell(map, w, x + dirs[d][0], y + dirs[d][1]) = ' ';
+        stack.emplace_back(x + dirs[d][0], y + dirs[d][1]);
+    }
+    return map;
+}
+
+// rectangular rooms joined by L shaped corridors between their centers
+static Map generateRooms(i32 w, i32 h, std::mt19937& rng) {
+    Map map((size_t) (w * h), '#');
+    i32 roomCount = std::max(2, (w * h) / 150);
+    i32 prevX = -1, prevY = -1;
+    for(i32 i = 0; i < roomCount; ++i) {
+        i32 rw = 3 + (i32) (rng() % 6);
+        i32 rh = 3 + (i32) (rng() % 6);
+        if(rw >= w - 2 || rh >= h - 2)
+            continue;
+        i32 rx = 1 + (i32) (rng() % (u32) (w - rw - 1));
+        i32 ry = 1 + (i32) (rng() % (u32) (h - rh - 1));
+        for(i32 y = ry; y < ry + rh; ++y) {
+            for(i32 x = rx; x < rx + rw; ++x) {
+                cell(map, w, x, y) = ' ';
+            }
+        }
+        i32 cx = rx + rw / 2;
+        i32 cy = ry + rh / 2;
+        if(prevX >= 0) {
+            for(i32 x = std::min(prevX, cx); x <= std::max(prevX, cx); ++x) {
+                cell(map, w, x, prevY) = ' ';
+            }
+            for(i32 y = std::min(prevY, cy); y <= std::max(prevY, cy); ++y) {
+                cell(map, w, cx, y) = ' ';
+            }
+        }
+        prevX = cx;
+        prevY = cy;
+    }
+    return map;
+}
+
+static Map generateMap(const std::string& type, i32 w, i32 h, std::mt19937& rng) {
+    if(type == "caves")
+        return generateCaves(w, h, rng);
+    if(type == "corridors")
+        return generateCorridors(w, h, rng);
+    if(type == "rooms")
+        return generateRooms(w, h, rng);
+    fprintf(stderr, "Unknown map type %s\n", type.c_str());
+    exit(1);
+}
+
+// lights, monsters and objects on open cells at the given densities, the player on the first open cell
+static void populateMap(Map& map, const BenchConfig& config, std::mt19937& rng, std::vector<std::pair<i32, i32>>& openCells) {
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    openCells.clear();
+    for(i32 y = 0; y < config.height; ++y) {
+        for(i32 x = 0; x < config.width; ++x) {
+            if(cell(map, config.width, x, y) == '#')
+                continue;
+            openCells.emplace_back(x, y);
+            float r = uniform(rng);
+            if(r < config.lights) {
+                cell(map, config.width, x, y) = 'L';
+            } else if(r < config.lights + config.monsters) {
+                cell(map, config.width, x, y) = 'M';
+            } else if(r < config.lights + config.monsters + config.objects) {
+                cell(map, config.width, x, y) = 'S';
+            }
+        }
+    }
+    if(openCells.empty()) {
+        fprintf(stderr, "Generated map has no open cells\n");
+        exit(1);
+    }
+    cell(map, config.width, openCells[0].first, openCells[0].second) = 'P';
+}
+
+// texture ids and uv rects standing in for the atlases, the meshing code only looks them up
+static void setupRenderer(LevelRenderer& r) {
+    r.camera = std::make_unique<Camera>(glm::vec3(0.0f, 0.0f, 0.0f));
+    r.viewCamera = std::make_unique<Camera>(glm::vec3(0.0f, 0.0f, 0.0f));
+    r.wallTexture = 1;
+    r.wallEndTexture = 2;
+    r.ceilingTexture = 3;
+    r.floorTexture = 4;
+    r.drainTexture = 5;
+    r.doorTexture = 6;
+    for(u32 id = 1; id <= 6; ++id) {
+        float u = (float) (id - 1) / 8.0f;
+        r.geometryTextureAtlas.uvRects[id] = FloatRect(u, 0.0f, u + 0.125f, 0.125f);
+        r.spriteTextureAtlas.uvRects[id] = FloatRect(u, 0.0f, u + 0.125f, 0.125f);
+    }
+}
+
+static void setupBluePrints(Level& level, u32 animFrames) {
+    InitAnimations(level.spriteAnimations);
+    CreateMonsterBluePrint(level, 'M', 'N', "synthetic_monster", 50, 64, 2.5f);
+    CreateObjectBluePrint(level, 'S', '*', "synthetic_object", 64, 22, 1.0f);
+    for(auto& [symbol, bluePrint] : level.monsterBluePrints) {
+        for(u32 side = 0; side < 4; ++side) {
+            bluePrint.base.textures[side] = 1 + side;
+            if(animFrames > 1) {
+                // every frame of a side shows its one stand-in texture
+                std::vector<u32> atlasIds(animFrames, 1 + side);
+                bluePrint.base.animations[side] = AddAnimation(level.spriteAnimations, atlasIds.data(), (u16) animFrames,
+                                                               50, 64, bluePrint.base.fps);
+            }
+        }
+    }
+    for(auto& [symbol, bluePrint] : level.objectBluePrints) {
+        bluePrint.base.textures[0] = 5;
+    }
+}
+
+static void stageListener(const ProfileFrame& frame, void* userData) {
+    auto& times = *(StageTimes*) userData;
+    if(frame.index < times.firstFrame)
+        return;
+    auto& stages = times.stages;
+    for(auto& zone : frame.zones) {
+        auto it = std::find_if(stages.begin(), stages.end(), [&](auto& s) { return s.name == zone.name; });
+        if(it == stages.end()) {
+            stages.push_back(StageTime{zone.name});
+            it = stages.end() - 1;
+        }
+        it->ticks += zone.end - zone.start;
+        it->calls++;
+    }
+}
+
+static nlohmann::json runMap(const std::string& type, const BenchConfig& config) {
+    std::mt19937 rng(config.seed);
+    auto map = generateMap(type, config.width, config.height, rng);
+    std::vector<std::pair<i32, i32>> openCells;
+    populateMap(map, config, rng, openCells);
+
+    auto level = std::make_unique<Level>();
+    auto renderer = std::make_unique<LevelRenderer>();
+    setupRenderer(*renderer);
+    setupBluePrints(*level, config.animFrames);
+
+    srand(config.seed);
+    auto loadStart = std::chrono::steady_clock::now();
+    LoadLevelData(*level, *renderer, map.data(), config.width, config.height);
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+    i32 lights = 0;
+    for(u8 c : level->map) {
+        lights += c == 'L' ? 1 : 0;
+    }
+
+    // walk the camera over the open cells and turn it now and then so the depth sort sees new input
+    auto& camera = *renderer->camera;
+    auto moveCamera = [&](i32 frame) {
+        auto& pos = openCells[(size_t) (frame * 7) % openCells.size()];
+        camera.Position = glm::vec3((float) pos.first * CUBE_SIZE, 0.0f, (float) pos.second * CUBE_SIZE);
+        camera.Yaw = (float) ((frame / 10) % 4) * 90.0f;
+        camera.updateCameraVectors();
+    };
+
+    // the profiler is on during warmup too, its thread ring and frame history are allocated on first use
+    StageTimes times;
+    times.stages.reserve(16);
+    SetProfileFrameListener(stageListener, &times);
+    SetProfilerEnabled(true);
+    times.firstFrame = GetProfilerFrameIndex() + config.warmup;
+    for(i32 i = 0; i < config.warmup; ++i) {
+        moveCamera(i);
+        BeginFrameArena();
+        BeginProfilerFrame();
+        TickLevel(*level, *renderer, 1.0f / 60.0f);
+        UpdateLevel(*level, *renderer, renderer->frames[0], 1.0f);
+        EndProfilerFrame();
+    }
+
+    // only TickLevel and UpdateLevel are counted
+    u64 allocs = 0;
+    u64 bytes = 0;
+    i32 allocFrames = 0;
+    u64 arenaOverflows = GetFrameArenaStats().overflowCount;
+    auto start = std::chrono::steady_clock::now();
+    for(i32 i = 0; i < config.frames; ++i) {
+        moveCamera(config.warmup + i);
+        BeginFrameArena();
+        BeginProfilerFrame();
+        auto before = GetAllocStats();
+        TickLevel(*level, *renderer, 1.0f / 60.0f);
+        UpdateLevel(*level, *renderer, renderer->frames[0], 1.0f);
+        auto after = GetAllocStats();
+        EndProfilerFrame();
+        allocs += after.count - before.count;
+        bytes += after.bytes - before.bytes;
+        allocFrames += after.count != before.count ? 1 : 0;
+    }
+    double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // the used bytes of the last frame are taken when the next one begins
+    BeginFrameArena();
+    auto arena = GetFrameArenaStats();
+    arenaOverflows = arena.overflowCount - arenaOverflows;
+    // the listener lags behind, empty frames push the last measured ones through
+    for(i32 i = 0; i < PROFILER_GPU_LATENCY; ++i) {
+        BeginProfilerFrame();
+        EndProfilerFrame();
+    }
+    SetProfilerEnabled(false);
+    SetProfileFrameListener(nullptr, nullptr);
+
+    auto frames = (double) config.frames;
+    u64 cells = (u64) config.width * (u64) config.height;
+    auto& stages = times.stages;
+    double updateSeconds = 0;
+    for(auto& stage : stages) {
+        if(strcmp(stage.name, "TickLevel") == 0 || strcmp(stage.name, "UpdateLevel") == 0)
+            updateSeconds += ProfilerTicksToMs(stage.ticks) / 1000.0;
+    }
+
+    nlohmann::json result = {
+        {"map", type},
+        {"width", config.width},
+        {"height", config.height},
+        {"open_cells", openCells.size()},
+        {"lights", lights},
+        {"monsters", CountEntities(level->entities, ENTITY_TAG_MONSTER)},
+        {"objects", CountEntities(level->entities, ENTITY_TAG_OBJECT)},
+        {"animated_sprites", GetAnimationControllerCount(level->spriteAnimations)},
+        {"frames", config.frames},
+        {"load_ms", loadMs},
+        {"frame_ms", totalSeconds * 1000.0 / frames},
+        {"allocs_per_frame", (double) allocs / frames},
+        {"alloc_bytes_per_frame", (double) bytes / frames},
+        {"allocating_frames", allocFrames},
+        {"cells_per_second", updateSeconds > 0 ? (double) cells * frames / updateSeconds : 0.0},
+        {"geometry_vertices", renderer->frames[0].geometryMesh.size()},
+        {"sprite_vertices", renderer->frames[0].spriteMesh.size()},
+        {"batches", renderer->frames[0].batches.size()},
+        {"arena_bytes_per_frame", arena.used},
+        {"arena_overflows", arenaOverflows},
+    };
+    std::sort(stages.begin(), stages.end(), [](auto& a, auto& b) { return strcmp(a.name, b.name) < 0; });
+    for(auto& stage : stages) {
+        result["stages"][stage.name] = {
+            {"ns_per_frame", ProfilerTicksToMs(stage.ticks) * 1e6 / frames},
+            {"calls_per_frame", (double) stage.calls / frames},
+        };
+    }
+    return result;
+}
+
+static void printResult(const nlohmann::json& r) {
+    printf("%-10s %4dx%-4d open %-6d lights %-4d monsters %-4d load %.2f ms\n",
+           r["map"].get<std::string>().c_str(), r["width"].get<i32>(), r["height"].get<i32>(),
+           r["open_cells"].get<i32>(), r["lights"].get<i32>(), r["monsters"].get<i32>(), r["load_ms"].get<double>());
+    for(auto& [name, stage] : r["stages"].items()) {
+        printf("    %-18s %12.0f ns/frame\n", name.c_str(), stage["ns_per_frame"].get<double>());
+    }
+    printf("    %-18s %12.1f\n", "allocs/frame", r["allocs_per_frame"].get<double>());
+    printf("    %-18s %12.0f\n", "alloc bytes/frame", r["alloc_bytes_per_frame"].get<double>());
+    printf("    %-18s %12.3g\n", "cells/s", r["cells_per_second"].get<double>());
+    printf("    %-18s %12.0f KB, %d overflows\n", "arena/frame", r["arena_bytes_per_frame"].get<double>() / 1024.0,
+           r["arena_overflows"].get<i32>());
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--map" && hasValue) {
+            std::string type = argv[++i];
+            if(type == "all") {
+                config.maps = {"caves", "corridors", "rooms"};
+            } else {
+                config.maps.push_back(type);
+            }
+        } else if(arg == "--size" && hasValue) {
+            const char* value = argv[++i];
+            config.width = atoi(value);
+            const char* x = strchr(value, 'x');
+            config.height = x ? atoi(x + 1) : config.width;
+        } else if(arg == "--frames" && hasValue) {
+            config.frames = std::max(1, atoi(argv[++i]));
+        } else if(arg == "--warmup" && hasValue) {
+            config.warmup = std::max(0, atoi(argv[++i]));
+        } else if(arg == "--lights" && hasValue) {
+            config.lights = (float) atof(argv[++i]);
+        } else if(arg == "--monsters" && hasValue) {
+            config.monsters = (float) atof(argv[++i]);
+        } else if(arg == "--objects" && hasValue) {
+            config.objects = (float) atof(argv[++i]);
+        } else if(arg == "--anim-frames" && hasValue) {
+            config.animFrames = (u32) std::max(1, atoi(argv[++i]));
+        } else if(arg == "--seed" && hasValue) {
+            config.seed = (u32) strtoul(argv[++i], nullptr, 10);
+        } else if(arg == "--arena" && hasValue) {
+            config.arenaMB = std::max(1, atoi(argv[++i]));
+        } else if(arg == "--workers" && hasValue) {
+            config.workers = (u32) strtoul(argv[++i], nullptr, 10);
+        } else if(arg == "--json" && hasValue) {
+            config.jsonFile = argv[++i];
+        } else if(arg == "--check-allocs") {
+            config.checkAllocs = true;
+        } else if(arg == "--verbose") {
+            config.verbose = true;
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if(config.maps.empty())
+        config.maps = {"caves", "corridors", "rooms"};
+    if(config.width < 8 || config.height < 8) {
+        fprintf(stderr, "Map size must be at least 8x8\n");
+        return 1;
+    }
+    // spawning logs every monster
+    if(!config.verbose)
+        SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_WARN);
+
+    nlohmann::json report = {
+        {"config", {
+            {"width", config.width},
+            {"height", config.height},
+            {"frames", config.frames},
+            {"warmup", config.warmup},
+            {"lights", config.lights},
+            {"monsters", config.monsters},
+            {"objects", config.objects},
+            {"anim_frames", config.animFrames},
+            {"seed", config.seed},
+            {"arena_mb", config.arenaMB},
+        }},
+        {"results", nlohmann::json::array()},
+    };
+    if(config.checkAllocs && !IsAllocTrackingEnabled()) {
+        fprintf(stderr, "--check-allocs needs a build with CRAWLER_TRACK_ALLOCS\n");
+        return 1;
+    }
+    InitFrameArena((size_t) MEGABYTES(config.arenaMB));
+    InitJobSystem(config.workers);
+    report["config"]["workers"] = GetJobWorkerCount();
+    // UpdateLevel sets up the frame's projection from it
+    Renderer::InitViewport(1920, 1080);
+    i32 allocFailures = 0;
+    for(auto& type : config.maps) {
+        auto result = runMap(type, config);
+        printResult(result);
+        if(config.checkAllocs && result["allocating_frames"].get<i32>() > 0) {
+            fprintf(stderr, "%s: %d of %d frames allocated after warmup\n", type.c_str(),
+                    result["allocating_frames"].get<i32>(), config.frames);
+            allocFailures++;
+        }
+        report["results"].push_back(result);
+    }
+    ShutdownJobSystem();
+
+    if(!config.jsonFile.empty()) {
+        FILE* f = fopen(config.jsonFile.c_str(), "wb");
+        if(!f) {
+            fprintf(stderr, "Could not write %s\n", config.jsonFile.c_str());
+            return 1;
+        }
+        auto text = report.dump(2);
+        fwrite(text.data(), 1, text.size(), f);
+        fputc('\n', f);
+        fclose(f);
+    }
+    return allocFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+//
+// Created by bison on 19-10-26.
+//
+
+// Decodes every png under a directory (assets/ by default) with each image decoder and reports
+// throughput in MB/s of decoded RGBA pixels. The lodepng output is the reference, any pixel
+// difference in the other decoders, padded or not, makes the benchmark exit with an error.
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include "../renderer/PixelBuffer.h"
+#include "../renderer/ImageDecoder.h"
+
+using namespace Renderer;
+
+struct DecodeFile {
+    std::string path;
+    std::vector<u8> bytes;
+};
+
+static bool samePixels(const PixelBuffer& a, const PixelBuffer& b) {
+    return a.width == b.width && a.height == b.height &&
+           memcmp(a.pixels, b.pixels, (size_t) a.width * a.height * sizeof(u32)) == 0;
+}
+
+// padding the way PixelBuffer used to do it, one blit per edge and corner
+static void referencePad(PixelBuffer& dst, const PixelBuffer& orig) {
+    u32 w = orig.width, h = orig.height;
+    dst.copyFrom(orig, UIntRect(0, 0, w, h), UIntPos(1, 1));
+    dst.copyFrom(orig, UIntRect(0, 0, 1, h), UIntPos(0, 1));
+    dst.copyFrom(orig, UIntRect(w - 1, 0, 1, h), UIntPos(w + 1, 1));
+    dst.copyFrom(orig, UIntRect(0, 0, w, 1), UIntPos(1, 0));
+    dst.copyFrom(orig, UIntRect(0, h - 1, w, 1), UIntPos(1, h + 1));
+    dst.copyFrom(orig, UIntRect(0, 0, 1, 1), UIntPos(0, 0));
+    dst.copyFrom(orig, UIntRect(w - 1, 0, 1, 1), UIntPos(w + 1, 0));
+    dst.copyFrom(orig, UIntRect(0, h - 1, 1, 1), UIntPos(0, h + 1));
+    dst.copyFrom(orig, UIntRect(w - 1, h - 1, 1, 1), UIntPos(w + 1, h + 1));
+}
+
+int main(int argc, char** argv) {
+    std::string dir = "assets";
+    i32 iterations = 20;
+    bool verbose = false;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else {
+            dir = argv[i];
+        }
+    }
+
+    std::vector<DecodeFile> files;
+    for(auto& entry : std::filesystem::recursive_directory_iterator(dir)) {
+        if(entry.is_regular_file() && entry.path().extension() == ".png") {
+            DecodeFile file;
+            file.path = entry.path().string();
+            if(!ReadFileBytes(file.path, file.bytes)) {
+                fprintf(stderr, "Could not read %s\n", file.path.c_str());
+                return 1;
+            }
+            files.emplace_back(std::move(file));
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const DecodeFile& a, const DecodeFile& b) { return a.path < b.path; });
+    if(files.empty()) {
+        fprintf(stderr, "No png files found in %s\n", dir.c_str());
+        return 1;
+    }
+
+    ImageDecoder* decoders[] = {&GetLodePngDecoder(), &GetFastPngDecoder()};
+    std::string error;
+    i32 mismatches = 0;
+
+    // correctness against lodepng, with and without padding
+    size_t compressedBytes = 0;
+    size_t pixelBytes = 0;
+    for(auto& file : files) {
+        compressedBytes += file.bytes.size();
+        PixelBuffer reference(0, 0, PixelFormat::RGBA);
+        if(!GetLodePngDecoder().decode(reference, file.bytes.data(), file.bytes.size(), false, error)) {
+            fprintf(stderr, "%s: %s\n", file.path.c_str(), error.c_str());
+            return 1;
+        }
+        pixelBytes += (size_t) reference.width * reference.height * sizeof(u32);
+        PixelBuffer referencePadded(reference.width + 2, reference.height + 2, PixelFormat::RGBA);
+        referencePad(referencePadded, reference);
+
+        for(auto decoder : decoders) {
+            PixelBuffer pb(0, 0, PixelFormat::RGBA);
+            PixelBuffer padded(0, 0, PixelFormat::RGBA);
+            bool ok = decoder->decode(pb, file.bytes.data(), file.bytes.size(), false, error) &&
+                      decoder->decode(padded, file.bytes.data(), file.bytes.size(), true, error);
+            if(!ok || !samePixels(pb, reference) || !samePixels(padded, referencePadded)) {
+                fprintf(stderr, "MISMATCH %s: %s %s\n", decoder->name(), file.path.c_str(), ok ? "" : error.c_str());
+                mismatches++;
+            }
+        }
+    }
+
+    printf("%zu png files, %.2f MB compressed, %.2f MB decoded, %d iterations\n", files.size(),
+           (double) compressedBytes / (1024.0 * 1024.0), (double) pixelBytes / (1024.0 * 1024.0), iterations);
+
+    double baseline = 0;
+    for(auto decoder : decoders) {
+        double total = 0;
+        for(auto& file : files) {
+            PixelBuffer pb(0, 0, PixelFormat::RGBA);
+            auto start = std::chrono::steady_clock::now();
+            for(i32 i = 0; i < iterations; ++i) {
+                decoder->decode(pb, file.bytes.data(), file.bytes.size(), true, error);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+            total += seconds;
+            if(verbose) {
+                printf("  %-8s %-48s %4ux%-4u %8.3f ms %8.1f MB/s\n", decoder->name(), file.path.c_str(),
+                       pb.width - 2, pb.height - 2, seconds * 1000.0,
+                       (double) (pb.width - 2) * (pb.height - 2) * 4 / (1024.0 * 1024.0) / seconds);
+            }
+        }
+        if(baseline == 0)
+            baseline = total;
+        printf("%-8s %8.2f ms per pass %8.1f MB/s  %.2fx\n", decoder->name(), total * 1000.0,
+               (double) pixelBytes / (1024.0 * 1024.0) / total, baseline / total);
+    }
+
+    if(mismatches > 0) {
+        fprintf(stderr, "%d decode mismatches against lodepng\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+//
+// Created by bison on 19-10-26.
+//
+
+// Runs the same workload through SlotMap and the SparseVector it replaced: inserting N values (100k by default),
+// looking up N random live keys, iterating the values and removing and inserting --churn random values. Every value
+// carries its own key so lookups are checked to find the right one, and SlotMap handles of removed values are
+// checked to no longer resolve.
+//
+//   slotmap_bench [--count N] [--churn N] [--rounds N]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "defs.h"
+#include "SlotMap.h"
+#include "SparseVector.h"
+
+// about the size of a LoadedAnimation or a position with an owner
+struct BenchValue {
+    u32 key;
+    float x, y, z;
+};
+
+struct BenchTimes {
+    double insert = 0;
+    double lookup = 0;
+    double iterate = 0;
+    double churn = 0;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// runs both containers through the same rounds, the key of a SparseVector value is the id it was inserted with
+template <typename Insert, typename Find, typename Remove, typename Iterate, typename Clear>
+static bool runRounds(u32 count, u32 churn, i32 rounds, BenchTimes& times, Insert insert, Find find, Remove remove,
+                      Iterate iterate, Clear clear) {
+    bool ok = true;
+    float sink = 0;
+    for(i32 round = 0; round < rounds; ++round) {
+        std::mt19937 rng(round + 1);
+        std::vector<u32> keys(count);
+        auto start = std::chrono::steady_clock::now();
+        for(u32 i = 0; i < count; ++i) {
+            keys[i] = insert((float) i);
+        }
+        times.insert += secondsSince(start);
+
+        std::vector<u32> probes(count);
+        for(auto& probe : probes) {
+            probe = keys[rng() % count];
+        }
+        start = std::chrono::steady_clock::now();
+        for(u32 key : probes) {
+            const BenchValue* v = find(key);
+            if(v == nullptr || v->key != key) {
+                ok = false;
+                break;
+            }
+            sink += v->x;
+        }
+        times.lookup += secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        sink += iterate();
+        times.iterate += secondsSince(start);
+
+        std::vector<u32> removed;
+        start = std::chrono::steady_clock::now();
+        for(u32 i = 0; i < churn; ++i) {
+            u32& key = keys[rng() % count];
+            if(remove(key))
+                removed.push_back(key);
+            key = insert((float) i);
+        }
+        times.churn += secondsSince(start);
+        for(u32 key : keys) {
+            const BenchValue* v = find(key);
+            ok = ok && v != nullptr && v->key == key;
+        }
+        for(u32 key : removed) {
+            ok = ok && find(key) == nullptr;
+        }
+        clear();
+    }
+    // keeps the lookups from being optimized out
+    if(sink == -1.0f)
+        printf(" ");
+    return ok;
+}
+
+static void printTimes(const char* name, const BenchTimes& t, u32 count, u32 churn, i32 rounds) {
+    double n = (double) count * rounds;
+    printf("    %-14s insert %7.1f ns  lookup %7.1f ns  iterate %6.2f ns  remove+insert %9.1f ns\n", name,
+           t.insert * 1e9 / n, t.lookup * 1e9 / n, t.iterate * 1e9 / n,
+           churn > 0 ? t.churn * 1e9 / ((double) churn * rounds) : 0.0);
+}
+
+int main(int argc, char** argv) {
+    u32 count = 100000;
+    u32 churn = 1000;
+    i32 rounds = 5;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = (u32) std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--churn") == 0 && i + 1 < argc) {
+            churn = (u32) std::max(0, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = std::max(1, atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if(count + churn > SLOT_MAP_MAX_SIZE) {
+        fprintf(stderr, "At most %u values\n", SLOT_MAP_MAX_SIZE);
+        return 1;
+    }
+
+    BenchTimes slotTimes;
+    SlotMap<BenchValue> slotMap;
+    bool slotOk = runRounds(count, churn, rounds, slotTimes,
+            [&](float x) {
+                u32 handle = slotMap.insert(BenchValue{0, x, x, x});
+                slotMap.get(handle).key = handle;
+                return handle;
+            },
+            [&](u32 key) { return slotMap.find(key); },
+            [&](u32 key) { return slotMap.remove(key); },
+            [&]() {
+                float sum = 0;
+                for(auto& v : slotMap) {
+                    sum += v.x + v.y + v.z;
+                }
+                return sum;
+            },
+            [&]() { slotMap.clear(); });
+
+    BenchTimes sparseTimes;
+    SparseVector<BenchValue> sparse;
+    u32 nextId = 1;
+    bool sparseOk = runRounds(count, churn, rounds, sparseTimes,
+            [&](float x) {
+                u32 id = nextId++;
+                sparse.insert(id, BenchValue{id, x, x, x});
+                return id;
+            },
+            [&](u32 key) -> const BenchValue* {
+                auto it = sparse.find(key);
+                return it != sparse.end() ? &*it : nullptr;
+            },
+            [&](u32 key) {
+                bool found = sparse.find(key) != sparse.end();
+                sparse.remove(key);
+                return found;
+            },
+            [&]() {
+                float sum = 0;
+                for(auto& v : sparse) {
+                    sum += v.x + v.y + v.z;
+                }
+                return sum;
+            },
+            [&]() { sparse.clear(); });
+
+    printf("%u values, %u removed and inserted, %d rounds, per value\n", count, churn, rounds);
+    printTimes("SlotMap", slotTimes, count, churn, rounds);
+    printTimes("SparseVector", sparseTimes, count, churn, rounds);
+    if(!slotOk || !sparseOk) {
+        fprintf(stderr, "Lookups found the wrong values (SlotMap %s, SparseVector %s)\n", slotOk ? "ok" : "wrong",
+                sparseOk ? "ok" : "wrong");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+//
+// Created by bison on 19-10-26.
+//
+
+// Pushes a screen worth of text (100k glyphs per frame by default) into a RenderBuffer every frame and reports
+// the cpu time and the vertex bytes the frame would upload. The font is synthetic, printable ascii glyphs already
+// placed on a 16x6 grid of its first glyph page, so no font file, window or GL context is needed. The vertex stream lives in the frame arena,
+// after the first frame a push is expected to be nothing but vertex writes. --cached draws the same lines through
+// a TextLayoutCache instead, with the text unchanged between frames every line after the first frame is a copy
+// of its cached vertices.
+//
+//   text_bench [--glyphs N] [--frames N] [--line N] [--cached]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../renderer/RenderBuffer.h"
+#include "../renderer/TextLayout.h"
+#include "../util/FrameArena.h"
+
+using namespace Renderer;
+
+#define TEXT_BENCH_FIRST_CHAR 32
+#define TEXT_BENCH_LAST_CHAR 126
+
+static void setupFont(Font& font) {
+    font.face = nullptr;
+    font.size = 16;
+    font.pages[0].textureId = 1;
+    for(u32 cp = TEXT_BENCH_FIRST_CHAR; cp <= TEXT_BENCH_LAST_CHAR; ++cp) {
+        u32 index = cp - TEXT_BENCH_FIRST_CHAR;
+        float u = (float) (index % 16) / 16.0f;
+        float v = (float) (index / 16) / 6.0f;
+        font.glyphs[cp] = Glyph{.page = 0, .advance = 9, .size = {8, 14}, .bearing = {0, 12}, .index = cp,
+                                .uv = FloatRect(u, v, u + 1.0f / 16.0f, v + 1.0f / 6.0f)};
+    }
+}
+
+int main(int argc, char** argv) {
+    i32 glyphs = 100000;
+    i32 frames = 100;
+    i32 lineLength = 120;
+    bool cached = false;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--glyphs") == 0 && i + 1 < argc) {
+            glyphs = std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--line") == 0 && i + 1 < argc) {
+            lineLength = std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--cached") == 0) {
+            cached = true;
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Font font;
+    setupFont(font);
+    std::vector<std::string> lines;
+    for(i32 left = glyphs; left > 0; left -= lineLength) {
+        // numbered so every line is a different string
+        std::string line = std::to_string(lines.size());
+        line.resize(std::min((i32) line.size(), std::min(left, lineLength)));
+        for(i32 c = (i32) line.size(); c < std::min(left, lineLength); ++c) {
+            line += (char) (TEXT_BENCH_FIRST_CHAR + (lines.size() * 7 + c) % (TEXT_BENCH_LAST_CHAR - TEXT_BENCH_FIRST_CHAR + 1));
+        }
+        lines.push_back(line);
+    }
+
+    InitFrameArena((size_t) MEGABYTES(64));
+    RenderBuffer buffer = {};
+    CreateRenderBuffer(buffer, KILOBYTES(16));
+    TextLayoutCache cache;
+    InitTextLayoutCache(cache, lines.size());
+    auto pushFrame = [&]() {
+        BeginFrameArena();
+        Clear(buffer);
+        float y = 0.0f;
+        for(auto& line : lines) {
+            if(cached) {
+                PushCachedText(buffer, cache, line, font, 0.0f, y, WHITE);
+            } else {
+                PushText(buffer, line, font, 0.0f, y, WHITE);
+            }
+            y += 16.0f;
+        }
+    };
+    // the first frame sizes the vertex stream
+    pushFrame();
+
+    auto start = std::chrono::steady_clock::now();
+    for(i32 i = 0; i < frames; ++i) {
+        pushFrame();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto overflows = GetFrameArenaStats().overflowCount;
+
+    size_t vertexBytes = buffer.vertices.size() * sizeof(Vertex);
+    // the quad index buffer is static, only the vertices are uploaded every frame
+    printf("%d glyphs in %zu lines, %zu commands, %d frames, %s\n", glyphs, lines.size(), buffer.cmdCount, frames,
+           cached ? "cached layouts" : "PushText");
+    printf("    %-22s %10.3f ms\n", "push/frame", seconds * 1000.0 / frames);
+    printf("    %-22s %10.1f ns\n", "push/glyph", seconds * 1e9 / ((double) frames * glyphs));
+    printf("    %-22s %10zu KB\n", "vertex upload/frame", vertexBytes / 1024);
+    printf("    %-22s %10.1f bytes\n", "vertex bytes/glyph", (double) vertexBytes / glyphs);
+    printf("    %-22s %10llu\n", "arena overflows", (unsigned long long) overflows);
+    if(cached) {
+        printf("    %-22s %10llu hits, %llu rebuilds, %llu misses\n", "layout cache", (unsigned long long) cache.stats.hits,
+               (unsigned long long) cache.stats.rebuilds, (unsigned long long) cache.stats.misses);
+    }
+    DestroyRenderBuffer(buffer);
+    return 0;
+}
@@ -1,5 +0,0 @@
-//
-// Created by bison on 12-09-23.
-//
-
-#include "Database.h"
@@ -2,11 +2,16 @@
 // Created by bison on 4/4/19.
 //
 
+#include <ctime>
+#include <cstdlib>
 #include <defs.h>
 #include <SDL_log.h>
 #include <SDL_mouse.h>
 #include "Game.h"
 #include "../input/SDLInput.h"
+#include "../util/Profiler.h"
+#include "../util/ProfilerOverlay.h"
+#include "../util/TraceWriter.h"
 
 namespace Game {
 
@@ -80,6 +85,8 @@ namespace Game {
         createMapping(Input::MappingType::Action, INPUT_ACTION_RIGHT, Input::RawEventType::Keyboard, SDLK_d);
         createMapping(Input::MappingType::Action, INPUT_ACTION_TURN_LEFT, Input::RawEventType::Keyboard, SDLK_q);
         createMapping(Input::MappingType::Action, INPUT_ACTION_TURN_RIGHT, Input::RawEventType::Keyboard, SDLK_e);
+        createMapping(Input::MappingType::Action, INPUT_ACTION_TOGGLE_TRACE, Input::RawEventType::Keyboard, SDLK_F2);
+        createMapping(Input::MappingType::Action, INPUT_ACTION_TOGGLE_FPS, Input::RawEventType::Keyboard, SDLK_F3);
         createMapping(Input::MappingType::Action, INPUT_ACTION_TOGGLE_FREECAM, Input::RawEventType::Keyboard, SDLK_F4);
     }
 
@@ -87,6 +94,7 @@ namespace Game {
         game.inputContext = std::make_shared<Input::InputContext>();
         Input::RegisterContext(game.inputContext);
         game.inputContext->registerAction(INPUT_ACTION_TOGGLE_FPS);
+        game.inputContext->registerAction(INPUT_ACTION_TOGGLE_TRACE);
         game.inputContext->registerAction(INPUT_ACTION_TOGGLE_EDIT);
         game.inputContext->registerAction(INPUT_ACTION_ESCAPE);
         game.inputContext->registerAction(INPUT_ACTION_SAVE);
@@ -129,6 +137,16 @@ namespace Game {
                     if(!game.level.freeCam) TurnRight(game.level, *game.levelRenderer.camera);
                     break;
                 case INPUT_ACTION_TOGGLE_FPS:
+                    game.showProfiler = !game.showProfiler;
+                    SetProfilerEnabled(game.showProfiler || IsTraceRecording());
+                    break;
+                case INPUT_ACTION_TOGGLE_TRACE:
+                    if(IsTraceRecording()) {
+                        StopTraceRecording();
+                    } else {
+                        StartTraceRecording(MakeTraceFilename());
+                    }
+                    SetProfilerEnabled(game.showProfiler || IsTraceRecording());
                     break;
                 case INPUT_ACTION_TOGGLE_FREECAM:
                     game.level.freeCam = !game.level.freeCam;
@@ -174,6 +192,7 @@ namespace Game {
     }
 
     void InitGame(Game& game) {
+        srand(game.randomSeed != 0 ? game.randomSeed : (u32) time(nullptr));
         setupInputMappings();
         setupInputContext(game);
         CreateFont(game.font, "assets/fonts/OpenSans-Semibold.ttf", 32);
@@ -222,15 +241,81 @@ namespace Game {
         CreateModelInstance(game.level, 5, 1, CubeSide::NORTH, 1.0f, benchModel);
         CreateModelInstance(game.level, 7, 1, CubeSide::EAST, 1.0f, benchModel);
 
+        StartFileWatcher(game.fileWatcher, {"shaders", "assets", "assets/models"});
+    }
+
+    void SetCameraScript(Game& game, const std::string& script) {
+        game.cameraScript = script;
+        game.cameraScriptPos = 0;
+    }
+
+    bool IsCameraScriptDone(Game& game) {
+        return game.cameraScriptPos >= game.cameraScript.size() && game.cameraScriptWait <= 0.0f &&
+               game.levelRenderer.camera->animations.empty();
     }
 
-    void UpdateGame(Game& game, float frameDelta) {
+    static void stepCameraScript(Game& game, float frameDelta) {
+        auto& camera = *game.levelRenderer.camera;
+        if(game.cameraScriptWait > 0.0f) {
+            game.cameraScriptWait -= frameDelta;
+            return;
+        }
+        if(game.cameraScriptPos >= game.cameraScript.size() || !camera.animations.empty())
+            return;
+        switch(game.cameraScript[game.cameraScriptPos++]) {
+            case 'f': MoveForward(game.level, camera); break;
+            case 'b': MoveBackward(game.level, camera); break;
+            case 'l': MoveLeft(game.level, camera); break;
+            case 'r': MoveRight(game.level, camera); break;
+            case 'q': TurnLeft(game.level, camera); break;
+            case 'e': TurnRight(game.level, camera); break;
+            case 'o': OpenDoor(game.level); break;
+            case '.': game.cameraScriptWait = game.level.moveDuration; break;
+            default: break;
+        }
+    }
+
+    static void reloadChangedFiles(Game& game) {
+        PollFileChanges(game.fileWatcher, game.changedFiles);
+        for(auto& file : game.changedFiles) {
+            ReloadLevelRendererFile(game.levelRenderer, file);
+        }
+    }
+
+    static void tickGame(Game& game, float tickDelta) {
+        PROFILE_SCOPE("TickGame");
+        TickLevel(game.level, game.levelRenderer, tickDelta);
         handleMouseInput(game);
-        handleInput(game, frameDelta);
+        handleInput(game, tickDelta);
+        stepCameraScript(game, tickDelta);
+        UpdateLevelRenderer(game.levelRenderer, tickDelta);
+        game.tickCount++;
+    }
 
-        UpdateLevel(game.level, game.levelRenderer, frameDelta);
-        UpdateLevelRenderer(game.levelRenderer, frameDelta);
-        RenderLevel(game.levelRenderer, frameDelta);
+    void UpdateGame(Game& game, float frameDelta, u32 slot) {
+        PROFILE_SCOPE("UpdateGame");
+
+        const float tickDelta = 1.0f / game.tickRate;
+        game.tickAccumulator += frameDelta;
+        i32 ticks = 0;
+        while(game.tickAccumulator >= tickDelta) {
+            if(ticks == GAME_MAX_TICKS_PER_FRAME) {
+                SDL_Log("Simulation %.1f ms behind, skipping", game.tickAccumulator * 1000.0);
+                game.tickAccumulator = 0.0;
+                break;
+            }
+            tickGame(game, tickDelta);
+            game.tickAccumulator -= tickDelta;
+            ticks++;
+        }
+        float alpha = (float) (game.tickAccumulator / tickDelta);
+
+        UpdateLevel(game.level, game.levelRenderer, game.levelRenderer.frames[slot], alpha);
+        if(game.showProfiler) {
+            DrawProfilerOverlay(&game.showProfiler);
+            // closed with the window button or recording toggled from the overlay
+            SetProfilerEnabled(game.showProfiler || IsTraceRecording());
+        }
 
         /*
         UpdateAnimations(game.animation, frameDelta);
@@ -268,11 +353,22 @@ namespace Game {
         PushTransform(game.renderer->renderBuffer, glm::identity<glm::mat4>());
 
         //PushLine(game.renderer->renderBuffer, Vector2(0, 0), Vector2(100, 100), Renderer::YELLOW);
+        UploadGlyphCache(game.font);
         UpdateRenderer(*game.renderer, frameDelta);
          */
     }
     
+    void RenderGame(Game& game, u32 slot) {
+        PROFILE_SCOPE("RenderGame");
+        reloadChangedFiles(game);
+        auto& frame = game.levelRenderer.frames[slot];
+        UploadLevelMesh(game.levelRenderer, frame);
+        RenderLevel(game.levelRenderer, frame);
+    }
+
     void ShutdownGame(Game& game) {
+        StopTraceRecording();
+        StopFileWatcher(game.fileWatcher);
         ShutdownLevel(game.level);
         ShutdownLevelRenderer(game.levelRenderer);
         /*
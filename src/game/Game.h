@@ -12,6 +12,12 @@
 #include "animation/Animations.h"
 #include "../renderer/LevelRenderer.h"
 #include "level/Level.h"
+#include "../util/FileWatcher.h"
+
+// simulation steps per second, rendering runs at any rate and blends between the last two steps
+#define GAME_TICK_RATE 60
+// frames that fall further behind than this drop the time instead of stepping to catch up
+#define GAME_MAX_TICKS_PER_FRAME 8
 
 namespace Game {
     struct Game {
@@ -20,6 +26,18 @@ namespace Game {
         Level level;
         Renderer::Font font;
         bool quitFlag;
+        bool showProfiler = false;
+        float tickRate = GAME_TICK_RATE;
+        // time not yet simulated, in seconds
+        double tickAccumulator = 0.0;
+        u64 tickCount = 0;
+        // seeds rand in InitGame, 0 uses the current time
+        u32 randomSeed = 0;
+        std::string cameraScript;
+        size_t cameraScriptPos = 0;
+        float cameraScriptWait = 0.0f;
+        FileWatcher fileWatcher;
+        std::vector<std::string> changedFiles;
 
         /*
         u32 animId;
@@ -29,8 +47,16 @@ namespace Game {
     };
 
     void InitGame(Game& game);
-    void UpdateGame(Game& game, float frameDelta);
+    // runs as many fixed simulation ticks as frameDelta covers, then builds a frame between the last two into
+    // render packet slot, see RenderThread.h
+    void UpdateGame(Game& game, float frameDelta, u32 slot);
+    // GL side of a frame built by UpdateGame, runs on the thread owning the context
+    void RenderGame(Game& game, u32 slot);
     void ShutdownGame(Game& game);
+    // scripted camera path, one step per character: f/b forward/back, l/r strafe, q/e turn left/right,
+    // o opens the door in front and . waits one move duration. Each step starts when the previous one is done.
+    void SetCameraScript(Game& game, const std::string& script);
+    bool IsCameraScriptDone(Game& game);
 }
 
 #endif
@@ -3,47 +3,51 @@
 //
 
 #include <SDL_log.h>
+#include <algorithm>
 #include "Animations.h"
+#include "../../util/Profiler.h"
 
 namespace Game {
 
     void InitAnimations(Animations &anim) {
-        anim.nextId = 1;
-        
+        anim.frames.clear();
+        anim.animations.clear();
+        anim.loadedAnimations.clear();
+        anim.controllers = AnimationControllers();
+        anim.stoppedControllers.clear();
     }
 
     void ShutdownAnimations(Animations &anim) {
         
     }
 
-    static void buildAnim(Animations &anim, AnimationInfo& info, Renderer::TextureAtlasBuilder& builder, LoadedAnimation& la, const FloatRect* insets) {
-        Renderer::PixelBuffer sheet_pb(info.filename, false);
+    static void buildAnim(Animations &anim, AnimationInfo& info, Renderer::TextureAtlasBuilder& builder, LoadedAnimation& la) {
+        // the sheet is handed to the builder and frames are added as views into it, so each pixel is copied once
+        u32 sheet = builder.addSheet(Renderer::PixelBuffer(info.filename, false));
+        const Renderer::PixelBuffer& sheet_pb = builder.getSheet(sheet);
         u32 widthInFrames = sheet_pb.width / info.frameWidth;
         u32 heightInFrames = sheet_pb.height / info.frameHeight;
-        la.id = info.id;
         la.frameCount = widthInFrames * heightInFrames;
         la.frameWidth = info.frameWidth;
         la.frameHeight = info.frameHeight;
+        la.firstFrame = (u32) anim.frames.size();
 
         for(u32 y = 0; y < heightInFrames; ++y) {
             for(u32 x = 0; x < widthInFrames; ++x) {
-                auto pb = std::make_unique<Renderer::PixelBuffer>(info.frameWidth+2, info.frameHeight+2, Renderer::PixelFormat::RGBA);
-                pb->padding = true;
-                pb->copyFrom(sheet_pb, UIntRect(x * info.frameWidth, info.frameHeight * y, info.frameWidth, info.frameHeight), UIntPos(1,1));
-
-                auto size = pb->getTrimmedSize();
-                UIntRect sizeI = UIntRect(0, 0, pb->width - 2, pb->height - 2);
+                auto frameRect = UIntRect(x * info.frameWidth, info.frameHeight * y, info.frameWidth, info.frameHeight);
+                auto size = sheet_pb.getTrimmedSize(frameRect);
+                UIntRect sizeI = UIntRect(0, 0, info.frameWidth, info.frameHeight);
 
                 Frame frame;
-                frame.textureAtlasId = builder.add(*pb);
+                frame.textureAtlasId = builder.addSubImage(sheet, frameRect, Renderer::AtlasPadding::EMPTY);
                 frame.combatBox = FloatRect((float) size.x, (float) size.y, (float) size.x + (float) size.w, (float) size.y + (float) size.h);
                 frame.delay = 1.0f / (float) info.fps;
 
-                if(insets != nullptr) {
-                    sizeI.x = (u32) ((float) sizeI.w * insets->left);
-                    sizeI.w -= (u32) ((float) sizeI.w * insets->right) + sizeI.x;
-                    sizeI.y = (u32) ((float) sizeI.h * insets->top);
-                    sizeI.h -= (u32) ((float) sizeI.h * insets->bottom) + sizeI.y;
+                if(info.hasInsets) {
+                    sizeI.x = (u32) ((float) sizeI.w * info.insets.left);
+                    sizeI.w -= (u32) ((float) sizeI.w * info.insets.right) + sizeI.x;
+                    sizeI.y = (u32) ((float) sizeI.h * info.insets.top);
+                    sizeI.h -= (u32) ((float) sizeI.h * info.insets.bottom) + sizeI.y;
                     SDL_Log("Anim frame insetted: %d,%d,%d,%d", sizeI.x, sizeI.y, sizeI.w, sizeI.h);
                     frame.box = FloatRect((float) sizeI.x, (float) sizeI.y, (float) sizeI.x + (float) sizeI.w, (float) sizeI.y + (float) sizeI.h);
 
@@ -51,10 +55,6 @@ namespace Game {
                     frame.box = frame.combatBox;
                 }
                 anim.frames.emplace_back(frame);
-                // or framekey together based on animation id and frame id
-                u32 frameId = (u32) anim.frames.size() - 1;
-                u64 frameKey = ((u64) info.id << 32) | (u64) frameId;
-                anim.animationFrames.insert(std::pair(frameKey, frameId));
             }
         }
     }
@@ -62,82 +62,108 @@ namespace Game {
     void LoadAnimations(Animations &anim) {
         auto builder = Renderer::TextureAtlasBuilder(1024, 1024, Renderer::PixelFormat::RGBA);
         for(auto& info : anim.animations) {
-            LoadedAnimation la{};
-            auto insets = anim.insets.find(info.id);
-            if(insets != anim.insets.end()) {
-                buildAnim(anim, info, builder, la, &*insets);
-            } else {
-                buildAnim(anim, info, builder, la, nullptr);
+            // destroyed before it was loaded
+            LoadedAnimation* la = anim.loadedAnimations.find(info.id);
+            if(la != nullptr) {
+                buildAnim(anim, info, builder, *la);
             }
-            anim.loadedAnimations.insert(la.id, la);
         }
-        anim.insets.clear();
         anim.animations.clear();
         builder.build(anim.textureAtlas);
         SDL_Log("Loaded %zu animation(s)", anim.loadedAnimations.size());
     }
 
+    static u32 controllerHandle(const AnimationControllers& c, size_t index) {
+        return c.slots.handleOf(c.slot[index]);
+    }
+
+    // dense index of a live handle, -1 for a stale or invalid one
+    static i64 controllerIndex(const AnimationControllers& c, u32 handle) {
+        return c.slots.indexOf(handle);
+    }
+
+    template<typename T>
+    static void swapRemove(std::vector<T>& v, size_t index) {
+        v[index] = v.back();
+        v.pop_back();
+    }
+
+    static void removeController(AnimationControllers& c, u32 handle) {
+        i64 found = controllerIndex(c, handle);
+        if(found < 0)
+            return;
+        auto index = (size_t) found;
+        u32 slot = c.slot[index];
+        swapRemove(c.timer, index);
+        swapRemove(c.delay, index);
+        swapRemove(c.currentFrame, index);
+        swapRemove(c.frameCount, index);
+        swapRemove(c.flags, index);
+        swapRemove(c.firstFrame, index);
+        swapRemove(c.animationId, index);
+        swapRemove(c.slot, index);
+        // the last controller took its place
+        if(index < c.slot.size())
+            c.slots.move(c.slot[index], (u32) index);
+        c.slots.release(slot);
+    }
+
     void UpdateAnimations(Animations &anim, float delta) {
-        for(auto& id : anim.playingControllers) {
-            auto controller = anim.controllers.find(id);
-            if(controller == anim.controllers.end()) {
-                SDL_Log("Animations controller %d not found", id);
-                continue;
-            }
-            u64 frameKey = ((u64) controller->animationId << 32) | (u64) controller->currentFrame;
-            auto frameId = anim.animationFrames.find(frameKey);
-            if(frameId == anim.animationFrames.end()) {
-                SDL_Log("Animations frame %ld not found", frameKey);
+        PROFILE_SCOPE("UpdateAnimations");
+        auto& c = anim.controllers;
+        size_t count = c.timer.size();
+        float* timer = c.timer.data();
+        const float* delay = c.delay.data();
+        i32* currentFrame = c.currentFrame.data();
+        const i32* frameCount = c.frameCount.data();
+        u32* flags = c.flags.data();
+        // the common case for everyone, no branches so it vectorizes. A step past the first or last frame is
+        // left undone and flagged
+        u32 atEnd = 0;
+        for(size_t i = 0; i < count; ++i) {
+            float t = timer[i] + delta;
+            i32 step = t >= delay[i] ? 1 : 0;
+            // at most one frame a call, so the carried remainder is capped at a frame or a delay shorter than the
+            // tick would make it grow forever
+            timer[i] = std::min(t - delay[i] * (float) step, delay[i]);
+            // +1 or -1
+            i32 direction = 1 - (i32) ((flags[i] & ANIMATION_FLAG_REVERSE) >> 1);
+            i32 next = currentFrame[i] + step * direction;
+            // one unsigned compare catches stepping below 0 too
+            u32 end = (u32) next >= (u32) frameCount[i] ? 1u : 0u;
+            currentFrame[i] = next - (i32) end * step * direction;
+            flags[i] |= end * ANIMATION_FLAG_AT_END;
+            atEnd += end;
+        }
+        for(size_t i = 0; i < count && atEnd > 0; ++i) {
+            if((flags[i] & ANIMATION_FLAG_AT_END) == 0)
                 continue;
-            }
-
-            if(controller->timer >= anim.frames[frameId->second].delay) {
-                controller->timer = 0;
-                if(controller->reverse) {
-                    if(controller->currentFrame == 0) {
-                        if(controller->repeatType == RepeatType::ReverseOnce) {
-                            anim.stoppedControllers.emplace_back(id);
-                            SDL_Log("Animations %d stopped", id);
-                            continue;
-                        } else if(controller->repeatType == RepeatType::Reverse) {
-                            controller->currentFrame = controller->frameCount - 1;
-                        } else {
-                            controller->currentFrame++;
-                        }
-                    } else {
-                        controller->currentFrame--;
-                    }
+            atEnd--;
+            flags[i] &= ~ANIMATION_FLAG_AT_END;
+            auto repeatType = (RepeatType) (flags[i] & ANIMATION_FLAG_REPEAT_MASK);
+            if((flags[i] & ANIMATION_FLAG_REVERSE) != 0) {
+                // stepped back from the first frame
+                if(repeatType == RepeatType::ReverseOnce) {
+                    anim.stoppedControllers.emplace_back(controllerHandle(c, i));
+                } else if(repeatType == RepeatType::Reverse) {
+                    currentFrame[i] = frameCount[i] - 1;
                 } else {
-                    if(controller->currentFrame == controller->frameCount - 1) {
-                        if(controller->repeatType == RepeatType::Once) {
-                            anim.stoppedControllers.emplace_back(id);
-                            SDL_Log("Animations %d stopped", id);
-                            continue;
-                        } else if(controller->repeatType == RepeatType::Restart) {
-                            controller->currentFrame = 0;
-                        } else if(controller->repeatType == RepeatType::Reverse || controller->repeatType == RepeatType::ReverseOnce) {
-                            controller->reverse = true;
-                            controller->currentFrame--;
-                        } else {
-                            controller->currentFrame++;
-                        }
-                    } else {
-                        controller->currentFrame++;
-                    }
+                    currentFrame[i] = std::min(1, frameCount[i] - 1);
                 }
             } else {
-                controller->timer += delta;
+                // stepped on from the last frame
+                if(repeatType == RepeatType::Once) {
+                    anim.stoppedControllers.emplace_back(controllerHandle(c, i));
+                } else if(repeatType == RepeatType::Restart) {
+                    currentFrame[i] = 0;
+                } else {
+                    flags[i] |= ANIMATION_FLAG_REVERSE;
+                    currentFrame[i] = std::max(frameCount[i] - 2, 0);
+                }
             }
         }
-        for(auto& id : anim.stoppedControllers) {
-            auto controller = anim.controllers.find(id);
-            if(controller == anim.controllers.end()) {
-                SDL_Log("Animations controller %d not found", id);
-                continue;
-            }
-            SDL_Log("Removing animation controller %d", id);
-            anim.playingControllers.erase(std::remove(anim.playingControllers.begin(), anim.playingControllers.end(), id), anim.playingControllers.end());
-            anim.controllers.remove(id);
+        for(auto& handle : anim.stoppedControllers) {
+            removeController(c, handle);
         }
         anim.stoppedControllers.clear();
     }
@@ -145,57 +171,100 @@ namespace Game {
 
     u32 CreateAnimation(Animations &anim, u32 frameWidth, u32 frameHeight, u32 fps, const std::string &filename, const FloatRect* insets) {
         AnimationInfo info;
-        info.id = anim.nextId++;
+        // the id is good right away, the animation can't play until it's loaded
+        info.id = anim.loadedAnimations.insert(LoadedAnimation{});
         info.frameWidth = frameWidth;
         info.frameHeight = frameHeight;
         info.filename = filename;
         info.fps = fps;
-        anim.animations.insert(info.id, info);
-        if(insets) {
-            anim.insets.insert(info.id, *insets);
-        }
+        info.hasInsets = insets != nullptr;
+        info.insets = insets != nullptr ? *insets : FloatRect();
+        anim.animations.emplace_back(info);
         return info.id;
     }
 
-    void DestroyAnimation(Animations &anim, u32 id) {
+    u32 AddAnimation(Animations &anim, const u32* atlasIds, u16 frameCount, u16 frameWidth, u16 frameHeight, u32 fps) {
+        LoadedAnimation la{};
+        la.frameWidth = frameWidth;
+        la.frameHeight = frameHeight;
+        la.frameCount = frameCount;
+        la.firstFrame = (u32) anim.frames.size();
+        auto box = FloatRect(0, 0, (float) frameWidth, (float) frameHeight);
+        for(u16 i = 0; i < frameCount; ++i) {
+            anim.frames.emplace_back(Frame{1.0f / (float) fps, atlasIds[i], box, box});
+        }
+        return anim.loadedAnimations.insert(la);
+    }
 
+    void DestroyAnimation(Animations &anim, u32 id) {
+        // its frames stay in anim.frames, controllers already playing it keep going
+        anim.loadedAnimations.remove(id);
     }
 
-    u32 PlayAnimation(Animations &anim, u32 id, RepeatType repeatType, bool reverse) {
-        AnimationController controller{};
-        controller.id = anim.nextId++;
-        controller.animationId = id;
-        controller.repeatType = repeatType;
-        controller.reverse = reverse;
-        controller.currentFrame = 0;
-        controller.timer = 0;
-        controller.frameCount = anim.loadedAnimations.find(id)->frameCount;
-        anim.controllers.insert(controller.id, controller);
-        anim.playingControllers.emplace_back(controller.id);
-        SDL_Log("Playing animation controller %d", controller.id);
-        return controller.id;
+    u32 PlayAnimation(Animations &anim, u32 id, RepeatType repeatType, bool reverse, u32 startFrame) {
+        auto la = anim.loadedAnimations.find(id);
+        if(la == nullptr || la->frameCount == 0) {
+            SDL_Log("Animations animation %d not found or not loaded", id);
+            return 0;
+        }
+        auto& c = anim.controllers;
+        u32 handle = c.slots.acquire((u32) c.timer.size());
+        c.timer.push_back(0);
+        // frames of an animation share its fps
+        c.delay.push_back(anim.frames[la->firstFrame].delay);
+        c.currentFrame.push_back((i32) (startFrame % la->frameCount));
+        c.frameCount.push_back(la->frameCount);
+        c.flags.push_back((u32) repeatType | (reverse ? ANIMATION_FLAG_REVERSE : 0u));
+        c.firstFrame.push_back(la->firstFrame);
+        c.animationId.push_back(id);
+        c.slot.push_back(handle & SLOT_MAP_INDEX_MASK);
+        return handle;
     }
 
     void StopAnimation(Animations &anim, u32 controllerId) {
         anim.stoppedControllers.emplace_back(controllerId);
     }
 
+    void StopAllAnimations(Animations &anim) {
+        auto& c = anim.controllers;
+        for(u32 slot : c.slot) {
+            c.slots.release(slot);
+        }
+        c.timer.clear();
+        c.delay.clear();
+        c.currentFrame.clear();
+        c.frameCount.clear();
+        c.flags.clear();
+        c.firstFrame.clear();
+        c.animationId.clear();
+        c.slot.clear();
+        anim.stoppedControllers.clear();
+    }
+
+    bool IsAnimationPlaying(const Animations &anim, u32 controllerId) {
+        return controllerIndex(anim.controllers, controllerId) >= 0;
+    }
+
+    size_t GetAnimationControllerCount(const Animations &anim) {
+        return anim.controllers.timer.size();
+    }
+
+    u32 GetAnimationFrame(const Animations &anim, u32 controllerId) {
+        i64 index = controllerIndex(anim.controllers, controllerId);
+        return index >= 0 ? (u32) anim.controllers.currentFrame[index] : 0;
+    }
+
     void RenderAnimation(Animations &anim, u32 controllerId, Renderer::RenderBuffer &renderBuffer, float x, float y) {
-        auto controller = anim.controllers.find(controllerId);
-        if(controller == anim.controllers.end()) {
+        auto& c = anim.controllers;
+        i64 index = controllerIndex(c, controllerId);
+        if(index < 0) {
             SDL_Log("Animations controller %d not found", controllerId);
             return;
         }
-        u64 frameKey = ((u64) controller->animationId << 32) | (u64) controller->currentFrame;
-        auto frameId = anim.animationFrames.find(frameKey);
-        if(frameId == anim.animationFrames.end()) {
-            SDL_Log("Animations frame %ld not found", frameKey);
-            return;
-        }
-        auto& frame = anim.frames[frameId->second];
-        auto la = anim.loadedAnimations.find(controller->animationId);
-        if(la == anim.loadedAnimations.end()) {
-            SDL_Log("Animations loaded animation %d not found", controller->animationId);
+        auto& frame = anim.frames[c.firstFrame[index] + c.currentFrame[index]];
+        auto la = anim.loadedAnimations.find(c.animationId[index]);
+        if(la == nullptr) {
+            SDL_Log("Animations loaded animation %d not found", c.animationId[index]);
             return;
         }
         Renderer::AtlasQuad q = {
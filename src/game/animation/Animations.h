@@ -9,7 +9,14 @@
 #include <unordered_map>
 #include "Vector2.h"
 #include "../../renderer/RenderBuffer.h"
-#include "SparseVector.h"
+#include "SlotMap.h"
+
+#define ANIMATION_FLAG_REPEAT_MASK 0x3u
+#define ANIMATION_FLAG_REVERSE 0x4u
+// set by the update pass for controllers that stepped past the first or last frame
+#define ANIMATION_FLAG_AT_END 0x8u
+// controller handles come out of a SlotTable like SlotMap handles, 0 is never a valid handle
+#define ANIMATION_MAX_CONTROLLERS SLOT_MAP_MAX_SIZE
 
 namespace Game {
     enum class RepeatType {
@@ -26,54 +33,75 @@ namespace Game {
         FloatRect combatBox;
     };
 
+    // waiting for LoadAnimations
     struct AnimationInfo {
         u32 id;
         u16 frameWidth;
         u16 frameHeight;
         u16 fps;
         std::string filename;
+        bool hasInsets;
+        FloatRect insets;
     };
 
+    // the frames of an animation are consecutive in Animations::frames, frameCount is 0 until it's loaded
     struct LoadedAnimation {
-        u32 id;
         u16 frameWidth;
         u16 frameHeight;
         u16 frameCount;
+        u32 firstFrame;
     };
 
-    struct AnimationController {
-        u32 id;
-        u32 animationId;
-        RepeatType repeatType;
-        bool reverse;
-        u32 currentFrame;
-        u16 frameCount;
-        float timer;
+    // Controllers are parallel arrays behind a SlotTable, a handle's slot points at the controller's place in the
+    // dense arrays. Stopping one moves the last controller into its place and releases its slot, so the arrays stay
+    // packed and old handles stop resolving.
+    // UpdateAnimations is one branch free pass over timer, delay, currentFrame, frameCount and flags, controllers
+    // stepping past either end of their animation are flagged and handled after it.
+    struct AnimationControllers {
+        // dense, one entry per playing controller
+        std::vector<float> timer;
+        std::vector<float> delay;               // seconds per frame
+        std::vector<i32> currentFrame;
+        std::vector<i32> frameCount;
+        std::vector<u32> flags;                 // RepeatType in the low bits, ANIMATION_FLAG_*
+        std::vector<u32> firstFrame;            // the frame shown is Animations::frames[firstFrame + currentFrame]
+        std::vector<u32> animationId;
+        std::vector<u32> slot;                  // back to the slot, to fix it up when the entry moves
+        SlotTable slots;
     };
 
     struct Animations {
         Renderer::TextureAtlas textureAtlas;
-        u32 nextId;
-        SparseVector<FloatRect> insets;
         std::vector<Frame> frames;
-        std::unordered_map<u64, u32> animationFrames;
-        SparseVector<AnimationInfo> animations;
-        SparseVector<LoadedAnimation> loadedAnimations;
-        SparseVector<AnimationController> controllers;
-        std::vector<u32> playingControllers;
+        std::vector<AnimationInfo> animations;
+        // the animation ids handed out are handles into this
+        SlotMap<LoadedAnimation> loadedAnimations;
+        // every controller in here is playing
+        AnimationControllers controllers;
         std::vector<u32> stoppedControllers;
     };
 
+    // also clears everything, an Animations can be initialized again to start over
     void InitAnimations(Animations& anim);
     void ShutdownAnimations(Animations& anim);
     void LoadAnimations(Animations& anim);
     void UpdateAnimations(Animations & anim, float delta);
 
     u32 CreateAnimation(Animations& anim, u32 frameWidth, u32 frameHeight, u32 fps, const std::string& filename, const FloatRect* insets);
+    // an animation whose frames were added to an atlas the caller builds (like the level sprite atlas), atlasIds are
+    // the ids that builder handed out for the frames in order. Usable right away, no LoadAnimations needed
+    u32 AddAnimation(Animations& anim, const u32* atlasIds, u16 frameCount, u16 frameWidth, u16 frameHeight, u32 fps);
     void DestroyAnimation(Animations& anim, u32 id);
 
-    u32 PlayAnimation(Animations& anim, u32 id, RepeatType repeatType, bool reverse);
+    // returns the controller's handle
+    u32 PlayAnimation(Animations& anim, u32 id, RepeatType repeatType, bool reverse, u32 startFrame = 0);
+    // takes effect at the end of the next UpdateAnimations, stale handles are ignored
     void StopAnimation(Animations& anim, u32 controllerId);
+    void StopAllAnimations(Animations& anim);
+    bool IsAnimationPlaying(const Animations& anim, u32 controllerId);
+    size_t GetAnimationControllerCount(const Animations& anim);
+    // frame the controller is on (0 - frameCount-1), 0 for a controller that's gone
+    u32 GetAnimationFrame(const Animations& anim, u32 controllerId);
 
     void RenderAnimation(Animations& anim, u32 controllerId, Renderer::RenderBuffer& renderBuffer, float x, float y);
 }
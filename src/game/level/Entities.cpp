@@ -0,0 +1,112 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <stdexcept>
+#include <string>
+#include "Entities.h"
+
+namespace Game {
+    static Entity& nextLink(CellIndex& cells, Entity entity) {
+        u32 slot = entity & SLOT_MAP_INDEX_MASK;
+        if(slot >= cells.next.size())
+            cells.next.resize(slot + 1, 0);
+        return cells.next[slot];
+    }
+
+    static void linkCell(CellIndex& cells, Entity entity, i32 x, i32 y) {
+        Entity& head = cells.heads[y * cells.width + x];
+        nextLink(cells, entity) = head;
+        head = entity;
+    }
+
+    // cells rarely hold more than a few entities, the walk to find the link pointing at it is short
+    static void unlinkCell(CellIndex& cells, Entity entity, i32 x, i32 y) {
+        Entity* link = &cells.heads[y * cells.width + x];
+        while(*link != 0 && *link != entity) {
+            link = &nextLink(cells, *link);
+        }
+        if(*link == entity) {
+            *link = nextLink(cells, entity);
+            nextLink(cells, entity) = 0;
+        }
+    }
+
+    void InitEntities(Entities& e, i32 width, i32 height) {
+        e.entities.clear();
+        ClearComponents(e.gridPositions);
+        ClearComponents(e.worldPositions);
+        ClearComponents(e.sprites);
+        ClearComponents(e.models);
+        ClearComponents(e.doors);
+        ClearComponents(e.lights);
+        e.cells.width = width;
+        e.cells.height = height;
+        e.cells.heads.assign((size_t) width * height, 0);
+        std::fill(e.cells.next.begin(), e.cells.next.end(), 0);
+    }
+
+    Entity CreateEntity(Entities& e, u32 tags) {
+        return e.entities.insert(EntityInfo{tags});
+    }
+
+    void DestroyEntity(Entities& e, Entity entity) {
+        if(!e.entities.remove(entity))
+            return;
+        auto grid = GetComponent(e.gridPositions, entity);
+        if(grid != nullptr)
+            unlinkCell(e.cells, entity, grid->x, grid->y);
+        RemoveComponent(e.gridPositions, entity);
+        RemoveComponent(e.worldPositions, entity);
+        RemoveComponent(e.sprites, entity);
+        RemoveComponent(e.models, entity);
+        RemoveComponent(e.doors, entity);
+        RemoveComponent(e.lights, entity);
+    }
+
+    bool IsEntityAlive(const Entities& e, Entity entity) {
+        return e.entities.contains(entity);
+    }
+
+    u32 GetEntityTags(const Entities& e, Entity entity) {
+        const EntityInfo* info = e.entities.find(entity);
+        return info != nullptr ? info->tags : 0;
+    }
+
+    size_t CountEntities(const Entities& e, u32 tags) {
+        size_t count = 0;
+        for(auto& info : e.entities) {
+            if((info.tags & tags) == tags)
+                count++;
+        }
+        return count;
+    }
+
+    void SetEntityCell(Entities& e, Entity entity, i32 x, i32 y) {
+        if(x < 0 || x >= e.cells.width || y < 0 || y >= e.cells.height)
+            throw std::runtime_error("Entity cell " + std::to_string(x) + ", " + std::to_string(y) + " is outside the level");
+        if(!e.entities.contains(entity))
+            return;
+        auto grid = GetComponent(e.gridPositions, entity);
+        if(grid != nullptr) {
+            if(grid->x == x && grid->y == y)
+                return;
+            unlinkCell(e.cells, entity, grid->x, grid->y);
+            *grid = GridPosition{x, y};
+        } else {
+            AddComponent(e.gridPositions, entity, GridPosition{x, y});
+        }
+        linkCell(e.cells, entity, x, y);
+    }
+
+    Entity GetFirstEntityAt(const Entities& e, i32 x, i32 y) {
+        if(x < 0 || x >= e.cells.width || y < 0 || y >= e.cells.height)
+            return 0;
+        return e.cells.heads[y * e.cells.width + x];
+    }
+
+    Entity GetNextEntityInCell(const Entities& e, Entity entity) {
+        u32 slot = entity & SLOT_MAP_INDEX_MASK;
+        return slot < e.cells.next.size() ? e.cells.next[slot] : 0;
+    }
+}
@@ -0,0 +1,208 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_ENTITIES_H
+#define CRAWLER_ENTITIES_H
+
+#include <vector>
+#include <algorithm>
+#include "defs.h"
+#include "SlotMap.h"
+#include "glm/ext.hpp"
+#include "../../renderer/LevelRenderer.h"
+
+// Level entities are handles out of a SlotMap, their data lives in one ComponentPool per component type. A pool keeps
+// its components packed together with the entity owning each, and an index by entity slot to find them, so a
+// system walks one contiguous array and only looks up the other components it needs. Adding and removing is O(1),
+// removing moves the pool's last component into the hole. A handle whose entity was destroyed finds nothing in any
+// pool, even after its slot is reused.
+//
+// Every entity with a grid position is also in the cell index, a list per map cell threaded through a next link
+// per entity slot, so what's in a cell is found without looking at anything else. SetEntityCell places and moves
+// entities and keeps the index up to date, grid positions must not be added or changed directly.
+
+// tags, an entity has any mix of them and they carry no data
+#define ENTITY_TAG_MONSTER 0x1u
+#define ENTITY_TAG_OBJECT 0x2u
+#define COMPONENT_NONE 0xFFFFFFFFu
+
+namespace Game {
+    // 0 is never an entity
+    typedef u32 Entity;
+
+    enum CellCorner { NW, NE, SW, SE, CENTER };
+    enum CellAxis { CELL_AXIS_XY, CELL_AXIS_ZY };
+
+    struct GridPosition {
+        i32 x;
+        i32 y;
+    };
+
+    struct Sprite {
+        CellCorner corner;
+        glm::vec2 size;
+        glm::vec2 direction;
+        u32 textures[4];
+        bool uniDirectional;
+        // for animated sprites the first frame of each side in Level::spriteAnimations and the handle of the
+        // controller picking the frame, 0 for still sprites
+        u32 firstFrames[4];
+        u32 animation;
+    };
+
+    struct Door {
+        CellAxis axis;
+        bool open;
+        u32 modelIndex;
+        bool opening;
+        bool closing;
+        float duration;
+        float elapsed;
+        float offsetY;
+        float previousOffsetY;  // offsetY at the start of the last tick
+        float targetOffsetY;
+    };
+
+    struct ModelInstance {
+        Renderer::CubeSide alignSide;
+        float scale;
+        u32 modelIndex;
+    };
+
+    struct LightSource {
+        glm::vec3 diffuse;
+    };
+
+    template <typename T>
+    struct ComponentPool {
+        std::vector<T> components;
+        std::vector<Entity> owners;             // the entity of each component
+        std::vector<u32> index;                 // by entity slot, COMPONENT_NONE when it has no component here
+    };
+
+    struct EntityInfo {
+        u32 tags;
+    };
+
+    struct CellIndex {
+        i32 width = 0;
+        i32 height = 0;
+        std::vector<Entity> heads;              // by cell, the first entity in it, 0 for none
+        std::vector<Entity> next;               // by entity slot, the next entity in its cell, 0 at the end
+    };
+
+    struct Entities {
+        SlotMap<EntityInfo> entities;
+        ComponentPool<GridPosition> gridPositions;
+        // where it's drawn, sprites sit at their corner of the cell
+        ComponentPool<glm::vec3> worldPositions;
+        ComponentPool<Sprite> sprites;
+        ComponentPool<ModelInstance> models;
+        ComponentPool<Door> doors;
+        ComponentPool<LightSource> lights;
+        CellIndex cells;
+    };
+
+    // destroys everything and sizes the cell index for a width x height map, handles handed out so far go stale
+    void InitEntities(Entities& e, i32 width, i32 height);
+    Entity CreateEntity(Entities& e, u32 tags = 0);
+    // removes every component, the handle goes stale
+    void DestroyEntity(Entities& e, Entity entity);
+    bool IsEntityAlive(const Entities& e, Entity entity);
+    u32 GetEntityTags(const Entities& e, Entity entity);
+    // entities with every one of tags
+    size_t CountEntities(const Entities& e, u32 tags);
+    // gives the entity its grid position or moves it, throws for a cell outside the map
+    void SetEntityCell(Entities& e, Entity entity, i32 x, i32 y);
+    // walks the entities in a cell, 0 when there are no more. Outside the map a cell is empty
+    Entity GetFirstEntityAt(const Entities& e, i32 x, i32 y);
+    Entity GetNextEntityInCell(const Entities& e, Entity entity);
+
+    template <typename T>
+    T& AddComponent(ComponentPool<T>& pool, Entity entity, const T& component) {
+        u32 slot = entity & SLOT_MAP_INDEX_MASK;
+        if(slot >= pool.index.size())
+            pool.index.resize(slot + 1, COMPONENT_NONE);
+        if(pool.index[slot] != COMPONENT_NONE && pool.owners[pool.index[slot]] == entity) {
+            pool.components[pool.index[slot]] = component;
+            return pool.components[pool.index[slot]];
+        }
+        pool.index[slot] = (u32) pool.components.size();
+        pool.components.push_back(component);
+        pool.owners.push_back(entity);
+        return pool.components.back();
+    }
+
+    // nullptr when the entity has none or is gone, good until the next add or remove on the pool
+    template <typename T>
+    T* GetComponent(ComponentPool<T>& pool, Entity entity) {
+        u32 slot = entity & SLOT_MAP_INDEX_MASK;
+        if(slot >= pool.index.size() || pool.index[slot] == COMPONENT_NONE || pool.owners[pool.index[slot]] != entity)
+            return nullptr;
+        return &pool.components[pool.index[slot]];
+    }
+
+    template <typename T>
+    const T* GetComponent(const ComponentPool<T>& pool, Entity entity) {
+        return GetComponent(const_cast<ComponentPool<T>&>(pool), entity);
+    }
+
+    template <typename T>
+    void RemoveComponent(ComponentPool<T>& pool, Entity entity) {
+        u32 slot = entity & SLOT_MAP_INDEX_MASK;
+        if(slot >= pool.index.size() || pool.index[slot] == COMPONENT_NONE || pool.owners[pool.index[slot]] != entity)
+            return;
+        u32 i = pool.index[slot];
+        pool.components[i] = pool.components.back();
+        pool.components.pop_back();
+        pool.owners[i] = pool.owners.back();
+        pool.owners.pop_back();
+        pool.index[slot] = COMPONENT_NONE;
+        // the last component took its place
+        if(i < pool.owners.size())
+            pool.index[pool.owners[i] & SLOT_MAP_INDEX_MASK] = i;
+    }
+
+    template <typename Fn>
+    void ForEachEntityAt(const Entities& e, i32 x, i32 y, Fn fn) {
+        for(Entity entity = GetFirstEntityAt(e, x, y); entity != 0; entity = GetNextEntityInCell(e, entity)) {
+            fn(entity);
+        }
+    }
+
+    // every cell from (x0, y0) to (x1, y1) inclusive, clipped to the map
+    template <typename Fn>
+    void ForEachEntityIn(const Entities& e, i32 x0, i32 y0, i32 x1, i32 y1, Fn fn) {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, e.cells.width - 1);
+        y1 = std::min(y1, e.cells.height - 1);
+        for(i32 y = y0; y <= y1; ++y) {
+            for(i32 x = x0; x <= x1; ++x) {
+                for(Entity entity = e.cells.heads[y * e.cells.width + x]; entity != 0; entity = GetNextEntityInCell(e, entity)) {
+                    fn(entity);
+                }
+            }
+        }
+    }
+
+    // the first entity in the cell with a component in pool, 0 for none
+    template <typename T>
+    Entity FindEntityAt(const Entities& e, const ComponentPool<T>& pool, i32 x, i32 y) {
+        for(Entity entity = GetFirstEntityAt(e, x, y); entity != 0; entity = GetNextEntityInCell(e, entity)) {
+            if(GetComponent(pool, entity) != nullptr)
+                return entity;
+        }
+        return 0;
+    }
+
+    template <typename T>
+    void ClearComponents(ComponentPool<T>& pool) {
+        pool.components.clear();
+        pool.owners.clear();
+        std::fill(pool.index.begin(), pool.index.end(), COMPONENT_NONE);
+    }
+}
+
+#endif //CRAWLER_ENTITIES_H
@@ -5,12 +5,16 @@
 #include <algorithm>
 #include <cstdio>
 #include <utility>
+#include <stdexcept>
 #include <SDL_log.h>
 #include "Level.h"
+#include "../../util/Profiler.h"
+#include "../../util/JobSystem.h"
 #include <glm/gtx/rotate_vector.hpp>
 
 namespace Game {
-    static void meshCell(Level& r, float x, float y, float z, CubeFaces& faces, std::vector<MeshVertex>& vertices, TextureAtlas& atlas, i32 mapX, i32 mapY) {
+    // writes 6 vertices per face into vertices, see cellVertexCount
+    static void meshCell(Level& r, float x, float y, float z, const CubeFaces& faces, MeshVertex* vertices, const TextureAtlas& atlas, i32 mapX, i32 mapY) {
         // Calculate half size for centering
         float halfSize = CUBE_SIZE / 2.0f;
 
@@ -26,24 +30,24 @@ namespace Game {
 
         // Front face
         if (faces.front) {
-            auto uvRect = atlas.uvRects[faces.front];
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
+            auto& uvRect = atlas.uvRects.at(faces.front);
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
         }
 
         // Back face
         if (faces.back) {
-            auto uvRect = atlas.uvRects[faces.back];
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
+            auto& uvRect = atlas.uvRects.at(faces.back);
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
         }
 
         SetLightColorLeft_LR(r.lighting, mapX, mapY, tl);
@@ -53,24 +57,24 @@ namespace Game {
 
         // Left face
         if (faces.left) {
-            auto uvRect = atlas.uvRects[faces.left];
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
+            auto& uvRect = atlas.uvRects.at(faces.left);
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
         }
 
         // Right face
         if (faces.right) {
-            auto uvRect = atlas.uvRects[faces.right];
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
+            auto& uvRect = atlas.uvRects.at(faces.right);
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
         }
 
         SetLightColorTopLeft_TB(r.lighting, mapX, mapY, tl);
@@ -80,24 +84,24 @@ namespace Game {
 
         // Bottom face
         if (faces.bottom) {
-            auto uvRect = atlas.uvRects[faces.bottom];
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
+            auto& uvRect = atlas.uvRects.at(faces.bottom);
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{halfSize + x, -halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, -halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
         }
 
         // Top face
         if (faces.top) {
-            auto uvRect = atlas.uvRects[faces.top];
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}});
-            vertices.emplace_back(MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}});
+            auto& uvRect = atlas.uvRects.at(faces.top);
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, -halfSize + z}, {uvRect.right, uvRect.top}, {tr.r, tr.g, tr.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{halfSize + x, halfSize + y, halfSize + z}, {uvRect.right, uvRect.bottom}, {br.r, br.g, br.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, halfSize + z}, {uvRect.left, uvRect.bottom}, {bl.r, bl.g, bl.b}};
+            *vertices++ = MeshVertex{{-halfSize + x, halfSize + y, -halfSize + z}, {uvRect.left, uvRect.top}, {tl.r, tl.g, tl.b}};
         }
     }
     
@@ -119,10 +123,7 @@ namespace Game {
         return l.map[index] != '#';
     }
 
-    static void buildCellMesh(Level &l, Renderer::LevelRenderer& r, DepthSortedObject& dso) {
-        auto x = dso.mapX;
-        auto y = dso.mapY;
-
+    static CubeFaces cellFaces(Level &l, Renderer::LevelRenderer& r, i32 x, i32 y) {
         // Determine neighboring cells
         char leftCell = (x > 0) ? l.map[y * l.width + (x - 1)] : '#';
         char rightCell = (x < l.width - 1) ? l.map[y * l.width + (x + 1)] : '#';
@@ -143,9 +144,28 @@ namespace Game {
         faces.right = charToWallTexture(r, rightCell);
         faces.front = charToWallTexture(r, frontCell);
         faces.back = charToWallTexture(r, backCell);
+        return faces;
+    }
+
+    static u32 cellVertexCount(const CubeFaces& faces) {
+        u32 count = (faces.front != 0) + (faces.back != 0) + (faces.left != 0) + (faces.right != 0) +
+                    (faces.top != 0) + (faces.bottom != 0);
+        return count * 6;
+    }
 
-        // Call meshCell function
-        meshCell(l, dso.worldPosition.x, dso.worldPosition.y, dso.worldPosition.z, faces, r.geometryMesh, r.geometryTextureAtlas, x, y);
+    // meshes the cells queued by buildMapMesh into the slices of frame.geometryMesh their batches point at, the
+    // slices don't overlap so the cells are split over the job system
+    static void buildCellMeshes(Level &l, Renderer::LevelRenderer& r, Renderer::LevelFrame& frame) {
+        PROFILE_SCOPE("buildCellMeshes");
+        MeshVertex* vertices = frame.geometryMesh.data();
+        const CellMeshJob* cells = l.cellMeshJobs.data();
+        ParallelFor((u32) l.cellMeshJobs.size(), CELL_MESH_JOB_GRAIN, [&l, &r, vertices, cells](u32 begin, u32 end) {
+            for(u32 i = begin; i < end; ++i) {
+                auto& cell = cells[i];
+                meshCell(l, cell.worldPosition.x, cell.worldPosition.y, cell.worldPosition.z, cell.faces,
+                         vertices + cell.offset, r.geometryTextureAtlas, cell.mapX, cell.mapY);
+            }
+        });
     }
 
     static void normalizeResolution(int width, int height, float scale, float* normalizedWidth, float* normalizedHeight) {
@@ -178,37 +198,54 @@ namespace Game {
         }
     }
 
-    static void calcWorldPosition(Level& l, SpriteEntity& sprite, DepthSortedObject& dso) {
-        auto x = sprite.x;
-        auto y = sprite.y;
-        dso.mapX = x;
-        dso.mapY = y;
-        float worldX = ((float) x) * CUBE_SIZE;
-        float worldZ = ((float) y) * CUBE_SIZE;
-        dso.worldPosition = glm::vec3(worldX, 0.0f, worldZ);
+    static glm::vec3 cellWorldPosition(i32 x, i32 y) {
+        return glm::vec3(((float) x) * CUBE_SIZE, 0.0f, ((float) y) * CUBE_SIZE);
+    }
+
+    static glm::vec3 spriteWorldPosition(i32 x, i32 y, const Sprite& sprite) {
+        glm::vec3 worldPosition = cellWorldPosition(x, y);
 
         // place sprite at floor
         auto halfCubeSize = CUBE_SIZE / 2.0f;
-        dso.worldPosition.y = -halfCubeSize + (sprite.size.y / 2.0f);
+        worldPosition.y = -halfCubeSize + (sprite.size.y / 2.0f);
         switch(sprite.corner) {
             case CellCorner::NW:
-                dso.worldPosition += glm::vec3(-halfCubeSize + (sprite.size.x / 2.0f), 0.0f, -halfCubeSize + (sprite.size.x / 2.0f));
+                worldPosition += glm::vec3(-halfCubeSize + (sprite.size.x / 2.0f), 0.0f, -halfCubeSize + (sprite.size.x / 2.0f));
                 break;
             case CellCorner::NE:
-                dso.worldPosition += glm::vec3(halfCubeSize - (sprite.size.x / 2.0f), 0.0f, -halfCubeSize + (sprite.size.x / 2.0f));
+                worldPosition += glm::vec3(halfCubeSize - (sprite.size.x / 2.0f), 0.0f, -halfCubeSize + (sprite.size.x / 2.0f));
                 break;
             case CellCorner::SW:
-                dso.worldPosition += glm::vec3(-halfCubeSize + (sprite.size.x / 2.0f), 0.0f, halfCubeSize - (sprite.size.x / 2.0f));
+                worldPosition += glm::vec3(-halfCubeSize + (sprite.size.x / 2.0f), 0.0f, halfCubeSize - (sprite.size.x / 2.0f));
                 break;
             case CellCorner::SE:
-                dso.worldPosition += glm::vec3(halfCubeSize - (sprite.size.x / 2.0f), 0.0f, halfCubeSize - (sprite.size.x / 2.0f));
+                worldPosition += glm::vec3(halfCubeSize - (sprite.size.x / 2.0f), 0.0f, halfCubeSize - (sprite.size.x / 2.0f));
                 break;
             case CellCorner::CENTER:
                 break;
         }
+        return worldPosition;
+    }
+
+    // depth sort entry for every entity in pool, a linear walk of the pool looking up the positions of each
+    template <typename T>
+    static void addDepthSortedEntities(Level& l, Renderer::LevelRenderer& r, const ComponentPool<T>& pool, DSOType type) {
+        auto& e = l.entities;
+        for(Entity entity : pool.owners) {
+            auto& grid = *GetComponent(e.gridPositions, entity);
+            auto depthSortedObject = DepthSortedObject{};
+            depthSortedObject.type = type;
+            depthSortedObject.worldPosition = *GetComponent(e.worldPositions, entity);
+            depthSortedObject.mapX = grid.x;
+            depthSortedObject.mapY = grid.y;
+            // sorted by the cell, a sprite in the corner of a cell doesn't pass the cell's walls
+            depthSortedObject.distanceToCamera = glm::distance(r.viewCamera->Position, cellWorldPosition(grid.x, grid.y));
+            depthSortedObject.entity = entity;
+            l.depthSortedObjects.push_back(depthSortedObject);
+        }
     }
 
-    static void buildSpriteMesh(Level &l, Renderer::LevelRenderer& r, DepthSortedObject& dso, glm::vec2& size, u32 texture, CellAxis axis) {
+    static void buildSpriteMesh(Level &l, Renderer::LevelRenderer& r, Renderer::LevelFrame& frame, DepthSortedObject& dso, glm::vec2& size, u32 texture, CellAxis axis) {
         auto x = dso.worldPosition.x;
         auto y = dso.worldPosition.y;
         auto z = dso.worldPosition.z;
@@ -221,20 +258,20 @@ namespace Game {
         GetLightColorAt(l.lighting, dso.mapX, dso.mapY, c);
 
         if(axis == CellAxis::CELL_AXIS_XY) {
-            r.spriteMesh.emplace_back(MeshVertex{{-halfWidth + x, -halfHeight + y, z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{-halfWidth + x, halfHeight + y, z}, {uvRect.left, uvRect.top}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{halfWidth + x, halfHeight + y, z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{halfWidth + x, halfHeight + y, z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{halfWidth + x, -halfHeight + y, z}, {uvRect.right, uvRect.bottom}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{-halfWidth + x, -halfHeight + y, z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{-halfWidth + x, -halfHeight + y, z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{-halfWidth + x, halfHeight + y, z}, {uvRect.left, uvRect.top}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{halfWidth + x, halfHeight + y, z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{halfWidth + x, halfHeight + y, z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{halfWidth + x, -halfHeight + y, z}, {uvRect.right, uvRect.bottom}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{-halfWidth + x, -halfHeight + y, z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
         }
         if(axis == CellAxis::CELL_AXIS_ZY) { // rotated 90 degrees about the y axis
-            r.spriteMesh.emplace_back(MeshVertex{{x, -halfHeight + y, halfWidth + z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{x, halfHeight + y, halfWidth + z}, {uvRect.left, uvRect.top}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{x, halfHeight + y, -halfWidth + z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{x, halfHeight + y, -halfWidth + z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{x, -halfHeight + y, -halfWidth + z}, {uvRect.right, uvRect.bottom}, {c.r, c.g, c.b}});
-            r.spriteMesh.emplace_back(MeshVertex{{x, -halfHeight + y, halfWidth + z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{x, -halfHeight + y, halfWidth + z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{x, halfHeight + y, halfWidth + z}, {uvRect.left, uvRect.top}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{x, halfHeight + y, -halfWidth + z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{x, halfHeight + y, -halfWidth + z}, {uvRect.right, uvRect.top}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{x, -halfHeight + y, -halfWidth + z}, {uvRect.right, uvRect.bottom}, {c.r, c.g, c.b}});
+            frame.spriteMesh.emplace_back(MeshVertex{{x, -halfHeight + y, halfWidth + z}, {uvRect.left, uvRect.bottom}, {c.r, c.g, c.b}});
         }
     }
 
@@ -253,13 +290,12 @@ namespace Game {
     }
 
 
-    static void buildMapMesh(Level &l, Renderer::LevelRenderer& r) {
-        l.depthSortedObjects.clear();
-        r.lights.clear();
+    static void buildMapMesh(Level &l, Renderer::LevelRenderer& r, Renderer::LevelFrame& frame, float alpha) {
+        PROFILE_SCOPE("buildMapMesh");
+        ResetFrameVector(l.depthSortedObjects);
+        ResetFrameVector(frame.lights);
         for (int y = 0; y < l.height; y++) {
             for (int x = 0; x < l.width; x++) {
-                // Get the current cell
-                char currentCell = (i8) l.map[y * l.width + x];
                 // add geometry
                 if(isOpenCell(l, x, y)) {
                     float worldX = ((float) x) * CUBE_SIZE;
@@ -269,115 +305,90 @@ namespace Game {
                     depthSortedObject.worldPosition = glm::vec3(worldX, 0.0f, worldZ);
                     depthSortedObject.mapX = x;
                     depthSortedObject.mapY = y;
-                    depthSortedObject.distanceToCamera = glm::distance(r.camera->Position, depthSortedObject.worldPosition);
+                    depthSortedObject.distanceToCamera = glm::distance(r.viewCamera->Position, depthSortedObject.worldPosition);
                     l.depthSortedObjects.push_back(depthSortedObject);
                 }
-                // add lights
-                if(currentCell == 'L') {
-                    Renderer::Light light{};
-                    light.position = glm::vec3(((float) x) * CUBE_SIZE, CUBE_SIZE, ((float) y) * CUBE_SIZE);
-                    light.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
-                    r.lights.push_back(light);
-                }
             }
         }
-        // add monsters
-        for(auto& m : l.monsters) {
-            auto depthSortedObject = DepthSortedObject{};
-            depthSortedObject.type = DSOType::SPRITE;
-            calcWorldPosition(l, m, depthSortedObject);
-            auto sortPos = glm::vec3(((float) m.x) * CUBE_SIZE, 0.0f, ((float) m.y) * CUBE_SIZE);
-            depthSortedObject.distanceToCamera = glm::distance(r.camera->Position, sortPos);
-            depthSortedObject.sprite = &m;
-            l.depthSortedObjects.push_back(depthSortedObject);
-        }
-
-        // add objects
-        for(auto& o : l.objects) {
-            auto depthSortedObject = DepthSortedObject{};
-            depthSortedObject.type = DSOType::SPRITE;
-            calcWorldPosition(l, o, depthSortedObject);
-            auto sortPos = glm::vec3(((float) o.x) * CUBE_SIZE, 0.0f, ((float) o.y) * CUBE_SIZE);
-            depthSortedObject.distanceToCamera = glm::distance(r.camera->Position, sortPos);
-            depthSortedObject.sprite = &o;
-            l.depthSortedObjects.push_back(depthSortedObject);
-        }
-
-        // add doors
-        for(auto& d : l.doors) {
-            auto depthSortedObject = DepthSortedObject{};
-            depthSortedObject.type = DSOType::DOOR;
-            auto x = d.x;
-            auto y = d.y;
-            float worldX = ((float) x) * CUBE_SIZE;
-            float worldZ = ((float) y) * CUBE_SIZE;
-            depthSortedObject.worldPosition = glm::vec3(worldX, 0.0f, worldZ);
-            depthSortedObject.mapX = x;
-            depthSortedObject.mapY = y;
-            depthSortedObject.distanceToCamera = glm::distance(r.camera->Position, depthSortedObject.worldPosition);
-            depthSortedObject.door = &d;
-            l.depthSortedObjects.push_back(depthSortedObject);
-        }
-
-        // add 3d models
-        for(auto& m : l.modelInstances) {
-            auto depthSortedObject = DepthSortedObject{};
-            depthSortedObject.type = DSOType::MODEL;
-            auto sortPos = glm::vec3(((float) m.x) * CUBE_SIZE, 0.0f, ((float) m.y) * CUBE_SIZE);
-            depthSortedObject.worldPosition = sortPos;
-            depthSortedObject.distanceToCamera = glm::distance(r.camera->Position, sortPos);
-            depthSortedObject.model = &m;
-            depthSortedObject.mapX = m.x;
-            depthSortedObject.mapY = m.y;
-            l.depthSortedObjects.push_back(depthSortedObject);
+        // add lights
+        auto& e = l.entities;
+        for(size_t i = 0; i < e.lights.components.size(); ++i) {
+            Renderer::Light light{};
+            light.position = *GetComponent(e.worldPositions, e.lights.owners[i]);
+            light.diffuse = e.lights.components[i].diffuse;
+            frame.lights.push_back(light);
         }
+        // monsters and objects, doors and 3d models
+        addDepthSortedEntities(l, r, e.sprites, DSOType::SPRITE);
+        addDepthSortedEntities(l, r, e.doors, DSOType::DOOR);
+        addDepthSortedEntities(l, r, e.models, DSOType::MODEL);
 
         // Sort depth sorted objects
-        std::sort(l.depthSortedObjects.begin(), l.depthSortedObjects.end(), depthSortedComparator);
+        {
+            PROFILE_SCOPE("SortDepthObjects");
+            std::sort(l.depthSortedObjects.begin(), l.depthSortedObjects.end(), depthSortedComparator);
+        }
         // Generate render batches from depth sorted objects, painters algorithm (back to front)
-        r.batches.clear();
+        ResetFrameVector(frame.batches);
+        ResetFrameVector(l.cellMeshJobs);
+        // cells are only counted here, their vertex offsets are a running sum of the face counts
+        u32 geometryVertices = 0;
         DSOType lastType = DSOType::GEOMETRY;
         for(auto& dso : l.depthSortedObjects) {
             switch(dso.type) {
                 case DSOType::GEOMETRY: {
+                    CellMeshJob cell{};
+                    cell.worldPosition = dso.worldPosition;
+                    cell.mapX = dso.mapX;
+                    cell.mapY = dso.mapY;
+                    cell.faces = cellFaces(l, r, dso.mapX, dso.mapY);
+                    cell.offset = geometryVertices;
+                    l.cellMeshJobs.push_back(cell);
                     RenderBatch batch{};
                     batch.type = BatchType::GEOMETRY;
-                    batch.offset = r.geometryMesh.size();
-                    buildCellMesh(l, r, dso);
-                    batch.count = r.geometryMesh.size() - batch.offset;
-                    r.batches.push_back(batch);
+                    batch.offset = geometryVertices;
+                    batch.count = cellVertexCount(cell.faces);
+                    geometryVertices += batch.count;
+                    frame.batches.push_back(batch);
                     break;
                 }
                 case DSOType::SPRITE: {
+                    auto& sprite = *GetComponent(e.sprites, dso.entity);
                     RenderBatch batch{};
                     batch.type = BatchType::SPRITE;
-                    batch.offset = r.spriteMesh.size();
+                    batch.offset = frame.spriteMesh.size();
                     batch.billboarding = 1;
 
                     batch.position = dso.worldPosition;
-                    batch.spriteSize = dso.sprite->size;
+                    batch.spriteSize = sprite.size;
                     auto side = CellSide::NORTH;
-                    if(!dso.sprite->uniDirectional) {
-                        side = getFacingSide(r.camera->Front, dso.sprite->direction);
+                    if(!sprite.uniDirectional) {
+                        side = getFacingSide(r.viewCamera->Front, sprite.direction);
+                    }
+                    //SDL_Log("Sprite at %d, %d, facing %d\n", dso.mapX, dso.mapY, side);
+                    u32 texture = sprite.textures[side];
+                    if(sprite.animation != 0) {
+                        auto& anim = l.spriteAnimations;
+                        texture = anim.frames[sprite.firstFrames[side] + GetAnimationFrame(anim, sprite.animation)].textureAtlasId;
                     }
-                    //SDL_Log("SpriteEntity at %d, %d, facing %d\n", dso.mapX, dso.mapY, side);
-                    buildSpriteMesh(l, r, dso, batch.spriteSize, dso.sprite->textures[side], CellAxis::CELL_AXIS_XY);
-                    batch.count = r.spriteMesh.size() - batch.offset;
-                    r.batches.push_back(batch);
+                    buildSpriteMesh(l, r, frame, dso, batch.spriteSize, texture, CellAxis::CELL_AXIS_XY);
+                    batch.count = frame.spriteMesh.size() - batch.offset;
+                    frame.batches.push_back(batch);
                     break;
                 }
                 case DSOType::DOOR: {
+                    auto& door = *GetComponent(e.doors, dso.entity);
                     glm::vec3 rotation;
-                    if(dso.door->axis == CellAxis::CELL_AXIS_XY) {
+                    if(door.axis == CellAxis::CELL_AXIS_XY) {
                         rotation = glm::vec3(0.0f, 00.0f, 0.0f);
                     }
-                    if(dso.door->axis == CellAxis::CELL_AXIS_ZY) {
+                    if(door.axis == CellAxis::CELL_AXIS_ZY) {
                         rotation = glm::vec3(0.0f, -90.0f, 0.0f);
                     }
                     // frame
                     RenderBatch frameBatch{};
                     frameBatch.type = BatchType::MODEL;
-                    frameBatch.modelIndex = dso.door->modelIndex;
+                    frameBatch.modelIndex = door.modelIndex;
                     frameBatch.position = dso.worldPosition;
                     frameBatch.modelScale = 1.0f;
                     frameBatch.modelAlignSide = CubeSide::BOTTOM;
@@ -385,36 +396,40 @@ namespace Game {
                     frameBatch.transform = glm::vec3(0.0f, 0.0f, 0.0f);
                     frameBatch.rotation = rotation;
                     GetLightColorAt(l.lighting, dso.mapX, dso.mapY, frameBatch.lightColor);
-                    r.batches.push_back(frameBatch);
+                    frame.batches.push_back(frameBatch);
                     // door
                     RenderBatch doorBatch{};
                     doorBatch.type = BatchType::MODEL;
-                    doorBatch.modelIndex = dso.door->modelIndex;
+                    doorBatch.modelIndex = door.modelIndex;
                     doorBatch.position = dso.worldPosition;
                     doorBatch.modelScale = 1.0f;
                     doorBatch.modelAlignSide = CubeSide::BOTTOM;
                     doorBatch.modelObjName = "door";
-                    doorBatch.transform = glm::vec3(0.0f, dso.door->offsetY, 0.0f);
+                    float offsetY = glm::mix(door.previousOffsetY, door.offsetY, alpha);
+                    doorBatch.transform = glm::vec3(0.0f, offsetY, 0.0f);
                     doorBatch.rotation = rotation;
                     GetLightColorAt(l.lighting, dso.mapX, dso.mapY, doorBatch.lightColor);
-                    r.batches.push_back(doorBatch);
+                    frame.batches.push_back(doorBatch);
                     break;
                 }
                 case DSOType::MODEL: {
+                    auto& model = *GetComponent(e.models, dso.entity);
                     RenderBatch batch{};
                     batch.type = BatchType::MODEL;
-                    batch.modelIndex = dso.model->modelIndex;
+                    batch.modelIndex = model.modelIndex;
                     batch.position = dso.worldPosition;
-                    batch.modelScale = dso.model->scale;
-                    batch.modelAlignSide = dso.model->alignSide;
+                    batch.modelScale = model.scale;
+                    batch.modelAlignSide = model.alignSide;
                     batch.modelObjName = "*";
                     GetLightColorAt(l.lighting, dso.mapX, dso.mapY, batch.lightColor);
-                    r.batches.push_back(batch);
+                    frame.batches.push_back(batch);
                     break;
                 }
             }
             lastType = dso.type;
         }
+        frame.geometryMesh.resize(geometryVertices);
+        buildCellMeshes(l, r, frame);
     }
 
     static void setPlayerPosition(Level &l, Renderer::LevelRenderer& r) {
@@ -435,19 +450,53 @@ namespace Game {
                     l.player.direction = glm::vec2(0.0f, 1.0f);
                     r.camera->Position = glm::vec3(worldX, 0.0f, worldZ);
                     //r.camera->Yaw = 90.0f;
+                    r.previousCameraPose = r.camera->GetPose();
                     return;
                 }
             }
         }
     }
 
+    // adds a blueprint image to the sprite atlas, a sheet of more than one frame is added frame by frame and
+    // registered as an animation. Returns the atlas id of the first frame
+    static u32 addSpriteImage(Level& l, TextureAtlasBuilder& builder, const BluePrintBase& base, const std::string& filename,
+                              u32& animation) {
+        u32 sheet = builder.addSheetFromPng(filename);
+        auto& pb = builder.getSheet(sheet);
+        u32 frameWidth = base.frameWidth > 0 ? (u32) base.frameWidth : pb.width;
+        u32 frameCount = pb.width % frameWidth == 0 ? pb.width / frameWidth : 1;
+        if(frameCount <= 1) {
+            animation = 0;
+            return builder.addSubImage(sheet, UIntRect(0, 0, pb.width, pb.height), Renderer::AtlasPadding::EXTEND);
+        }
+        std::vector<u32> atlasIds(frameCount);
+        for(u32 i = 0; i < frameCount; ++i) {
+            atlasIds[i] = builder.addSubImage(sheet, UIntRect(i * frameWidth, 0, frameWidth, pb.height), Renderer::AtlasPadding::EXTEND);
+        }
+        animation = AddAnimation(l.spriteAnimations, atlasIds.data(), (u16) frameCount, (u16) frameWidth, (u16) pb.height, base.fps);
+        SDL_Log("Sprite sheet %s has %u frames", filename.c_str(), frameCount);
+        return atlasIds[0];
+    }
+
+    // a sprite shows the same frame index whichever side it's seen from
+    static void checkBluePrintFrames(Level& l, const BluePrintBase& base, i32 sides) {
+        auto frameCount = [&l](u32 animation) {
+            return animation != 0 ? l.spriteAnimations.loadedAnimations.find(animation)->frameCount : (u16) 1;
+        };
+        for(i32 side = 1; side < sides; ++side) {
+            if(frameCount(base.animations[side]) != frameCount(base.animations[0]))
+                throw std::runtime_error("Sprite sheets of " + base.textureFile + " have different frame counts");
+        }
+    }
+
     static void loadMonsterBluePrints(Level& l, LevelRenderer& r, TextureAtlasBuilder& builder) {
-        i32 w,h;
         for(auto& [symbol, bluePrint] : l.monsterBluePrints) {
-            bluePrint.base.textures[CellSide::NORTH] = builder.addFromPngSize(bluePrint.base.textureFile + "_front.png", true, w, h);
-            bluePrint.base.textures[CellSide::SOUTH] = builder.addFromPngSize(bluePrint.base.textureFile + "_back.png", true, w, h);
-            bluePrint.base.textures[CellSide::WEST] = builder.addFromPngSize(bluePrint.base.textureFile + "_left.png", true, w, h);
-            bluePrint.base.textures[CellSide::EAST] = builder.addFromPngSize(bluePrint.base.textureFile + "_right.png", true, w, h);
+            auto& base = bluePrint.base;
+            base.textures[CellSide::NORTH] = addSpriteImage(l, builder, base, base.textureFile + "_front.png", base.animations[CellSide::NORTH]);
+            base.textures[CellSide::SOUTH] = addSpriteImage(l, builder, base, base.textureFile + "_back.png", base.animations[CellSide::SOUTH]);
+            base.textures[CellSide::WEST] = addSpriteImage(l, builder, base, base.textureFile + "_left.png", base.animations[CellSide::WEST]);
+            base.textures[CellSide::EAST] = addSpriteImage(l, builder, base, base.textureFile + "_right.png", base.animations[CellSide::EAST]);
+            checkBluePrintFrames(l, base, 4);
         }
     }
 
@@ -474,76 +523,116 @@ namespace Game {
         }
     }
 
-    static void spawnMonsters(Level& l) {
+    // animated sprites get a controller starting at a random frame, so a room of them doesn't move in step
+    static void setupSpriteAnimation(Level& l, Sprite& sprite, const BluePrintBase& base, i32 sides) {
+        sprite.animation = 0;
+        if(base.animations[CellSide::NORTH] == 0)
+            return;
+        auto& anim = l.spriteAnimations;
+        for(i32 side = 0; side < sides; ++side) {
+            sprite.firstFrames[side] = anim.loadedAnimations.find(base.animations[side])->firstFrame;
+        }
+        u32 frameCount = anim.loadedAnimations.find(base.animations[CellSide::NORTH])->frameCount;
+        sprite.animation = PlayAnimation(anim, base.animations[CellSide::NORTH], RepeatType::Restart, false,
+                                         (u32) rand() % frameCount);
+    }
+
+    // the cells of the map grouped by symbol, each group in map order. Spawning looks up the cells of a blueprint's
+    // symbol instead of scanning the whole map for every blueprint
+    struct SpawnCells {
+        u32 offsets[257];       // the cells of symbol c are cells[offsets[c]] up to cells[offsets[c + 1]]
+        std::vector<u32> cells;
+    };
+
+    static void collectSpawnCells(const Level& l, SpawnCells& spawn) {
+        u32 counts[256] = {};
+        for(u8 c : l.map) {
+            counts[c]++;
+        }
+        spawn.offsets[0] = 0;
+        for(u32 c = 0; c < 256; ++c) {
+            spawn.offsets[c + 1] = spawn.offsets[c] + counts[c];
+        }
+        u32 next[256];
+        std::copy(spawn.offsets, spawn.offsets + 256, next);
+        spawn.cells.resize(l.map.size());
+        for(u32 i = 0; i < (u32) l.map.size(); ++i) {
+            spawn.cells[next[l.map[i]]++] = i;
+        }
+    }
+
+    static Entity spawnSprite(Level& l, i32 x, i32 y, const Sprite& sprite, u32 tags) {
+        auto& e = l.entities;
+        Entity entity = CreateEntity(e, tags);
+        SetEntityCell(e, entity, x, y);
+        AddComponent(e.worldPositions, entity, spriteWorldPosition(x, y, sprite));
+        AddComponent(e.sprites, entity, sprite);
+        return entity;
+    }
+
+    static void spawnMonsters(Level& l, const SpawnCells& spawn) {
         for(auto& [symbol, bluePrint] : l.monsterBluePrints) {
-            for (int y = 0; y < l.height; y++) {
-                for (int x = 0; x < l.width; x++) {
-                    // Get the current cell
-                    char currentCell = l.map[y * l.width + x];
-                    if(currentCell == bluePrint.base.mapSymbol) {
-                        SpriteEntity m{};
-                        m.x = x;
-                        m.y = y;
-                        m.corner = getRandomCorner();
-                        glm::vec2 mobDir;
-                        getRandomDirection(mobDir);
-                        m.direction = mobDir;
-                        m.textures[CellSide::NORTH] = bluePrint.base.textures[CellSide::NORTH];
-                        m.textures[CellSide::SOUTH] = bluePrint.base.textures[CellSide::SOUTH];
-                        m.textures[CellSide::WEST] = bluePrint.base.textures[CellSide::WEST];
-                        m.textures[CellSide::EAST] = bluePrint.base.textures[CellSide::EAST];
-                        normalizeResolution(bluePrint.base.frameWidth, bluePrint.base.frameHeight, bluePrint.base.scale, &m.size.x, &m.size.y);
-                        l.monsters.push_back(m);
-                        SDL_Log("Spawned monster at %d, %d\n", x, y);
-                    }
-                }
+            auto c = (u8) bluePrint.base.mapSymbol;
+            for(u32 i = spawn.offsets[c]; i < spawn.offsets[c + 1]; ++i) {
+                i32 x = (i32) spawn.cells[i] % l.width;
+                i32 y = (i32) spawn.cells[i] / l.width;
+                Sprite m{};
+                m.corner = getRandomCorner();
+                glm::vec2 mobDir;
+                getRandomDirection(mobDir);
+                m.direction = mobDir;
+                m.textures[CellSide::NORTH] = bluePrint.base.textures[CellSide::NORTH];
+                m.textures[CellSide::SOUTH] = bluePrint.base.textures[CellSide::SOUTH];
+                m.textures[CellSide::WEST] = bluePrint.base.textures[CellSide::WEST];
+                m.textures[CellSide::EAST] = bluePrint.base.textures[CellSide::EAST];
+                setupSpriteAnimation(l, m, bluePrint.base, 4);
+                normalizeResolution(bluePrint.base.frameWidth, bluePrint.base.frameHeight, bluePrint.base.scale, &m.size.x, &m.size.y);
+                spawnSprite(l, x, y, m, ENTITY_TAG_MONSTER);
+                SDL_Log("Spawned monster at %d, %d\n", x, y);
             }
         }
     }
 
-    static void spawnObjects(Level& l) {
+    static void spawnObjects(Level& l, const SpawnCells& spawn) {
         for(auto& [symbol, bluePrint] : l.objectBluePrints) {
-            for (int y = 0; y < l.height; y++) {
-                for (int x = 0; x < l.width; x++) {
-                    // Get the current cell
-                    char currentCell = l.map[y * l.width + x];
-                    if(currentCell == bluePrint.base.mapSymbol) {
-                        SpriteEntity obj{};
-                        obj.x = x;
-                        obj.y = y;
-                        obj.corner = getRandomCorner();
-                        glm::vec2 objDir;
-                        getRandomDirection(objDir);
-                        obj.direction = objDir;
-                        if(bluePrint.base.dirSymbol == '*') {
-                            obj.uniDirectional = true;
-                            obj.textures[CellSide::NORTH] = bluePrint.base.textures[CellSide::NORTH];
-                        } else {
-                            obj.uniDirectional = false;
-                            obj.textures[CellSide::NORTH] = bluePrint.base.textures[CellSide::NORTH];
-                            obj.textures[CellSide::SOUTH] = bluePrint.base.textures[CellSide::SOUTH];
-                            obj.textures[CellSide::WEST] = bluePrint.base.textures[CellSide::WEST];
-                            obj.textures[CellSide::EAST] = bluePrint.base.textures[CellSide::EAST];
-                        }
-                        normalizeResolution(bluePrint.base.frameWidth, bluePrint.base.frameHeight, bluePrint.base.scale, &obj.size.x, &obj.size.y);
-                        l.monsters.push_back(obj);
-                        SDL_Log("Spawned object at %d, %d\n", x, y);
-                    }
+            auto c = (u8) bluePrint.base.mapSymbol;
+            for(u32 i = spawn.offsets[c]; i < spawn.offsets[c + 1]; ++i) {
+                i32 x = (i32) spawn.cells[i] % l.width;
+                i32 y = (i32) spawn.cells[i] / l.width;
+                Sprite obj{};
+                obj.corner = getRandomCorner();
+                glm::vec2 objDir;
+                getRandomDirection(objDir);
+                obj.direction = objDir;
+                if(bluePrint.base.dirSymbol == '*') {
+                    obj.uniDirectional = true;
+                    obj.textures[CellSide::NORTH] = bluePrint.base.textures[CellSide::NORTH];
+                } else {
+                    obj.uniDirectional = false;
+                    obj.textures[CellSide::NORTH] = bluePrint.base.textures[CellSide::NORTH];
+                    obj.textures[CellSide::SOUTH] = bluePrint.base.textures[CellSide::SOUTH];
+                    obj.textures[CellSide::WEST] = bluePrint.base.textures[CellSide::WEST];
+                    obj.textures[CellSide::EAST] = bluePrint.base.textures[CellSide::EAST];
                 }
+                setupSpriteAnimation(l, obj, bluePrint.base, obj.uniDirectional ? 1 : 4);
+                normalizeResolution(bluePrint.base.frameWidth, bluePrint.base.frameHeight, bluePrint.base.scale, &obj.size.x, &obj.size.y);
+                spawnSprite(l, x, y, obj, ENTITY_TAG_OBJECT);
+                SDL_Log("Spawned object at %d, %d\n", x, y);
             }
         }
     }
 
     static void loadObjectBluePrints(Level& l, LevelRenderer& r, TextureAtlasBuilder& builder) {
-        i32 w,h;
         for(auto& [symbol, bluePrint] : l.objectBluePrints) {
-            if(bluePrint.base.dirSymbol == '*') {
-                bluePrint.base.textures[CellSide::NORTH] = builder.addFromPngSize(bluePrint.base.textureFile + ".png", true, w, h);
+            auto& base = bluePrint.base;
+            if(base.dirSymbol == '*') {
+                base.textures[CellSide::NORTH] = addSpriteImage(l, builder, base, base.textureFile + ".png", base.animations[CellSide::NORTH]);
             } else {
-                bluePrint.base.textures[CellSide::NORTH] = builder.addFromPngSize(bluePrint.base.textureFile + "_front.png", true, w, h);
-                bluePrint.base.textures[CellSide::SOUTH] = builder.addFromPngSize(bluePrint.base.textureFile + "_back.png", true, w, h);
-                bluePrint.base.textures[CellSide::WEST] = builder.addFromPngSize(bluePrint.base.textureFile + "_left.png", true, w, h);
-                bluePrint.base.textures[CellSide::EAST] = builder.addFromPngSize(bluePrint.base.textureFile + "_right.png", true, w, h);
+                base.textures[CellSide::NORTH] = addSpriteImage(l, builder, base, base.textureFile + "_front.png", base.animations[CellSide::NORTH]);
+                base.textures[CellSide::SOUTH] = addSpriteImage(l, builder, base, base.textureFile + "_back.png", base.animations[CellSide::SOUTH]);
+                base.textures[CellSide::WEST] = addSpriteImage(l, builder, base, base.textureFile + "_left.png", base.animations[CellSide::WEST]);
+                base.textures[CellSide::EAST] = addSpriteImage(l, builder, base, base.textureFile + "_right.png", base.animations[CellSide::EAST]);
+                checkBluePrintFrames(l, base, 4);
             }
         }
     }
@@ -555,8 +644,6 @@ namespace Game {
                 char currentCell = l.map[y * l.width + x];
                 if(currentCell == 'D' || currentCell == 'd') {
                     Door d{};
-                    d.x = x;
-                    d.y = y;
                     if(currentCell == 'D') {
                         d.axis = CellAxis::CELL_AXIS_XY;
                     } else {
@@ -568,21 +655,69 @@ namespace Game {
                     d.elapsed = 0.0f;
                     d.duration = 5.0f;
                     d.offsetY = 0.0f;
+                    d.previousOffsetY = 0.0f;
                     d.targetOffsetY = -CUBE_SIZE + 0.075f;
-                    l.doors.push_back(d);
+                    auto& e = l.entities;
+                    Entity entity = CreateEntity(e);
+                    SetEntityCell(e, entity, x, y);
+                    AddComponent(e.worldPositions, entity, cellWorldPosition(x, y));
+                    AddComponent(e.doors, entity, d);
                     SDL_Log("Spawned door at %d, %d\n", x, y);
                 }
             }
         }
     }
 
+    // lights hang at the ceiling of their cell
+    static void spawnLights(Level& l) {
+        auto& e = l.entities;
+        for (int y = 0; y < l.height; y++) {
+            for (int x = 0; x < l.width; x++) {
+                if(l.map[y * l.width + x] == 'L') {
+                    Entity entity = CreateEntity(e);
+                    SetEntityCell(e, entity, x, y);
+                    AddComponent(e.worldPositions, entity, glm::vec3(((float) x) * CUBE_SIZE, CUBE_SIZE, ((float) y) * CUBE_SIZE));
+                    AddComponent(e.lights, entity, LightSource{glm::vec3(1.0f, 1.0f, 1.0f)});
+                }
+            }
+        }
+    }
+
     void LoadLevel(Level& level, LevelRenderer& renderer, const u8 map[], i32 w, i32 h) {
-        // seed rand
-        srand(time(nullptr));
-        level.monsters.clear();
-        level.objects.clear();
-        level.modelInstances.clear();
-        level.doors.clear();
+        auto builder = Renderer::TextureAtlasBuilder(1024, 1024, Renderer::PixelFormat::RGBA);
+        InitAnimations(level.spriteAnimations);
+        loadMonsterBluePrints(level, renderer, builder);
+        loadObjectBluePrints(level, renderer, builder);
+        renderer.doorTexture = builder.addFromPng("assets/eye_door.png", true);
+        builder.build(renderer.spriteTextureAtlas);
+        LoadLevelData(level, renderer, map, w, h);
+    }
+
+    static void updateBlockedMap(Level &l) {
+        for (int y = 0; y < l.height; y++) {
+            for (int x = 0; x < l.width; x++) {
+                if(isOpenCell(l, x, y)) {
+                    l.blockedMap[y * l.width + x] = 0;
+                } else {
+                    l.blockedMap[y * l.width + x] = 1;
+                }
+            }
+        }
+        /*
+        for(auto& d : l.doors) {
+            if(!d.open) {
+                l.blockedMap[d.y * l.width + d.x] = 1;
+            } else {
+                l.blockedMap[d.y * l.width + d.x] = 0;
+            }
+        }
+        */
+    }
+
+    void LoadLevelData(Level& level, LevelRenderer& renderer, const u8 map[], i32 w, i32 h) {
+        InitEntities(level.entities, w, h);
+        // the blueprint animations stay, only the sprites playing them go
+        StopAllAnimations(level.spriteAnimations);
         level.freeCam = false;
         level.width = w;
         level.height = h;
@@ -600,14 +735,15 @@ namespace Game {
             level.map[i] = map[i];
         }
         setPlayerPosition(level, renderer);
-        auto builder = Renderer::TextureAtlasBuilder(1024, 1024, Renderer::PixelFormat::RGBA);
-        loadMonsterBluePrints(level, renderer, builder);
-        loadObjectBluePrints(level, renderer, builder);
-        renderer.doorTexture = builder.addFromPng("assets/eye_door.png", true);
-        builder.build(renderer.spriteTextureAtlas);
         spawnDoors(level, renderer.doorModelIndex);
-        spawnMonsters(level);
-        spawnObjects(level);
+        SpawnCells spawn;
+        collectSpawnCells(level, spawn);
+        spawnMonsters(level, spawn);
+        spawnObjects(level, spawn);
+        spawnLights(level);
+        // frames can be drawn before the first tick
+        updateBlockedMap(level);
+        BuildLightMap(level.lighting, level.map.data(), level.blockedMap.data());
     }
 
     void ShutdownLevel(Level &level) {
@@ -626,7 +762,7 @@ namespace Game {
     }
     */
     static void updateDoors(Level &level, LevelRenderer& renderer, float delta) {
-        for(auto& d : level.doors) {
+        for(auto& d : level.entities.doors.components) {
             if(d.opening || d.closing) {
                 bool done = false;
                 d.elapsed += delta;
@@ -651,39 +787,28 @@ namespace Game {
         }
     }
 
-    static void updateBlockedMap(Level &l) {
-        l.blockedMap.clear();
-        for (int y = 0; y < l.height; y++) {
-            for (int x = 0; x < l.width; x++) {
-                if(isOpenCell(l, x, y)) {
-                    l.blockedMap[y * l.width + x] = 0;
-                } else {
-                    l.blockedMap[y * l.width + x] = 1;
-                }
-            }
-        }
-        /*
-        for(auto& d : l.doors) {
-            if(!d.open) {
-                l.blockedMap[d.y * l.width + d.x] = 1;
-            } else {
-                l.blockedMap[d.y * l.width + d.x] = 0;
-            }
+    void TickLevel(Level &level, LevelRenderer& renderer, float tickDelta) {
+        PROFILE_SCOPE("TickLevel");
+        renderer.previousCameraPose = renderer.camera->GetPose();
+        for(auto& d : level.entities.doors.components) {
+            d.previousOffsetY = d.offsetY;
         }
-        */
-    }
-
-    void UpdateLevel(Level &level, LevelRenderer& renderer, float delta) {
-        updateDoors(level, renderer, delta);
+        updateDoors(level, renderer, tickDelta);
+        UpdateAnimations(level.spriteAnimations, tickDelta);
         if(!level.freeCam) {
             //adjustCamera(level, renderer);
         }
-        renderer.geometryMesh.clear();
-        renderer.spriteMesh.clear();
         updateBlockedMap(level);
         BuildLightMap(level.lighting, level.map.data(), level.blockedMap.data());
-        buildMapMesh(level, renderer);
-        UploadLevelMesh(renderer);
+    }
+
+    void UpdateLevel(Level &level, LevelRenderer& renderer, LevelFrame& frame, float alpha) {
+        PROFILE_SCOPE("UpdateLevel");
+        renderer.viewCamera->SetPose(LerpCameraPose(renderer.previousCameraPose, renderer.camera->GetPose(), alpha));
+        SetLevelFrameCamera(renderer, frame);
+        ResetFrameVector(frame.geometryMesh);
+        ResetFrameVector(frame.spriteMesh);
+        buildMapMesh(level, renderer, frame, alpha);
     }
 
     void MoveForward(Level &level, Camera& c) {
@@ -737,7 +862,8 @@ namespace Game {
         SDL_Log("Player direction: %f, %f\n", level.player.direction.x, level.player.direction.y);
     }
 
-    void CreateMonsterBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale) {
+    void CreateMonsterBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale,
+                                u32 fps) {
         MonsterBluePrint m{};
         m.base.dirSymbol = dirSymbol;
         m.base.mapSymbol = mapSymbol;
@@ -749,10 +875,12 @@ namespace Game {
         m.base.frameWidth = fW;
         m.base.frameHeight = fH;
         m.base.scale = scale;
+        m.base.fps = fps;
         level.monsterBluePrints[mapSymbol] = m;
     }
 
-    void CreateObjectBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale) {
+    void CreateObjectBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale,
+                               u32 fps) {
         ObjectBluePrint m{};
         m.base.dirSymbol = dirSymbol;
         m.base.mapSymbol = mapSymbol;
@@ -764,17 +892,21 @@ namespace Game {
         m.base.frameWidth = fW;
         m.base.frameHeight = fH;
         m.base.scale = scale;
+        m.base.fps = fps;
         level.objectBluePrints[mapSymbol] = m;
     }
 
-    void CreateModelInstance(Level &level, i32 x, i32 y, CubeSide alignSide, float scale, u32 modelIndex) {
+    Entity CreateModelInstance(Level &level, i32 x, i32 y, CubeSide alignSide, float scale, u32 modelIndex) {
         ModelInstance m{};
-        m.x = x;
-        m.y = y;
         m.alignSide = alignSide;
         m.scale = scale;
         m.modelIndex = modelIndex;
-        level.modelInstances.push_back(m);
+        auto& e = level.entities;
+        Entity entity = CreateEntity(e);
+        SetEntityCell(e, entity, x, y);
+        AddComponent(e.worldPositions, entity, cellWorldPosition(x, y));
+        AddComponent(e.models, entity, m);
+        return entity;
     }
 
     void OpenDoor(Level &level) {
@@ -783,8 +915,13 @@ namespace Game {
         i32 y = level.player.y - (i32) level.player.direction.y;
         SDL_Log("Player at %d, %d\n", level.player.x, level.player.y);
         SDL_Log("Try opening door at %d, %d\n", x, y);
-        for(auto& d : level.doors) {
-            if(d.x == x && d.y == y && !d.opening && !d.closing) {
+        auto& e = level.entities;
+        ForEachEntityAt(e, x, y, [&e](Entity entity) {
+            Door* door = GetComponent(e.doors, entity);
+            if(door == nullptr)
+                return;
+            auto& d = *door;
+            if(!d.opening && !d.closing) {
                 if(!d.open) {
                     d.opening = true;
                     d.closing = false;
@@ -799,13 +936,36 @@ namespace Game {
                     SDL_Log("Closing door\n");
                     d.elapsed = 0.0f;
                     d.duration = 1.0f;
-                    d.offsetY = 0.0f;
+                    // starts from open, the door isn't stepped until the next tick
                     d.targetOffsetY = -CUBE_SIZE + 0.075f;
+                    d.offsetY = d.targetOffsetY;
                 }
             }
+        });
+    }
+
+    void MoveEntity(Level& level, Entity entity, i32 x, i32 y) {
+        auto& e = level.entities;
+        SetEntityCell(e, entity, x, y);
+        glm::vec3* worldPosition = GetComponent(e.worldPositions, entity);
+        if(worldPosition == nullptr)
+            return;
+        const Sprite* sprite = GetComponent(e.sprites, entity);
+        if(sprite != nullptr) {
+            *worldPosition = spriteWorldPosition(x, y, *sprite);
+        } else {
+            // the cell center, lights stay at their height
+            *worldPosition = glm::vec3(((float) x) * CUBE_SIZE, worldPosition->y, ((float) y) * CUBE_SIZE);
         }
     }
 
+    void DespawnEntity(Level& level, Entity entity) {
+        const Sprite* sprite = GetComponent(level.entities.sprites, entity);
+        if(sprite != nullptr && sprite->animation != 0)
+            StopAnimation(level.spriteAnimations, sprite->animation);
+        DestroyEntity(level.entities, entity);
+    }
+
     /*
     void MoveForward(Level &level) {
         i32 x = level.player.x;
@@ -9,22 +9,27 @@
 #include "glm/ext.hpp"
 #include "../../renderer/LevelRenderer.h"
 #include "Lighting.h"
+#include "Entities.h"
+#include "../animation/Animations.h"
 #include <vector>
 
 #define MOVE_SPEED 5.0f
+// cells per job system range when meshing, small enough to balance, large enough to amortize taking a range
+#define CELL_MESH_JOB_GRAIN 256
+// frame rate of animated sprites unless the blueprint says otherwise
+#define SPRITE_ANIMATION_FPS 8
 using Renderer::MeshVertex;
 using Renderer::TextureAtlas;
 using Renderer::TextureAtlasBuilder;
 using Renderer::CubeFaces;
 using Renderer::LevelRenderer;
+using Renderer::LevelFrame;
 using Renderer::RenderBatch;
 using Renderer::BatchType;
 using Renderer::CubeSide;
 
 namespace Game {
     enum CellSide { NORTH, SOUTH, WEST, EAST };
-    enum CellCorner { NW, NE, SW, SE, CENTER };
-    enum CellAxis { CELL_AXIS_XY, CELL_AXIS_ZY };
     const glm::vec2 North = glm::vec2(0, -1);
     const glm::vec2 South = glm::vec2(0, 1);
     const glm::vec2 West = glm::vec2(-1, 0);
@@ -45,7 +50,11 @@ namespace Game {
         i8 dirSymbol; // (N, S, W, E)
         i8 mapSymbol;
         std::string textureFile;
+        // an image is a sheet of frameWidth wide frames, left to right. With more than one the side is animated
+        // at fps, every side of a blueprint needs the same number of frames
+        u32 fps;
         u32 textures[4];
+        u32 animations[4];      // Level::spriteAnimations ids, 0 for still images
     };
 
     struct MonsterBluePrint {
@@ -56,38 +65,6 @@ namespace Game {
         BluePrintBase base;
     };
 
-    struct Door {
-        i32 x;
-        i32 y;
-        CellAxis axis;
-        bool open;
-        u32 modelIndex;
-        bool opening;
-        bool closing;
-        float duration;
-        float elapsed;
-        float offsetY;
-        float targetOffsetY;
-    };
-
-    struct ModelInstance {
-        i32 x;
-        i32 y;
-        CubeSide alignSide;
-        float scale;
-        u32 modelIndex;
-    };
-
-    struct SpriteEntity {
-        i32 x;
-        i32 y;
-        CellCorner corner;
-        glm::vec2 size;
-        glm::vec2 direction;
-        u32 textures[4];
-        bool uniDirectional;
-    };
-
     enum class DSOType {
         GEOMETRY,
         MODEL,
@@ -101,9 +78,16 @@ namespace Game {
         glm::vec3 worldPosition;
         i32 mapX;
         i32 mapY;
-        SpriteEntity* sprite;
-        Door* door;
-        ModelInstance* model;
+        Entity entity;          // 0 for geometry
+    };
+
+    // an open cell waiting to be meshed, offset is where its vertices go in the frame's geometry mesh
+    struct CellMeshJob {
+        glm::vec3 worldPosition;
+        i32 mapX;
+        i32 mapY;
+        CubeFaces faces;
+        u32 offset;
     };
 
     struct Level {
@@ -116,27 +100,41 @@ namespace Game {
         bool freeCam;
         float moveDuration;
         float turnDuration;
-        std::vector<DepthSortedObject> depthSortedObjects;
-        std::vector<SpriteEntity> monsters;
-        std::vector<SpriteEntity> objects;
-        std::vector<Door> doors;
+        std::pmr::vector<DepthSortedObject> depthSortedObjects;  // frame arena
+        std::pmr::vector<CellMeshJob> cellMeshJobs;              // frame arena
+        // monsters, objects, doors, model instances and lights
+        Entities entities;
         std::unordered_map<i8, MonsterBluePrint> monsterBluePrints;
         std::unordered_map<i8, ObjectBluePrint> objectBluePrints;
-        std::vector<ModelInstance> modelInstances;
+        // frames live in the level sprite atlas, one controller per animated sprite advanced by TickLevel
+        Animations spriteAnimations;
     };
 
     void LoadLevel(Level& level, LevelRenderer& renderer, const u8 map[], i32 w, i32 h);
+    // the cpu side of LoadLevel, expects the blueprint textures to be assigned already and touches no GL state
+    void LoadLevelData(Level& level, LevelRenderer& renderer, const u8 map[], i32 w, i32 h);
     void ShutdownLevel(Level& level);
-    void UpdateLevel(Level& level, LevelRenderer& renderer, float delta);
+    // advances doors by one fixed simulation step and rebuilds the light map, call before the tick's input so
+    // the camera pose it saves is the one from the start of the tick
+    void TickLevel(Level& level, LevelRenderer& renderer, float tickDelta);
+    // places the view camera and doors alpha (0-1) of the way from the start of the last tick to its end and
+    // builds frame from there, RenderLevel draws it
+    void UpdateLevel(Level& level, LevelRenderer& renderer, LevelFrame& frame, float alpha);
     void MoveForward(Level& level, Camera& c);
     void MoveBackward(Level &level, Camera& c);
     void MoveLeft(Level &level, Camera& c);
     void MoveRight(Level &level, Camera& c);
     void TurnLeft(Level &level, Camera& c);
     void TurnRight(Level &level, Camera& c);
-    void CreateMonsterBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale);
-    void CreateObjectBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale);
-    void CreateModelInstance(Level& level, i32 x, i32 y, CubeSide alignSide, float scale, u32 modelIndex);
+    void CreateMonsterBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale,
+                                u32 fps = SPRITE_ANIMATION_FPS);
+    void CreateObjectBluePrint(Level& level, i8 mapSymbol, i8 dirSymbol, std::string textureFile, i32 fW, i32 fH, float scale,
+                               u32 fps = SPRITE_ANIMATION_FPS);
+    Entity CreateModelInstance(Level& level, i32 x, i32 y, CubeSide alignSide, float scale, u32 modelIndex);
     void OpenDoor(Level& level);
+    // moves an entity to another cell, keeping the cell index and where it's drawn up to date
+    void MoveEntity(Level& level, Entity entity, i32 x, i32 y);
+    // also stops its sprite animation
+    void DespawnEntity(Level& level, Entity entity);
 }
 #endif //CRAWLER_LEVEL_H
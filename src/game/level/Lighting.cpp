@@ -5,6 +5,7 @@
 #include <cstdio>
 #include <algorithm>
 #include "Lighting.h"
+#include "../../util/Profiler.h"
 
 namespace Game {
 
@@ -174,6 +175,7 @@ namespace Game {
     }
 
     void BuildLightMap(Lighting& l, const u8 map[], const u8 blockedMap[]) {
+        PROFILE_SCOPE("BuildLightMap");
         l.lightQueue.clear();
         l.lightQueue.reserve(l.width * l.height);
         l.lightMap.clear();
@@ -0,0 +1,175 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_SLOTMAP_H
+#define CRAWLER_SLOTMAP_H
+
+#include <cstddef>
+#include <vector>
+#include <stdexcept>
+#include "defs.h"
+
+// Values are kept packed in one vector, handed out handles go through a slot table to find them. A handle is the
+// slot index in the low SLOT_MAP_INDEX_BITS and the slot's generation above it. Removing a value moves the last one
+// into its place and bumps the generation of its slot, so insert and remove are O(1), iteration is a walk over the
+// packed values (in no particular order) and a handle to a removed value stops resolving instead of finding whatever
+// took its place. Generations wrap after 4095 reuses of a slot. 0 is never a valid handle.
+
+#define SLOT_MAP_INDEX_BITS 20
+#define SLOT_MAP_INDEX_MASK ((1u << SLOT_MAP_INDEX_BITS) - 1)
+#define SLOT_MAP_MAX_SIZE (1u << SLOT_MAP_INDEX_BITS)
+
+// The handle half of a SlotMap: slots pointing at positions in packed storage the owner keeps however it likes,
+// with a generation per slot and a free list. SlotMap keeps one vector of values behind it, the animation
+// controllers keep parallel arrays.
+class SlotTable {
+public:
+    // takes a free slot for the value at index in the packed storage
+    u32 acquire(u32 index) {
+        u32 slot;
+        if(!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            if(generations.size() >= SLOT_MAP_MAX_SIZE)
+                throw std::runtime_error("SlotTable::acquire() out of slots");
+            slot = (u32) generations.size();
+            generations.push_back(1);
+            slotToIndex.push_back(0);
+        }
+        slotToIndex[slot] = index;
+        return handleOf(slot);
+    }
+
+    // index of a live handle in the packed storage, -1 for a stale or invalid one
+    i64 indexOf(u32 handle) const {
+        u32 slot = handle & SLOT_MAP_INDEX_MASK;
+        if(slot >= generations.size() || generations[slot] != handle >> SLOT_MAP_INDEX_BITS)
+            return -1;
+        return slotToIndex[slot];
+    }
+
+    u32 handleOf(u32 slot) const {
+        return (generations[slot] << SLOT_MAP_INDEX_BITS) | slot;
+    }
+
+    // the slot's value moved to index in the packed storage
+    void move(u32 slot, u32 index) {
+        slotToIndex[slot] = index;
+    }
+
+    // handles to the slot go stale and it's free for reuse. A freed slot's next handle can't be mistaken for the
+    // last one until the generation wraps
+    void release(u32 slot) {
+        u32 generation = (generations[slot] + 1) & (0xFFFFFFFFu >> SLOT_MAP_INDEX_BITS);
+        generations[slot] = generation != 0 ? generation : 1;
+        freeSlots.push_back(slot);
+    }
+
+    void reserve(size_t capacity) {
+        slotToIndex.reserve(capacity);
+        generations.reserve(capacity);
+    }
+
+private:
+    // by slot
+    std::vector<u32> slotToIndex;
+    std::vector<u32> generations;
+    std::vector<u32> freeSlots;
+};
+
+template <typename T>
+class SlotMap {
+public:
+    explicit SlotMap() = default;
+
+    u32 insert(T value) {
+        u32 handle = slots.acquire((u32) values.size());
+        values.push_back(std::move(value));
+        indexToSlot.push_back(handle & SLOT_MAP_INDEX_MASK);
+        return handle;
+    }
+
+    // nullptr for a stale or invalid handle, the pointer is good until the next insert or remove
+    T* find(u32 handle) {
+        i64 index = slots.indexOf(handle);
+        return index >= 0 ? &values[index] : nullptr;
+    }
+
+    const T* find(u32 handle) const {
+        i64 index = slots.indexOf(handle);
+        return index >= 0 ? &values[index] : nullptr;
+    }
+
+    T& get(u32 handle) {
+        i64 index = slots.indexOf(handle);
+        if(index < 0)
+            throw std::runtime_error("SlotMap::get() called with a stale handle");
+        return values[index];
+    }
+
+    bool contains(u32 handle) const {
+        return slots.indexOf(handle) >= 0;
+    }
+
+    // false when the handle was already stale
+    bool remove(u32 handle) {
+        i64 found = slots.indexOf(handle);
+        if(found < 0)
+            return false;
+        auto index = (size_t) found;
+        u32 slot = indexToSlot[index];
+        values[index] = std::move(values.back());
+        values.pop_back();
+        indexToSlot[index] = indexToSlot.back();
+        indexToSlot.pop_back();
+        // the last value took its place
+        if(index < values.size())
+            slots.move(indexToSlot[index], (u32) index);
+        slots.release(slot);
+        return true;
+    }
+
+    // handle of the value at a position in the packed storage, for iterating with the handles
+    u32 handleAt(size_t index) const {
+        return slots.handleOf(indexToSlot[index]);
+    }
+
+    size_t size() const {
+        return values.size();
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+
+    void reserve(size_t capacity) {
+        values.reserve(capacity);
+        indexToSlot.reserve(capacity);
+        slots.reserve(capacity);
+    }
+
+    // every handle handed out so far goes stale
+    void clear() {
+        for(u32 slot : indexToSlot) {
+            slots.release(slot);
+        }
+        values.clear();
+        indexToSlot.clear();
+    }
+
+    auto begin() { return values.begin(); }
+    auto end() { return values.end(); }
+    auto cbegin() const { return values.begin(); }
+    auto cend() const { return values.end(); }
+    auto begin() const { return values.begin(); }
+    auto end() const { return values.end(); }
+
+private:
+    std::vector<T> values;
+    std::vector<u32> indexToSlot;
+    SlotTable slots;
+};
+
+#endif //CRAWLER_SLOTMAP_H
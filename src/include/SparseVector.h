@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <stdexcept>
 
+// Superseded by SlotMap, kept as the baseline slotmap_bench measures against
 template <typename T>
 class SparseVector {
 public:
@@ -41,8 +42,14 @@ public:
     void remove(size_t id) {
         auto it = idToIndex.find(id);
         if(it != idToIndex.end()) {
-            values.erase(values.begin() + it->second);
+            size_t index = it->second;
+            values.erase(values.begin() + index);
             idToIndex.erase(it);
+            // everything after it moved down one
+            for(auto& entry : idToIndex) {
+                if(entry.second > index)
+                    entry.second--;
+            }
         }
     }
 
@@ -43,6 +43,7 @@ enum {
     INPUT_ACTION_DUPLICATE,
     INPUT_ACTION_HIDE,
     INPUT_ACTION_GRID,
+    INPUT_ACTION_TOGGLE_TRACE,
 };
 
 enum {
@@ -1,5 +1,8 @@
 
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <SDL.h>
 #include <glad.h>
 #include <SDL_video.h>
@@ -11,6 +14,8 @@
 #include "imgui_impl_opengl3.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 extern "C" {
     #include "defs.h"
@@ -21,13 +26,33 @@ extern "C" {
 #include "game/Game.h"
 #include "renderer/Viewport.h"
 #include "renderer/Font.h"
+#include "renderer/ShaderCache.h"
+#include "renderer/GpuProfiler.h"
+#include "renderer/HeadlessContext.h"
+#include "renderer/RenderThread.h"
+#include "util/Profiler.h"
+#include "util/AllocTracker.h"
+#include "util/FrameArena.h"
+#include "util/JobSystem.h"
 
 
+#define FRAME_ARENA_SIZE MEGABYTES(16)
+// share of the refresh interval the level pass may take on the gpu with --dynamic-resolution
+#define DYNAMIC_RESOLUTION_BUDGET 0.8f
+
 global_variable u32 ScreenWidth = 1920;
 global_variable u32 ScreenHeight = 1080;
 global_variable SDL_Window* SDLWindow = nullptr;
 global_variable SDL_GLContext Context = nullptr;
 global_variable bool ShouldQuit = false;
+// 1 vsync, 0 uncapped, -1 adaptive vsync (late frames swap immediately), falls back to vsync if unsupported
+global_variable i32 SwapInterval = 1;
+// GL submission and swap on a separate thread, off renders on the main thread after each update
+global_variable bool UseRenderThread = true;
+// scale the level's render resolution and quality to hold the gpu budget, windowed only
+global_variable bool UseDynamicResolution = false;
+// job system threads besides the main thread, 0 meshes on the main thread only
+global_variable u32 JobWorkers = JOB_WORKERS_PER_CORE;
 global_variable u64 InitTimeStamp = 0;
 global_variable u64 PerformanceFrequency = 0;
 
@@ -187,8 +212,11 @@ INTERNAL bool InitVideo()
         return false;
     }
 
-    // request vsync
-    SDL_GL_SetSwapInterval(1);
+    if(SDL_GL_SetSwapInterval(SwapInterval) != 0) {
+        SDL_Log("Swap interval %d not supported (%s), using vsync", SwapInterval, SDL_GetError());
+        SwapInterval = 1;
+        SDL_GL_SetSwapInterval(SwapInterval);
+    }
 
     // Load OpenGL functions glad SDL
     gladLoadGLLoader(SDL_GL_GetProcAddress);
@@ -237,6 +265,216 @@ INTERNAL void ShutdownAudio() {
 }
 
 
+struct HeadlessOptions {
+    u32 width = 640;
+    u32 height = 360;
+    u32 seed = 1;
+    // 0 runs until the camera script is done
+    i32 frames = 0;
+    // from the start of testMap1 through the door and around the big room
+    std::string script = "efqo...ffeffqfffqfqq";
+    std::string captureDir;
+    i32 captureEvery = 1;
+    std::string hashFile;
+    std::string goldenFile;
+    // fail when UpdateGame allocates after the warmup frames, needs CRAWLER_TRACK_ALLOCS
+    bool checkAllocs = false;
+    i32 allocWarmupFrames = 30;
+    // frames are always 1/60 s apart, a lower tick rate renders interpolated frames between ticks
+    float tickRate = GAME_TICK_RATE;
+};
+
+// owned by the render thread while it runs
+struct HeadlessRenderState {
+    const HeadlessOptions* options;
+    Game::Game* game;
+    Renderer::PixelBuffer* frame;
+    std::vector<u64> hashes;
+    char filename[512];
+};
+
+// FNV-1a over 64 bit words, the frame size is always a multiple of 8 bytes for even widths
+INTERNAL u64 HashPixels(const Renderer::PixelBuffer& pb) {
+    const u8* bytes = (const u8*) pb.pixels;
+    size_t size = (size_t) pb.width * pb.height * 4;
+    u64 hash = 14695981039346656037ULL;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        u64 word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for(; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+INTERNAL bool ReadGoldenHashes(const std::string& filename, std::vector<u64>& hashes) {
+    FILE* f = fopen(filename.c_str(), "r");
+    if(!f)
+        return false;
+    unsigned long long hash;
+    int frame;
+    while(fscanf(f, "%d %llx", &frame, &hash) == 2) {
+        hashes.push_back((u64) hash);
+    }
+    fclose(f);
+    return true;
+}
+
+INTERNAL void StartHeadlessRenderThread(void* userData) {
+    Renderer::MakeHeadlessContextCurrent(true);
+    SetProfilerThreadName("Render");
+}
+
+INTERNAL void StopHeadlessRenderThread(void* userData) {
+    Renderer::MakeHeadlessContextCurrent(false);
+}
+
+INTERNAL void RenderHeadlessFrame(u32 slot, void* userData) {
+    auto& state = *(HeadlessRenderState*) userData;
+    Renderer::CollectGpuProfileZones();
+    Game::RenderGame(*state.game, slot);
+    Renderer::ReadFrameBuffer(state.game->levelRenderer.fbo, *state.frame);
+    state.hashes.push_back(HashPixels(*state.frame));
+    size_t index = state.hashes.size() - 1;
+    if(!state.options->captureDir.empty() && index % state.options->captureEvery == 0) {
+        snprintf(state.filename, sizeof(state.filename), "%s/frame_%05zu.png", state.options->captureDir.c_str(), index);
+        state.frame->saveToPNG(state.filename);
+    }
+}
+
+// Renders the level along a scripted camera path into the level renderer's fbo with a fixed time step and
+// no window, for soak tests and golden image checks. Every frame is read back and hashed, optionally saved
+// as png. Returns the process exit code, non zero when the hashes don't match the golden file.
+INTERNAL int RunHeadless(const HeadlessOptions& options, bool useShaderCache) {
+    if(SDL_Init(SDL_INIT_TIMER) < 0) {
+        SDL_Log("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return -1;
+    }
+    Renderer::InitViewport(options.width, options.height);
+    if(!Renderer::InitHeadlessContext()) {
+        SDL_Quit();
+        return -1;
+    }
+    Renderer::InitShaderCache("shadercache", useShaderCache);
+    glEnable(GL_BLEND);
+    PerformanceFrequency = SDL_GetPerformanceFrequency();
+    InitTimeStamp = SDL_GetPerformanceCounter();
+
+    Renderer::InitFonts();
+    SetProfilerThreadName("Main");
+    InitFrameArena(FRAME_ARENA_SIZE);
+    InitJobSystem(JobWorkers);
+    auto gameContext = std::make_unique<Game::Game>();
+    gameContext->randomSeed = options.seed;
+    gameContext->tickRate = options.tickRate;
+    Game::InitGame(*gameContext);
+    gameContext->levelRenderer.renderToFbo = true;
+    Game::SetCameraScript(*gameContext, options.script);
+    SDL_Log("Headless init took %.2f ms", GetTime() * 1000.0);
+
+    Renderer::PixelBuffer frame(options.width, options.height, Renderer::PixelFormat::RGBA);
+    HeadlessRenderState renderState{&options, gameContext.get(), &frame};
+    // pushing hashes from the render thread shouldn't count against the allocation check
+    renderState.hashes.reserve(options.frames > 0 ? options.frames : 4096);
+    Renderer::RenderThread renderThread;
+    Renderer::RenderThreadCallbacks callbacks;
+    callbacks.start = StartHeadlessRenderThread;
+    callbacks.stop = StopHeadlessRenderThread;
+    callbacks.render = RenderHeadlessFrame;
+    callbacks.userData = &renderState;
+    if(UseRenderThread)
+        Renderer::MakeHeadlessContextCurrent(false);
+    Renderer::StartRenderThread(renderThread, callbacks, UseRenderThread);
+
+    const float frameDelta = 1.0f / 60.0f;
+    double startTime = GetTime();
+    i32 frameCount = 0;
+    size_t allocatingFrames = 0;
+    while(true) {
+        if(options.frames > 0 ? frameCount >= options.frames : Game::IsCameraScriptDone(*gameContext))
+            break;
+        BeginProfilerFrame();
+        Renderer::WaitForRenderThread(renderThread);
+        BeginFrameArena();
+        auto allocsBefore = GetAllocStats();
+        Game::UpdateGame(*gameContext, frameDelta, Renderer::GetRenderPacketSlot(renderThread));
+        auto allocsAfter = GetAllocStats();
+        if(frameCount >= options.allocWarmupFrames && allocsAfter.count != allocsBefore.count) {
+            allocatingFrames++;
+            if(options.checkAllocs && allocatingFrames <= 8)
+                SDL_Log("Frame %d: %llu allocations, %llu bytes", frameCount,
+                        (unsigned long long) (allocsAfter.count - allocsBefore.count),
+                        (unsigned long long) (allocsAfter.bytes - allocsBefore.bytes));
+        }
+        Renderer::SubmitRenderPacket(renderThread);
+        frameCount++;
+        EndProfilerFrame();
+    }
+    Renderer::StopRenderThread(renderThread);
+    if(UseRenderThread)
+        Renderer::MakeHeadlessContextCurrent(true);
+    double seconds = GetTime() - startTime;
+    auto& hashes = renderState.hashes;
+    SDL_Log("Rendered %zu frames at %ux%u in %.2f s, %.1f frames/s%s", hashes.size(), options.width, options.height,
+            seconds, seconds > 0 ? (double) hashes.size() / seconds : 0.0, UseRenderThread ? " (render thread)" : "");
+
+    int result = 0;
+    if(options.checkAllocs) {
+        if(!IsAllocTrackingEnabled()) {
+            SDL_Log("--check-allocs needs a build with CRAWLER_TRACK_ALLOCS");
+            result = 1;
+        } else {
+            SDL_Log("Allocation check %s: %zu frames allocated after frame %d", allocatingFrames ? "FAILED" : "passed",
+                    allocatingFrames, options.allocWarmupFrames);
+            if(allocatingFrames)
+                result = 1;
+        }
+    }
+    if(!options.hashFile.empty()) {
+        FILE* f = fopen(options.hashFile.c_str(), "w");
+        if(f) {
+            for(size_t i = 0; i < hashes.size(); ++i) {
+                fprintf(f, "%zu %016llx\n", i, (unsigned long long) hashes[i]);
+            }
+            fclose(f);
+        } else {
+            SDL_Log("Could not write %s", options.hashFile.c_str());
+            result = 1;
+        }
+    }
+    if(!options.goldenFile.empty()) {
+        std::vector<u64> golden;
+        if(!ReadGoldenHashes(options.goldenFile, golden)) {
+            SDL_Log("Could not read golden hashes from %s", options.goldenFile.c_str());
+            result = 1;
+        } else {
+            size_t mismatches = golden.size() != hashes.size() ? 1 : 0;
+            for(size_t i = 0; i < std::min(golden.size(), hashes.size()); ++i) {
+                if(golden[i] != hashes[i]) {
+                    if(mismatches == 0 || i < 8)
+                        SDL_Log("Frame %zu differs from golden", i);
+                    mismatches++;
+                }
+            }
+            SDL_Log("Golden check %s: %zu frames, %zu golden, %zu mismatches", mismatches ? "FAILED" : "passed",
+                    hashes.size(), golden.size(), mismatches);
+            if(mismatches)
+                result = 1;
+        }
+    }
+
+    Game::ShutdownGame(*gameContext);
+    ShutdownJobSystem();
+    Renderer::ShutdownGpuProfiler();
+    Renderer::ShutdownFonts();
+    Renderer::ShutdownHeadlessContext();
+    SDL_Quit();
+    return result;
+}
+
 struct ImVec3 { float x, y, z; ImVec3(float _x = 0.0f, float _y = 0.0f, float _z = 0.0f) { x = _x; y = _y; z = _z; } };
 
 void imgui_easy_theming(ImVec3 color_for_text, ImVec3 color_for_head, ImVec3 color_for_area, ImVec3 color_for_body, ImVec3 color_for_pops)
@@ -295,14 +533,121 @@ void setupImGuiStyle2()
     imgui_easy_theming(color_for_text, color_for_head, color_for_area, color_for_body, color_for_pops);
 }
 
+// ImGui rebuilds its draw lists in the next NewFrame while the render thread may still be drawing this one, so
+// each packet slot keeps its own lists. Their buffers are swapped with ImGui's instead of copied, ImGui gets the
+// slot's previous buffers back and clears them, which keeps their capacity.
+struct ImGuiPacket {
+    ImDrawData drawData;
+    ImVector<ImDrawList*> lists;
+};
+
+global_variable ImGuiPacket ImGuiPackets[RENDER_PACKET_SLOTS];
+
+INTERNAL void SnapshotImGuiDrawData(ImGuiPacket& packet) {
+    ImDrawData* src = ImGui::GetDrawData();
+    while(packet.lists.Size < src->CmdListsCount) {
+        packet.lists.push_back(IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData()));
+    }
+    for(int i = 0; i < src->CmdListsCount; ++i) {
+        ImDrawList* from = src->CmdLists[i];
+        ImDrawList* to = packet.lists[i];
+        to->CmdBuffer.swap(from->CmdBuffer);
+        to->IdxBuffer.swap(from->IdxBuffer);
+        to->VtxBuffer.swap(from->VtxBuffer);
+        to->Flags = from->Flags;
+    }
+    packet.drawData = *src;
+    packet.drawData.CmdLists = packet.lists.Data;
+}
+
+INTERNAL void StartWindowRenderThread(void* userData) {
+    SDL_GL_MakeCurrent(SDLWindow, Context);
+    SetProfilerThreadName("Render");
+}
+
+INTERNAL void StopWindowRenderThread(void* userData) {
+    SDL_GL_MakeCurrent(SDLWindow, nullptr);
+}
+
+INTERNAL void RenderWindowFrame(u32 slot, void* userData) {
+    auto& game = *(Game::Game*) userData;
+    Renderer::CollectGpuProfileZones();
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        SDL_Log("Loop OpenGL error: %d", err);
+    }
+
+    Game::RenderGame(game, slot);
+
+    // ImGui Rendering
+    {
+        PROFILE_SCOPE("ImGui");
+        PROFILE_GPU_SCOPE("ImGui");
+        auto& drawData = ImGuiPackets[slot].drawData;
+        glViewport(0, 0, (int)drawData.DisplaySize.x, (int)drawData.DisplaySize.y);
+        ImGui_ImplOpenGL3_RenderDrawData(&drawData);
+    }
+
+    {
+        PROFILE_SCOPE("SwapWindow");
+        SDL_GL_SwapWindow(SDLWindow);
+    }
+}
+
 /**
  * Entry point
  * @return
  */
 
-int main()
+int main(int argc, char* argv[])
 {
+    bool useShaderCache = true;
+    bool headless = false;
+    HeadlessOptions headlessOptions;
+    float tickRate = GAME_TICK_RATE;
+    for(int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if(strcmp(argv[i], "--no-shader-cache") == 0) {
+            useShaderCache = false;
+        } else if(strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if(strcmp(argv[i], "--size") == 0 && hasValue) {
+            sscanf(argv[++i], "%ux%u", &headlessOptions.width, &headlessOptions.height);
+        } else if(strcmp(argv[i], "--seed") == 0 && hasValue) {
+            headlessOptions.seed = (u32) strtoul(argv[++i], nullptr, 10);
+        } else if(strcmp(argv[i], "--frames") == 0 && hasValue) {
+            headlessOptions.frames = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--path") == 0 && hasValue) {
+            headlessOptions.script = argv[++i];
+        } else if(strcmp(argv[i], "--capture-dir") == 0 && hasValue) {
+            headlessOptions.captureDir = argv[++i];
+        } else if(strcmp(argv[i], "--capture-every") == 0 && hasValue) {
+            headlessOptions.captureEvery = std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--hashes") == 0 && hasValue) {
+            headlessOptions.hashFile = argv[++i];
+        } else if(strcmp(argv[i], "--golden") == 0 && hasValue) {
+            headlessOptions.goldenFile = argv[++i];
+        } else if(strcmp(argv[i], "--check-allocs") == 0) {
+            headlessOptions.checkAllocs = true;
+        } else if(strcmp(argv[i], "--tick-rate") == 0 && hasValue) {
+            tickRate = std::max(1.0f, (float) atof(argv[++i]));
+            headlessOptions.tickRate = tickRate;
+        } else if(strcmp(argv[i], "--workers") == 0 && hasValue) {
+            JobWorkers = (u32) strtoul(argv[++i], nullptr, 10);
+        } else if(strcmp(argv[i], "--dynamic-resolution") == 0) {
+            UseDynamicResolution = true;
+        } else if(strcmp(argv[i], "--no-render-thread") == 0) {
+            UseRenderThread = false;
+        } else if(strcmp(argv[i], "--vsync") == 0 && hasValue) {
+            const char* mode = argv[++i];
+            SwapInterval = strcmp(mode, "off") == 0 ? 0 : strcmp(mode, "adaptive") == 0 ? -1 : 1;
+        }
+    }
+
     Input::InitInput();
+    if(headless) {
+        return RunHeadless(headlessOptions, useShaderCache);
+    }
     
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0 )
     {
@@ -318,6 +663,7 @@ int main()
         SDL_Quit();
         return -1;
     }
+    Renderer::InitShaderCache("shadercache", useShaderCache);
 
 
     // Setup Dear ImGui binding
@@ -342,65 +688,85 @@ int main()
         SDL_Quit();
         return -1;
     }
-    SDL_Log("Monitor refresh rate is %d hz", displayMode.refresh_rate);
+    SDL_Log("Monitor refresh rate is %d hz, simulating at %.0f hz, swap interval %d", displayMode.refresh_rate, tickRate,
+            SwapInterval);
 
-    //i32 monitorRefreshHz = displayMode.refresh_rate;
-    //i32 gameUpdateHz = monitorRefreshHz;
-    i32 gameUpdateHz = 60;
-    double targetSecondsPerFrame = 1.0 / (double) gameUpdateHz;
     PerformanceFrequency = SDL_GetPerformanceFrequency();
     InitTimeStamp = SDL_GetPerformanceCounter();
     double oldTime = 0;
     double secondsElapsedForFrame = 0;
-    float engineTimer = 0;
 
     Renderer::InitFonts();
+    SetProfilerThreadName("Main");
+    InitFrameArena(FRAME_ARENA_SIZE);
+    InitJobSystem(JobWorkers);
 
     auto gameContext = std::make_unique<Game::Game>();
+    gameContext->tickRate = tickRate;
 
     Game::InitGame(*gameContext);
+    if(UseDynamicResolution) {
+        i32 refreshRate = displayMode.refresh_rate > 0 ? displayMode.refresh_rate : 60;
+        Renderer::InitDynamicResolution(gameContext->levelRenderer.resolution,
+                                        1000.0f / (float) refreshRate * DYNAMIC_RESOLUTION_BUDGET);
+    }
+    auto& shaderStats = Renderer::GetShaderCacheStats();
+    SDL_Log("Game init took %.2f ms, shaders %.2f ms (%u cached, %u compiled, cache %s)",
+            GetTime() * 1000.0, shaderStats.ms, shaderStats.hits, shaderStats.misses,
+            Renderer::IsShaderCacheEnabled() ? "on" : "off");
+
+    // creates the ImGui device objects and font texture while the context is still current on this thread
+    ImGui_ImplOpenGL3_NewFrame();
+    Renderer::RenderThread renderThread;
+    Renderer::RenderThreadCallbacks callbacks;
+    callbacks.start = StartWindowRenderThread;
+    callbacks.stop = StopWindowRenderThread;
+    callbacks.render = RenderWindowFrame;
+    callbacks.userData = gameContext.get();
+    if(UseRenderThread)
+        SDL_GL_MakeCurrent(SDLWindow, nullptr);
+    Renderer::StartRenderThread(renderThread, callbacks, UseRenderThread);
 
     while(true) {
         if(ShouldQuit || gameContext->quitFlag)
             break;
 
         oldTime = GetTime();
+        BeginProfilerFrame();
+        // the render thread paces the loop, with vsync this is where the main thread waits for the swap
+        Renderer::WaitForRenderThread(renderThread);
+        BeginFrameArena();
         UpdateInput();
 
         // Start the Dear ImGui frame
-        ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame(SDLWindow);
         ImGui::NewFrame();
 
-        GLenum err;
-        while ((err = glGetError()) != GL_NO_ERROR) {
-            SDL_Log("Loop OpenGL error: %d", err);
-        }
+        // long frames are capped by UpdateGame, it drops time after GAME_MAX_TICKS_PER_FRAME ticks
+        u32 slot = Renderer::GetRenderPacketSlot(renderThread);
+        Game::UpdateGame(*gameContext, (float) secondsElapsedForFrame, slot);
 
-        //secondsElapsedForFrame = 1.0 / (double) 350;
-        if(secondsElapsedForFrame > 0.5) {
-            secondsElapsedForFrame = targetSecondsPerFrame;
-            SDL_Log("Correcting crazy framerate");
+        {
+            PROFILE_SCOPE("ImGui");
+            ImGui::Render();
+            SnapshotImGuiDrawData(ImGuiPackets[slot]);
         }
-
-        engineTimer += (float) secondsElapsedForFrame;
-        //SDL_Log("engineTimer: %f", engineTimer);
-
-        Game::UpdateGame(*gameContext, (float) secondsElapsedForFrame);
-
-        // ImGui Rendering
-        ImGui::Render();
-        SDL_GL_MakeCurrent(SDLWindow, Context);
-        glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-
-        SDL_GL_SwapWindow(SDLWindow);
+        Renderer::SubmitRenderPacket(renderThread);
+        EndProfilerFrame();
         //SDL_Delay(35);
         secondsElapsedForFrame = GetTime() - oldTime;
     }
+    Renderer::StopRenderThread(renderThread);
+    SDL_GL_MakeCurrent(SDLWindow, Context);
+    for(auto& packet : ImGuiPackets) {
+        for(auto list : packet.lists) {
+            IM_DELETE(list);
+        }
+    }
 
     Game::ShutdownGame(*gameContext);
+    ShutdownJobSystem();
+    Renderer::ShutdownGpuProfiler();
 
     Renderer::ShutdownFonts();
 
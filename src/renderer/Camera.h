@@ -44,6 +44,24 @@ struct HeadBobbing {
     float displacement = 0.0f; //  Current displacement of the head bobbing
 };
 
+// What the renderer needs from the camera. The fixed step simulation keeps the pose from the start of the tick
+// and frames drawn between ticks blend it with the current one.
+struct CameraPose {
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float bobbing;
+};
+
+inline CameraPose LerpCameraPose(const CameraPose& a, const CameraPose& b, float t) {
+    CameraPose pose{};
+    pose.position = glm::mix(a.position, b.position, t);
+    pose.yaw = glm::mix(a.yaw, b.yaw, t);
+    pose.pitch = glm::mix(a.pitch, b.pitch, t);
+    pose.bobbing = glm::mix(a.bobbing, b.bobbing, t);
+    return pose;
+}
+
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
 class Camera
 {
@@ -90,6 +108,18 @@ public:
         return glm::lookAt(position, position + Front, Up);
     }
 
+    CameraPose GetPose() const {
+        return CameraPose{Position, Yaw, Pitch, headBobbing.displacement};
+    }
+
+    void SetPose(const CameraPose& pose) {
+        Position = pose.position;
+        Yaw = pose.yaw;
+        Pitch = pose.pitch;
+        headBobbing.displacement = pose.bobbing;
+        updateCameraVectors();
+    }
+
     void AnimateMove(Camera_Movement direction, float duration, float distance) {
         CameraAnimation a{};
         a.direction = direction;
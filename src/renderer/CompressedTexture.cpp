@@ -0,0 +1,508 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <SDL_log.h>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "CompressedTexture.h"
+
+namespace Renderer {
+    namespace {
+        const u32 DDS_MAGIC = 0x20534444; // "DDS "
+        const u32 DDSD_CAPS = 0x1;
+        const u32 DDSD_HEIGHT = 0x2;
+        const u32 DDSD_WIDTH = 0x4;
+        const u32 DDSD_PIXELFORMAT = 0x1000;
+        const u32 DDSD_MIPMAPCOUNT = 0x20000;
+        const u32 DDSD_LINEARSIZE = 0x80000;
+        const u32 DDPF_FOURCC = 0x4;
+        const u32 DDSCAPS_COMPLEX = 0x8;
+        const u32 DDSCAPS_TEXTURE = 0x1000;
+        const u32 DDSCAPS_MIPMAP = 0x400000;
+        const u32 DXGI_FORMAT_BC1_UNORM = 71;
+        const u32 DXGI_FORMAT_BC3_UNORM = 77;
+        const u32 DXGI_FORMAT_BC7_UNORM = 98;
+        const u32 DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+        // larger than any texture we load, keeps the level sizes of a corrupt header from overflowing
+        const u32 DDS_MAX_DIMENSION = 16384;
+
+        constexpr u32 fourCC(char a, char b, char c, char d) {
+            return (u32) a | ((u32) b << 8) | ((u32) c << 16) | ((u32) d << 24);
+        }
+
+        struct DDSPixelFormat {
+            u32 size;
+            u32 flags;
+            u32 fourCC;
+            u32 rgbBitCount;
+            u32 rBitMask;
+            u32 gBitMask;
+            u32 bBitMask;
+            u32 aBitMask;
+        };
+
+        struct DDSHeader {
+            u32 size;
+            u32 flags;
+            u32 height;
+            u32 width;
+            u32 pitchOrLinearSize;
+            u32 depth;
+            u32 mipMapCount;
+            u32 reserved1[11];
+            DDSPixelFormat pixelFormat;
+            u32 caps;
+            u32 caps2;
+            u32 caps3;
+            u32 caps4;
+            u32 reserved2;
+        };
+
+        struct DDSHeaderDX10 {
+            u32 dxgiFormat;
+            u32 resourceDimension;
+            u32 miscFlag;
+            u32 arraySize;
+            u32 miscFlags2;
+        };
+
+        static_assert(sizeof(DDSHeader) == 124, "DDS header must be 124 bytes");
+
+        size_t levelSize(CompressedFormat format, u32 width, u32 height) {
+            return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * CompressedBlockSize(format);
+        }
+
+        inline u16 packRgb565(const u8* c) {
+            u32 r = (c[0] * 31 + 127) / 255;
+            u32 g = (c[1] * 63 + 127) / 255;
+            u32 b = (c[2] * 31 + 127) / 255;
+            return (u16) ((r << 11) | (g << 5) | b);
+        }
+
+        inline void unpackRgb565(u16 c, u8* out) {
+            u32 r = (c >> 11) & 31;
+            u32 g = (c >> 5) & 63;
+            u32 b = c & 31;
+            out[0] = (u8) ((r << 3) | (r >> 2));
+            out[1] = (u8) ((g << 2) | (g >> 4));
+            out[2] = (u8) ((b << 3) | (b >> 2));
+        }
+
+        // palette as the hardware decodes it, alpha included so index 3 can be transparent black
+        void colorPalette(u16 c0, u16 c1, bool fourColor, u8 palette[4][4]) {
+            unpackRgb565(c0, palette[0]);
+            unpackRgb565(c1, palette[1]);
+            palette[0][3] = palette[1][3] = 255;
+            for(int i = 0; i < 3; ++i) {
+                if(fourColor) {
+                    palette[2][i] = (u8) ((2 * palette[0][i] + palette[1][i]) / 3);
+                    palette[3][i] = (u8) ((palette[0][i] + 2 * palette[1][i]) / 3);
+                } else {
+                    palette[2][i] = (u8) ((palette[0][i] + palette[1][i]) / 2);
+                    palette[3][i] = 0;
+                }
+            }
+            palette[2][3] = 255;
+            palette[3][3] = fourColor ? 255 : 0;
+        }
+
+        inline u32 colorDistance(const u8* a, const u8* b) {
+            i32 dr = a[0] - b[0];
+            i32 dg = a[1] - b[1];
+            i32 db = a[2] - b[2];
+            return (u32) (dr * dr + dg * dg + db * db);
+        }
+
+        // Endpoints are picked as the extreme pixels along the principal axis of the block colors.
+        // With allowTransparent (plain BC1) pixels below half alpha are encoded with the punch through index.
+        void encodeColorBlock(const u8 block[16][4], bool allowTransparent, u8* out) {
+            bool transparent[16];
+            bool anyTransparent = false;
+            float mean[3] = {0, 0, 0};
+            u32 count = 0;
+            for(int i = 0; i < 16; ++i) {
+                transparent[i] = allowTransparent && block[i][3] < 128;
+                anyTransparent |= transparent[i];
+                if(transparent[i])
+                    continue;
+                for(int c = 0; c < 3; ++c)
+                    mean[c] += block[i][c];
+                count++;
+            }
+
+            u16 c0 = 0, c1 = 0;
+            if(count > 0) {
+                for(float& m : mean)
+                    m /= (float) count;
+                float cov[6] = {0, 0, 0, 0, 0, 0};
+                for(int i = 0; i < 16; ++i) {
+                    if(transparent[i])
+                        continue;
+                    float r = block[i][0] - mean[0];
+                    float g = block[i][1] - mean[1];
+                    float b = block[i][2] - mean[2];
+                    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+                    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+                }
+                float axis[3] = {1, 1, 1};
+                for(int it = 0; it < 8; ++it) {
+                    float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+                    float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+                    float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+                    float len = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+                    if(len < 1e-6f)
+                        break;
+                    axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+                }
+                float minDot = 1e30f, maxDot = -1e30f;
+                int minIdx = 0, maxIdx = 0;
+                for(int i = 0; i < 16; ++i) {
+                    if(transparent[i])
+                        continue;
+                    float d = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+                    if(d < minDot) { minDot = d; minIdx = i; }
+                    if(d > maxDot) { maxDot = d; maxIdx = i; }
+                }
+                c0 = packRgb565(block[maxIdx]);
+                c1 = packRgb565(block[minIdx]);
+            }
+
+            // c0 > c1 selects four color mode, c0 <= c1 three colors plus transparent black
+            bool fourColor = !anyTransparent;
+            if((fourColor && c0 < c1) || (!fourColor && c0 > c1))
+                std::swap(c0, c1);
+
+            u32 indices = 0;
+            if(fourColor && c0 == c1) {
+                indices = 0;
+            } else {
+                u8 palette[4][4];
+                colorPalette(c0, c1, fourColor, palette);
+                u32 paletteSize = fourColor ? 4 : 3;
+                for(int i = 0; i < 16; ++i) {
+                    u32 best = 3;
+                    if(!transparent[i]) {
+                        u32 bestDist = UINT32_MAX;
+                        for(u32 p = 0; p < paletteSize; ++p) {
+                            u32 dist = colorDistance(block[i], palette[p]);
+                            if(dist < bestDist) {
+                                bestDist = dist;
+                                best = p;
+                            }
+                        }
+                    }
+                    indices |= best << (2 * i);
+                }
+            }
+            memcpy(out, &c0, 2);
+            memcpy(out + 2, &c1, 2);
+            memcpy(out + 4, &indices, 4);
+        }
+
+        void alphaPalette(u8 a0, u8 a1, u8 palette[8]) {
+            palette[0] = a0;
+            palette[1] = a1;
+            if(a0 > a1) {
+                for(int i = 1; i < 7; ++i)
+                    palette[i + 1] = (u8) (((7 - i) * a0 + i * a1) / 7);
+            } else {
+                for(int i = 1; i < 5; ++i)
+                    palette[i + 1] = (u8) (((5 - i) * a0 + i * a1) / 5);
+                palette[6] = 0;
+                palette[7] = 255;
+            }
+        }
+
+        void encodeAlphaBlock(const u8 block[16][4], u8* out) {
+            u8 amin = 255, amax = 0;
+            for(int i = 0; i < 16; ++i) {
+                amin = std::min(amin, block[i][3]);
+                amax = std::max(amax, block[i][3]);
+            }
+            u64 bits = 0;
+            if(amin != amax) {
+                u8 palette[8];
+                alphaPalette(amax, amin, palette);
+                for(int i = 0; i < 16; ++i) {
+                    u32 best = 0;
+                    i32 bestDist = INT32_MAX;
+                    for(u32 p = 0; p < 8; ++p) {
+                        i32 dist = std::abs((i32) block[i][3] - (i32) palette[p]);
+                        if(dist < bestDist) {
+                            bestDist = dist;
+                            best = p;
+                        }
+                    }
+                    bits |= (u64) best << (3 * i);
+                }
+            }
+            out[0] = amax;
+            out[1] = amin;
+            for(int i = 0; i < 6; ++i)
+                out[2 + i] = (u8) (bits >> (8 * i));
+        }
+
+        void decodeColorBlock(const u8* in, bool forceFourColor, u8 block[16][4]) {
+            u16 c0, c1;
+            u32 indices;
+            memcpy(&c0, in, 2);
+            memcpy(&c1, in + 2, 2);
+            memcpy(&indices, in + 4, 4);
+            u8 palette[4][4];
+            colorPalette(c0, c1, forceFourColor || c0 > c1, palette);
+            for(int i = 0; i < 16; ++i)
+                memcpy(block[i], palette[(indices >> (2 * i)) & 3], 4);
+        }
+
+        void decodeAlphaBlock(const u8* in, u8 block[16][4]) {
+            u8 palette[8];
+            alphaPalette(in[0], in[1], palette);
+            u64 bits = 0;
+            for(int i = 0; i < 6; ++i)
+                bits |= (u64) in[2 + i] << (8 * i);
+            for(int i = 0; i < 16; ++i)
+                block[i][3] = palette[(bits >> (3 * i)) & 7];
+        }
+
+        void compressLevel(CompressedLevel& level, const u8* pixels, u32 width, u32 height, CompressedFormat format) {
+            level.width = width;
+            level.height = height;
+            level.data.resize(levelSize(format, width, height));
+            u8* out = level.data.data();
+            u8 block[16][4];
+            for(u32 by = 0; by < height; by += 4) {
+                for(u32 bx = 0; bx < width; bx += 4) {
+                    // clamp so partial edge blocks repeat their last row/column
+                    for(u32 y = 0; y < 4; ++y) {
+                        u32 sy = std::min(by + y, height - 1);
+                        for(u32 x = 0; x < 4; ++x) {
+                            u32 sx = std::min(bx + x, width - 1);
+                            memcpy(block[y * 4 + x], &pixels[(sy * width + sx) * 4], 4);
+                        }
+                    }
+                    if(format == CompressedFormat::BC3) {
+                        encodeAlphaBlock(block, out);
+                        encodeColorBlock(block, false, out + 8);
+                        out += 16;
+                    } else {
+                        encodeColorBlock(block, true, out);
+                        out += 8;
+                    }
+                }
+            }
+        }
+
+        void downsample(std::vector<u8>& dst, const std::vector<u8>& src, u32 width, u32 height) {
+            u32 dw = std::max(1u, width / 2);
+            u32 dh = std::max(1u, height / 2);
+            dst.resize((size_t) dw * dh * 4);
+            for(u32 y = 0; y < dh; ++y) {
+                u32 y0 = std::min(y * 2, height - 1);
+                u32 y1 = std::min(y * 2 + 1, height - 1);
+                for(u32 x = 0; x < dw; ++x) {
+                    u32 x0 = std::min(x * 2, width - 1);
+                    u32 x1 = std::min(x * 2 + 1, width - 1);
+                    for(u32 c = 0; c < 4; ++c) {
+                        u32 sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] +
+                                  src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+                        dst[(y * dw + x) * 4 + c] = (u8) ((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+
+    u32 CompressedBlockSize(CompressedFormat format) {
+        return format == CompressedFormat::BC1 ? 8 : 16;
+    }
+
+    void LoadDDS(CompressedImage& image, const std::string& filename) {
+        FILE* f = fopen(filename.c_str(), "rb");
+        if(!f)
+            throw std::runtime_error("Could not open " + filename);
+        u32 magic = 0;
+        DDSHeader header{};
+        bool ok = fread(&magic, sizeof(magic), 1, f) == 1 && magic == DDS_MAGIC &&
+                  fread(&header, sizeof(header), 1, f) == 1 && header.size == sizeof(DDSHeader);
+        if(ok && !(header.pixelFormat.flags & DDPF_FOURCC))
+            ok = false;
+
+        if(ok) {
+            u32 fcc = header.pixelFormat.fourCC;
+            if(fcc == fourCC('D', 'X', 'T', '1')) {
+                image.format = CompressedFormat::BC1;
+            } else if(fcc == fourCC('D', 'X', 'T', '5')) {
+                image.format = CompressedFormat::BC3;
+            } else if(fcc == fourCC('D', 'X', '1', '0')) {
+                DDSHeaderDX10 dx10{};
+                ok = fread(&dx10, sizeof(dx10), 1, f) == 1;
+                if(dx10.dxgiFormat == DXGI_FORMAT_BC1_UNORM) {
+                    image.format = CompressedFormat::BC1;
+                } else if(dx10.dxgiFormat == DXGI_FORMAT_BC3_UNORM) {
+                    image.format = CompressedFormat::BC3;
+                } else if(dx10.dxgiFormat == DXGI_FORMAT_BC7_UNORM || dx10.dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB) {
+                    image.format = CompressedFormat::BC7;
+                } else {
+                    SDL_Log("Unsupported DXGI format %u in %s", dx10.dxgiFormat, filename.c_str());
+                    ok = false;
+                }
+            } else {
+                SDL_Log("Unsupported DDS fourcc 0x%08x in %s", fcc, filename.c_str());
+                ok = false;
+            }
+        }
+
+        u32 mipCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.mipMapCount) : 1;
+        if(ok) {
+            // checked before any sizes are computed from them
+            u32 w = header.width;
+            u32 h = header.height;
+            u32 maxMipCount = 1;
+            for(u32 d = std::max(w, h); d > 1; d /= 2)
+                maxMipCount++;
+            if(w == 0 || h == 0 || w > DDS_MAX_DIMENSION || h > DDS_MAX_DIMENSION || mipCount > maxMipCount) {
+                SDL_Log("Bad DDS size %ux%u with %u mips in %s", w, h, mipCount, filename.c_str());
+                ok = false;
+            }
+        }
+
+        if(ok) {
+            // the whole mip chain has to be in the file before any of it is allocated
+            size_t total = 0;
+            u32 w = header.width;
+            u32 h = header.height;
+            for(u32 i = 0; i < mipCount; ++i) {
+                total += levelSize(image.format, w, h);
+                w = std::max(1u, w / 2);
+                h = std::max(1u, h / 2);
+            }
+            long start = ftell(f);
+            ok = start >= 0 && fseek(f, 0, SEEK_END) == 0;
+            long end = ok ? ftell(f) : -1;
+            ok = ok && end >= start && (size_t) (end - start) >= total && fseek(f, start, SEEK_SET) == 0;
+        }
+
+        if(ok) {
+            u32 w = header.width;
+            u32 h = header.height;
+            image.levels.clear();
+            image.levels.resize(mipCount);
+            for(auto& level : image.levels) {
+                level.width = w;
+                level.height = h;
+                level.data.resize(levelSize(image.format, w, h));
+                if(fread(level.data.data(), 1, level.data.size(), f) != level.data.size()) {
+                    ok = false;
+                    break;
+                }
+                w = std::max(1u, w / 2);
+                h = std::max(1u, h / 2);
+            }
+        }
+        fclose(f);
+        if(!ok)
+            throw std::runtime_error("Invalid or truncated DDS file " + filename);
+    }
+
+    void SaveDDS(const CompressedImage& image, const std::string& filename) {
+        if(image.levels.empty())
+            throw std::runtime_error("Cannot save empty compressed image");
+        if(image.format == CompressedFormat::BC7)
+            throw std::runtime_error("Saving BC7 is not supported");
+
+        DDSHeader header{};
+        header.size = sizeof(DDSHeader);
+        header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+        header.width = image.levels[0].width;
+        header.height = image.levels[0].height;
+        header.pitchOrLinearSize = (u32) image.levels[0].data.size();
+        header.mipMapCount = (u32) image.levels.size();
+        header.pixelFormat.size = sizeof(DDSPixelFormat);
+        header.pixelFormat.flags = DDPF_FOURCC;
+        header.pixelFormat.fourCC = image.format == CompressedFormat::BC1 ? fourCC('D', 'X', 'T', '1') : fourCC('D', 'X', 'T', '5');
+        header.caps = DDSCAPS_TEXTURE;
+        if(image.levels.size() > 1) {
+            header.flags |= DDSD_MIPMAPCOUNT;
+            header.caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+        }
+
+        FILE* f = fopen(filename.c_str(), "wb");
+        if(!f)
+            throw std::runtime_error("Could not open " + filename + " for writing");
+        bool ok = fwrite(&DDS_MAGIC, sizeof(DDS_MAGIC), 1, f) == 1 && fwrite(&header, sizeof(header), 1, f) == 1;
+        for(auto& level : image.levels) {
+            if(!ok)
+                break;
+            ok = fwrite(level.data.data(), 1, level.data.size(), f) == level.data.size();
+        }
+        fclose(f);
+        if(!ok)
+            throw std::runtime_error("Could not write " + filename);
+    }
+
+    void CompressPixelBuffer(CompressedImage& image, const PixelBuffer& pb, CompressedFormat format, bool mipmaps) {
+        if(pb.pixelFormat != PixelFormat::RGBA)
+            throw std::runtime_error("Only RGBA pixelbuffers can be block compressed");
+        if(format == CompressedFormat::BC7)
+            throw std::runtime_error("BC7 encoding is not supported, use an external encoder");
+
+        image.format = format;
+        image.levels.clear();
+        u32 w = pb.width;
+        u32 h = pb.height;
+        std::vector<u8> current((u8*) pb.pixels, (u8*) pb.pixels + (size_t) w * h * 4);
+        std::vector<u8> next;
+        while(true) {
+            image.levels.emplace_back();
+            compressLevel(image.levels.back(), current.data(), w, h, format);
+            if(!mipmaps || (w == 1 && h == 1))
+                break;
+            downsample(next, current, w, h);
+            current.swap(next);
+            w = std::max(1u, w / 2);
+            h = std::max(1u, h / 2);
+        }
+    }
+
+    void DecompressLevel(PixelBuffer& pb, const CompressedImage& image, u32 level) {
+        if(image.format == CompressedFormat::BC7)
+            throw std::runtime_error("No CPU decoder for BC7, the driver needs ARB_texture_compression_bptc");
+        const CompressedLevel& l = image.levels.at(level);
+        if(pb.width != l.width || pb.height != l.height || pb.pixelFormat != PixelFormat::RGBA)
+            throw std::runtime_error("Pixelbuffer does not match compressed level");
+
+        u8* pixels = (u8*) pb.pixels;
+        const u8* in = l.data.data();
+        u8 block[16][4];
+        for(u32 by = 0; by < l.height; by += 4) {
+            for(u32 bx = 0; bx < l.width; bx += 4) {
+                if(image.format == CompressedFormat::BC3) {
+                    decodeColorBlock(in + 8, true, block);
+                    decodeAlphaBlock(in, block);
+                    in += 16;
+                } else {
+                    decodeColorBlock(in, false, block);
+                    in += 8;
+                }
+                u32 bw = std::min(4u, l.width - bx);
+                u32 bh = std::min(4u, l.height - by);
+                for(u32 y = 0; y < bh; ++y)
+                    memcpy(&pixels[((by + y) * l.width + bx) * 4], block[y * 4], bw * 4);
+            }
+        }
+    }
+
+    std::string FindCompressedVariant(const std::string& filename) {
+        auto dot = filename.find_last_of('.');
+        std::string ddsFile = (dot == std::string::npos ? filename : filename.substr(0, dot)) + ".dds";
+        FILE* f = fopen(ddsFile.c_str(), "rb");
+        if(!f)
+            return "";
+        fclose(f);
+        return ddsFile;
+    }
+}
@@ -0,0 +1,49 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_COMPRESSEDTEXTURE_H
+#define CRAWLER_COMPRESSEDTEXTURE_H
+
+#include <string>
+#include <vector>
+#include "defs.h"
+#include "PixelBuffer.h"
+
+namespace Renderer {
+
+    // Block compressed formats we can read from DDS containers. BC1 and BC3 have a CPU encoder and decoder,
+    // BC7 can only be uploaded as is when the driver exposes bptc.
+    enum class CompressedFormat {
+        BC1,
+        BC3,
+        BC7,
+    };
+
+    struct CompressedLevel {
+        u32 width;
+        u32 height;
+        std::vector<u8> data;
+    };
+
+    struct CompressedImage {
+        CompressedFormat format;
+        std::vector<CompressedLevel> levels;
+    };
+
+    u32 CompressedBlockSize(CompressedFormat format);
+
+    // Baked DDS files are stored bottom-up, in the same row order LoadTextureFromPng uploads in
+    void LoadDDS(CompressedImage& image, const std::string& filename);
+    void SaveDDS(const CompressedImage& image, const std::string& filename);
+
+    // encode an RGBA pixelbuffer, optionally with a box filtered mip chain down to 1x1
+    void CompressPixelBuffer(CompressedImage& image, const PixelBuffer& pb, CompressedFormat format, bool mipmaps);
+    // decode a single level into an RGBA pixelbuffer of the same size (BC1/BC3 only)
+    void DecompressLevel(PixelBuffer& pb, const CompressedImage& image, u32 level);
+
+    // returns the .dds sitting next to a .png if one has been baked, otherwise an empty string
+    std::string FindCompressedVariant(const std::string& filename);
+}
+
+#endif //CRAWLER_COMPRESSEDTEXTURE_H
@@ -0,0 +1,118 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <SDL_log.h>
+#include <algorithm>
+#include <cmath>
+#include "DynamicResolution.h"
+
+extern "C" {
+#include "glad.h"
+}
+
+namespace Renderer {
+    static const RenderQualitySettings qualityLadder[] = {
+            {false, 1},     // LOW
+            {false, 3},     // MEDIUM
+            {true, 7},      // HIGH
+    };
+
+    static const char* qualityNames[] = {"low", "medium", "high"};
+
+    const RenderQualitySettings &GetRenderQualitySettings(RenderQuality quality) {
+        return qualityLadder[(i32) quality];
+    }
+
+    void InitDynamicResolution(DynamicResolution &dr, float targetMs) {
+        glGenQueries(DYNRES_QUERY_FRAMES * 2, &dr.queries[0][0]);
+        dr.enabled = true;
+        dr.targetMs = targetMs;
+        dr.scale = 1.0f;
+        dr.quality = RenderQuality::HIGH;
+        SDL_Log("Dynamic resolution on, level pass target %.2f ms", targetMs);
+    }
+
+    void ShutdownDynamicResolution(DynamicResolution &dr) {
+        if(!dr.enabled)
+            return;
+        glDeleteQueries(DYNRES_QUERY_FRAMES * 2, &dr.queries[0][0]);
+        dr.enabled = false;
+    }
+
+    static void stepQuality(DynamicResolution& dr, i32 step) {
+        dr.quality = (RenderQuality) ((i32) dr.quality + step);
+        // the new level changes the cost per pixel, give it time to show up in the measurements
+        dr.settleFrames = DYNRES_QUERY_FRAMES * 4;
+        SDL_Log("Render quality %s (level pass %.2f ms, target %.2f ms)", qualityNames[(i32) dr.quality], dr.gpuMs,
+                dr.targetMs);
+    }
+
+    static void adjust(DynamicResolution& dr) {
+        if(dr.settleFrames > 0) {
+            dr.settleFrames--;
+            return;
+        }
+        if(dr.gpuMs > dr.targetMs) {
+            if(dr.scale > DYNRES_MIN_SCALE) {
+                // the cost goes with the pixel count, the square of the scale. Drop at most 15% at a time
+                float wanted = dr.scale * sqrtf(dr.targetMs / dr.gpuMs);
+                dr.scale = std::max(DYNRES_MIN_SCALE, std::max(wanted, dr.scale * 0.85f));
+                dr.settleFrames = DYNRES_QUERY_FRAMES;
+            } else if(dr.quality != RenderQuality::LOW) {
+                stepQuality(dr, -1);
+            }
+        } else if(dr.gpuMs < dr.targetMs * 0.75f) {
+            if(dr.scale < 1.0f) {
+                dr.scale = std::min(1.0f, dr.scale * 1.02f);
+                dr.settleFrames = DYNRES_QUERY_FRAMES;
+            } else if(dr.gpuMs < dr.targetMs * 0.5f && dr.quality != RenderQuality::HIGH) {
+                stepQuality(dr, 1);
+            }
+        }
+    }
+
+    void BeginDynamicResolutionFrame(DynamicResolution &dr) {
+        dr.timing = dr.enabled && dr.issued - dr.collected < DYNRES_QUERY_FRAMES;
+        if(!dr.timing)
+            return;
+        glQueryCounter(dr.queries[dr.issued % DYNRES_QUERY_FRAMES][0], GL_TIMESTAMP);
+    }
+
+    void EndDynamicResolutionFrame(DynamicResolution &dr) {
+        if(!dr.timing)
+            return;
+        glQueryCounter(dr.queries[dr.issued % DYNRES_QUERY_FRAMES][1], GL_TIMESTAMP);
+        dr.issued++;
+        while(dr.collected < dr.issued) {
+            auto& pair = dr.queries[dr.collected % DYNRES_QUERY_FRAMES];
+            // the end timestamp is written last, when it's there the start is too
+            GLint available = 0;
+            glGetQueryObjectiv(pair[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available)
+                break;
+            GLuint64 start = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(pair[0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(pair[1], GL_QUERY_RESULT, &end);
+            dr.collected++;
+            float ms = (float) ((double) (end - start) / 1e6);
+            dr.gpuMs = dr.gpuMs == 0.0f ? ms : dr.gpuMs + (ms - dr.gpuMs) * 0.25f;
+            adjust(dr);
+        }
+    }
+
+    void GetDynamicResolutionSize(const DynamicResolution &dr, i32 width, i32 height, i32 &scaledWidth, i32 &scaledHeight) {
+        if(!dr.enabled || dr.scale >= 1.0f) {
+            scaledWidth = width;
+            scaledHeight = height;
+            return;
+        }
+        auto scaled = [&dr](i32 size) {
+            i32 steps = (i32) lroundf((float) size * dr.scale / DYNRES_SIZE_STEP);
+            return std::min(size, std::max(1, steps) * DYNRES_SIZE_STEP);
+        };
+        scaledWidth = scaled(width);
+        scaledHeight = scaled(height);
+    }
+}
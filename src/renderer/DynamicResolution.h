@@ -0,0 +1,61 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_DYNAMICRESOLUTION_H
+#define CRAWLER_DYNAMICRESOLUTION_H
+
+#include "defs.h"
+
+// Holds the level pass at a target gpu time by rendering it into part of the level renderer's fbo and
+// upscaling. The pass is timed with a pair of GL_TIMESTAMP queries per frame (they don't collide with the
+// GL_TIME_ELAPSED queries of the gpu profiler), results are read a few frames later once they're available so
+// the cpu never waits on the gpu. The scale drops quickly when over budget and creeps back up when there is
+// headroom. At the minimum scale the quality ladder steps down, at full scale with plenty of headroom it steps
+// back up.
+
+#define DYNRES_QUERY_FRAMES 4
+#define DYNRES_MIN_SCALE 0.5f
+// scaled sizes are rounded to this many pixels so small scale changes don't resize every frame
+#define DYNRES_SIZE_STEP 8
+
+namespace Renderer {
+    enum class RenderQuality {
+        LOW,
+        MEDIUM,
+        HIGH,
+    };
+
+    struct RenderQualitySettings {
+        bool fog;               // only when the renderer has fog turned on
+        i32 modelLights;
+    };
+
+    struct DynamicResolution {
+        bool enabled = false;
+        float targetMs = 1000.0f / 60.0f;
+        float scale = 1.0f;
+        RenderQuality quality = RenderQuality::HIGH;
+        // smoothed gpu time of the timed passes
+        float gpuMs = 0.0f;
+        u32 queries[DYNRES_QUERY_FRAMES][2] = {};
+        u64 issued = 0;
+        u64 collected = 0;
+        // false for frames where every query was still in flight
+        bool timing = false;
+        // measurements lag behind, after a change wait for frames rendered with it
+        i32 settleFrames = 0;
+    };
+
+    const RenderQualitySettings& GetRenderQualitySettings(RenderQuality quality);
+    // GL thread
+    void InitDynamicResolution(DynamicResolution& dr, float targetMs);
+    void ShutdownDynamicResolution(DynamicResolution& dr);
+    // around the commands to time, EndDynamicResolutionFrame also picks up finished timings and adjusts
+    void BeginDynamicResolutionFrame(DynamicResolution& dr);
+    void EndDynamicResolutionFrame(DynamicResolution& dr);
+    // size of the scaled render target for a full size of width x height
+    void GetDynamicResolutionSize(const DynamicResolution& dr, i32 width, i32 height, i32& scaledWidth, i32& scaledHeight);
+}
+
+#endif //CRAWLER_DYNAMICRESOLUTION_H
@@ -5,15 +5,18 @@
 #include <SDL_log.h>
 #include <unordered_map>
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
 #include "Font.h"
+#include "Texture.h"
 #include "../util/string_util.h"
+#include "../util/JobSystem.h"
 
-#define EN 0x01
-#define EN_START 0x00
-#define EN_END   0xFF
-#define KR 0x02
-#define KR_START 0xAC00
-#define KR_END   0xD7A3
+// cells a distance transform treats as infinitely far, finite so the parabola math stays finite
+#define SDF_INF 1e20f
+// glyphs per distance field job
+#define SDF_JOB_GRAIN 8
 
 namespace Renderer {
     FT_Library library;
@@ -30,88 +33,389 @@ namespace Renderer {
         FT_Done_FreeType(library);
     }
 
-    static void loadGlyphs(Font &font, TextureAtlasBuilder& builder, u32 cpStart, u32 cpEnd) {
-        for (u32 cp = cpStart; cp <= cpEnd; cp += 1) {
+    static void resetPage(GlyphPage& page) {
+        page.pixels.assign((size_t) GLYPH_PAGE_SIZE * GLYPH_PAGE_SIZE, 0);
+        page.skyline.clear();
+        page.skyline.push_back(SkylineNode{0, 0, GLYPH_PAGE_SIZE});
+        page.dirtyTop = 0;
+        page.dirtyBottom = GLYPH_PAGE_SIZE;
+    }
 
-            FT_UInt index = FT_Get_Char_Index(font.face, cp);
-            FT_Error err = FT_Load_Glyph(font.face, index, FT_LOAD_DEFAULT | FT_LOAD_RENDER | FT_LOAD_FORCE_AUTOHINT | FT_LOAD_TARGET_LIGHT);
-            if (err) {
-                SDL_Log("Failed to load glyph for codepoint: 0x%x\n", cp);
+    // y a w x h rect would rest at with its left edge at the start of skyline node index, -1 if it doesn't fit
+    static i32 skylineFit(const GlyphPage& page, size_t index, i32 w, i32 h) {
+        if(page.skyline[index].x + w > GLYPH_PAGE_SIZE)
+            return -1;
+        i32 y = 0;
+        for(i32 left = w; left > 0; left -= page.skyline[index++].width) {
+            y = std::max(y, page.skyline[index].y);
+            if(y + h > GLYPH_PAGE_SIZE)
+                return -1;
+        }
+        return y;
+    }
+
+    // bottom left skyline packing, the rect goes where its bottom edge ends up lowest, ties go to the narrower span
+    static bool skylinePack(GlyphPage& page, i32 w, i32 h, i32& x, i32& y) {
+        auto& skyline = page.skyline;
+        size_t best = SIZE_MAX;
+        i32 bestBottom = INT32_MAX;
+        i32 bestWidth = INT32_MAX;
+        for(size_t i = 0; i < skyline.size(); ++i) {
+            i32 top = skylineFit(page, i, w, h);
+            if(top < 0)
                 continue;
+            if(top + h < bestBottom || (top + h == bestBottom && skyline[i].width < bestWidth)) {
+                best = i;
+                bestBottom = top + h;
+                bestWidth = skyline[i].width;
+            }
+        }
+        if(best == SIZE_MAX)
+            return false;
+        x = skyline[best].x;
+        y = bestBottom - h;
+        // the rect's bottom edge becomes a new span, the spans it covers shrink or disappear
+        skyline.insert(skyline.begin() + (i64) best, SkylineNode{x, bestBottom, w});
+        for(size_t i = best + 1; i < skyline.size();) {
+            i32 coveredTo = skyline[i - 1].x + skyline[i - 1].width;
+            if(skyline[i].x >= coveredTo)
+                break;
+            i32 shrink = coveredTo - skyline[i].x;
+            skyline[i].x += shrink;
+            skyline[i].width -= shrink;
+            if(skyline[i].width > 0)
+                break;
+            skyline.erase(skyline.begin() + (i64) i);
+        }
+        for(size_t i = 0; i + 1 < skyline.size();) {
+            if(skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + (i64) i + 1);
+            } else {
+                ++i;
+            }
+        }
+        return true;
+    }
+
+    static void evictPage(Font& font, u32 page) {
+        for(auto it = font.glyphs.begin(); it != font.glyphs.end();) {
+            if(it->second.page == page) {
+                it = font.glyphs.erase(it);
+            } else {
+                ++it;
             }
-            //FT_Glyph_Metrics metrics = font->face->glyph->metrics;
+        }
+        resetPage(font.pages[page]);
+        font.generation++;
+        SDL_Log("Glyph cache full, evicted page %u", page);
+    }
 
-            u32 w = font.face->glyph->bitmap.width;
-            u32 h = font.face->glyph->bitmap.rows;
+    static void placeGlyph(Font& font, Glyph& glyph, const u8* pixels, i32 width, i32 height) {
+        // one empty pixel right and below keeps neighbours apart
+        i32 w = width + 1;
+        i32 h = height + 1;
+        if(w > GLYPH_PAGE_SIZE || h > GLYPH_PAGE_SIZE) {
+            SDL_Log("Glyph %dx%d doesn't fit a glyph page", width, height);
+            return;
+        }
+        i32 x = 0, y = 0;
+        u32 page = GLYPH_NO_PAGE;
+        for(u32 i = 0; i < GLYPH_MAX_PAGES && page == GLYPH_NO_PAGE; ++i) {
+            if(!font.pages[i].pixels.empty() && skylinePack(font.pages[i], w, h, x, y))
+                page = i;
+        }
+        if(page == GLYPH_NO_PAGE) {
+            for(u32 i = 0; i < GLYPH_MAX_PAGES && page == GLYPH_NO_PAGE; ++i) {
+                if(font.pages[i].pixels.empty()) {
+                    resetPage(font.pages[i]);
+                    page = i;
+                }
+            }
+            if(page == GLYPH_NO_PAGE) {
+                page = 0;
+                for(u32 i = 1; i < GLYPH_MAX_PAGES; ++i) {
+                    if(font.pages[i].lastUsed < font.pages[page].lastUsed)
+                        page = i;
+                }
+                evictPage(font, page);
+            }
+            // an empty page takes anything up to its size
+            skylinePack(font.pages[page], w, h, x, y);
+        }
 
-            //SDL_Log("Glyph w,h %d,%d", w, h);
+        auto& p = font.pages[page];
+        for(i32 row = 0; row < height; ++row) {
+            memcpy(&p.pixels[(size_t) (y + row) * GLYPH_PAGE_SIZE + x], pixels + (size_t) row * width, width);
+        }
+        if(p.dirtyTop >= p.dirtyBottom) {
+            p.dirtyTop = y;
+            p.dirtyBottom = y + height;
+        } else {
+            p.dirtyTop = std::min(p.dirtyTop, y);
+            p.dirtyBottom = std::max(p.dirtyBottom, y + height);
+        }
+        auto size = (float) GLYPH_PAGE_SIZE;
+        glyph.page = page;
+        glyph.uv = FloatRect((float) x / size, (float) y / size, (float) (x + width) / size, (float) (y + height) / size);
+    }
 
-            auto pb = PixelBuffer(w, h, PixelFormat::GREYSCALE);
+    // a glyph between FreeType and its page, pixels are tightly packed rows
+    struct GlyphBitmap {
+        u32 cp;
+        Glyph glyph;
+        std::vector<u8> pixels;
+        i32 width;
+        i32 height;
+    };
 
-            u8* pixels = (u8*) pb.pixels;
-            u8* src_buf = font.face->glyph->bitmap.buffer;
+    // needs the face, so one glyph at a time
+    static void loadGlyph(Font& font, u32 cp, GlyphBitmap& bitmap) {
+        bitmap.cp = cp;
+        bitmap.glyph = {GLYPH_NO_PAGE, 0, {0, 0}, {0, 0}, 0, FloatRect(0, 0, 0, 0)};
+        bitmap.pixels.clear();
+        bitmap.width = 0;
+        bitmap.height = 0;
+        FT_UInt index = font.face != nullptr ? FT_Get_Char_Index(font.face, cp) : 0;
+        if(index != 0) {
+            // distance fields are made from the outline as it is, hinting is for one pixel size only
+            FT_Int32 flags = font.sdf ? FT_LOAD_DEFAULT | FT_LOAD_RENDER | FT_LOAD_NO_HINTING
+                                      : FT_LOAD_DEFAULT | FT_LOAD_RENDER | FT_LOAD_FORCE_AUTOHINT | FT_LOAD_TARGET_LIGHT;
+            FT_Error err = FT_Load_Glyph(font.face, index, flags);
+            if (err) {
+                SDL_Log("Failed to load glyph for codepoint: 0x%x\n", cp);
+                index = 0;
+            }
+        }
+        if(index == 0)
+            return;
+        FT_GlyphSlot slot = font.face->glyph;
+        auto& glyph = bitmap.glyph;
+        glyph.index = index;
+        glyph.advance = (u32) (slot->advance.x >> 6);
+        glyph.size[0] = (i32) slot->bitmap.width;
+        glyph.size[1] = (i32) slot->bitmap.rows;
+        glyph.bearing[0] = slot->bitmap_left;
+        glyph.bearing[1] = slot->bitmap_top;
+        bitmap.width = (i32) slot->bitmap.width;
+        bitmap.height = (i32) slot->bitmap.rows;
+        bitmap.pixels.resize((size_t) bitmap.width * bitmap.height);
+        for(i32 row = 0; row < bitmap.height; ++row) {
+            memcpy(&bitmap.pixels[(size_t) row * bitmap.width], slot->bitmap.buffer + (size_t) row * slot->bitmap.pitch,
+                   bitmap.width);
+        }
+    }
 
-            for(u32 y = 0; y < h; ++y) {
-                for(u32 x = 0; x < w; ++x) {
-                    *pixels = src_buf[(y*w)+x];
-                    pixels++;
-                }
-                //pixels += 2;
+    // one dimensional squared distance transform of f into d (Felzenszwalb & Huttenlocher), v and z are scratch
+    // of n and n + 1 entries
+    static void distanceTransform(const float* f, float* d, i32* v, float* z, i32 n) {
+        i32 k = 0;
+        v[0] = 0;
+        z[0] = -SDF_INF;
+        z[1] = SDF_INF;
+        for(i32 q = 1; q < n; ++q) {
+            float s;
+            while(true) {
+                i32 r = v[k];
+                s = ((f[q] + (float) (q * q)) - (f[r] + (float) (r * r))) / (float) (2 * q - 2 * r);
+                if(s > z[k] || k == 0)
+                    break;
+                k--;
             }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = SDF_INF;
+        }
+        k = 0;
+        for(i32 q = 0; q < n; ++q) {
+            while(z[k + 1] < (float) q) {
+                k++;
+            }
+            auto dq = (float) (q - v[k]);
+            d[q] = dq * dq + f[v[k]];
+        }
+    }
 
-            //w+=2;
-            //h+=2;
+    // squared distance from every cell to the nearest 0 cell, columns then rows
+    static void distanceTransform2D(std::vector<float>& grid, i32 w, i32 h) {
+        i32 n = std::max(w, h);
+        std::vector<float> f(n), d(n), z(n + 1);
+        std::vector<i32> v(n);
+        for(i32 x = 0; x < w; ++x) {
+            for(i32 y = 0; y < h; ++y) {
+                f[y] = grid[(size_t) y * w + x];
+            }
+            distanceTransform(f.data(), d.data(), v.data(), z.data(), h);
+            for(i32 y = 0; y < h; ++y) {
+                grid[(size_t) y * w + x] = d[y];
+            }
+        }
+        for(i32 y = 0; y < h; ++y) {
+            float* row = &grid[(size_t) y * w];
+            memcpy(f.data(), row, sizeof(float) * w);
+            distanceTransform(f.data(), row, v.data(), z.data(), w);
+        }
+    }
 
-            //memcpy(pb.pixels, dst_buf, (size_t) w*h);
-            //SDL_Log("Padding: %s", pb.padding ? "true" : "false");
-            u32 atlas_id = builder.add(pb);
-            Glyph ch = {
-                    atlas_id,
-                    (u32) (font.face->glyph->advance.x >> 6),
-            };
-            ch.size[0] = (i32) w;
-            ch.size[1] = (i32) h;
-            ch.bearing[0] = font.face->glyph->bitmap_left;
-            ch.bearing[1] = font.face->glyph->bitmap_top;
-            font.glyphs[cp] = ch;
+    // replaces the coverage bitmap with a signed distance field padded by SDF_SPREAD on every side. 128 is the
+    // outline, every SDF_SPREAD pixels inside or outside moves it by 127. Partly covered pixels are seeded with
+    // their distance to the outline from the coverage, which keeps the edge sub pixel accurate when drawn larger.
+    // Only touches the bitmap, so any thread
+    static void buildDistanceField(GlyphBitmap& bitmap) {
+        if(bitmap.pixels.empty())
+            return;
+        i32 w = bitmap.width + 2 * SDF_SPREAD;
+        i32 h = bitmap.height + 2 * SDF_SPREAD;
+        std::vector<float> toInside((size_t) w * h, SDF_INF), toOutside((size_t) w * h, 0.0f);
+        for(i32 y = 0; y < bitmap.height; ++y) {
+            for(i32 x = 0; x < bitmap.width; ++x) {
+                float coverage = (float) bitmap.pixels[(size_t) y * bitmap.width + x] / 255.0f;
+                size_t i = (size_t) (y + SDF_SPREAD) * w + x + SDF_SPREAD;
+                if(coverage >= 1.0f) {
+                    toInside[i] = 0.0f;
+                    toOutside[i] = SDF_INF;
+                } else if(coverage > 0.0f) {
+                    float in = std::max(0.0f, 0.5f - coverage);
+                    float out = std::max(0.0f, coverage - 0.5f);
+                    toInside[i] = in * in;
+                    toOutside[i] = out * out;
+                }
+            }
+        }
+        distanceTransform2D(toInside, w, h);
+        distanceTransform2D(toOutside, w, h);
+        std::vector<u8> field((size_t) w * h);
+        for(size_t i = 0; i < field.size(); ++i) {
+            float distance = sqrtf(toOutside[i]) - sqrtf(toInside[i]);
+            float value = 128.0f + distance * 127.0f / (float) SDF_SPREAD;
+            field[i] = (u8) std::clamp(value, 0.0f, 255.0f);
         }
+        bitmap.pixels = std::move(field);
+        bitmap.width = w;
+        bitmap.height = h;
+        bitmap.glyph.size[0] = w;
+        bitmap.glyph.size[1] = h;
+        bitmap.glyph.bearing[0] -= SDF_SPREAD;
+        bitmap.glyph.bearing[1] += SDF_SPREAD;
+    }
+
+    static Glyph* insertGlyph(Font& font, GlyphBitmap& bitmap) {
+        if(!bitmap.pixels.empty())
+            placeGlyph(font, bitmap.glyph, bitmap.pixels.data(), bitmap.width, bitmap.height);
+        // codepoints the font doesn't have are remembered too, with index 0
+        return &font.glyphs.emplace(bitmap.cp, bitmap.glyph).first->second;
+    }
+
+    static Glyph* rasterizeGlyph(Font& font, u32 cp) {
+        GlyphBitmap bitmap;
+        loadGlyph(font, cp, bitmap);
+        if(font.sdf)
+            buildDistanceField(bitmap);
+        return insertGlyph(font, bitmap);
     }
 
-    void CreateFont(Font &font, const std::string& path, u32 size) {
+    void CreateFont(Font &font, const std::string& path, u32 size, bool sdf) {
         if (FT_New_Face(library, path.c_str(), 0, &font.face))
             throw std::runtime_error("Could not load font: " + path);
         if (FT_Set_Pixel_Sizes(font.face, 0, size))
             throw std::runtime_error("Could not set pixel size for font face");
         font.size = size;
-        SDL_Log("Creating font size %d", size);
-        auto builder = TextureAtlasBuilder(1024, 1024, PixelFormat::GREYSCALE);
-
-        // atlas = std::make_unique<Renderer::TextureAtlas>(renderDevice, 1024, 1024, Renderer::PixelFormat::GREYSCALE);
-        loadGlyphs(font, builder, EN_START, EN_END);
-        builder.build(font.atlas);
+        font.sdf = sdf;
+        font.kerning = FT_HAS_KERNING(font.face);
+        font.lineHeight = (i32) (font.face->size->metrics.height >> 6);
+        SDL_Log("Creating %sfont size %d", sdf ? "sdf " : "", size);
+        // texture storage is allocated when a page is first uploaded
+        for(auto& page : font.pages) {
+            page.textureId = CreateTexture();
+        }
+        // FreeType is loaded one glyph at a time, the distance fields are spread over the workers
+        std::vector<GlyphBitmap> bitmaps(0x7F - 0x20);
+        for(u32 i = 0; i < bitmaps.size(); ++i) {
+            loadGlyph(font, 0x20 + i, bitmaps[i]);
+        }
+        if(sdf) {
+            ParallelFor((u32) bitmaps.size(), SDF_JOB_GRAIN, [&bitmaps](u32 begin, u32 end) {
+                for(u32 i = begin; i < end; ++i) {
+                    buildDistanceField(bitmaps[i]);
+                }
+            });
+        }
+        for(auto& bitmap : bitmaps) {
+            insertGlyph(font, bitmap);
+        }
     }
 
     void DestroyFont(Font& font) {
         if(font.face != nullptr) {
             FT_Done_Face(font.face);
+            font.face = nullptr;
         }
+        for(auto& page : font.pages) {
+            if(page.textureId != 0)
+                DestroyTexture(page.textureId);
+            page = GlyphPage();
+        }
+        font.glyphs.clear();
     }
 
-    u32 MeasureTextWidth(const Font& font, const std::string& text) {
+    u32 MeasureTextWidth(Font& font, const std::string& text) {
         i32 len = (i32) text.size();
-        u32 x = 0;
+        // kerned like LayoutText and PushText so it matches what's drawn, kerning can pull the pen back
+        i32 x = 0;
+        u32 previous = 0;
         for (int i=0; i < len;) {
             u32 cpLen;
             u32 cp = DecodeCodePoint(&cpLen, &text[i]);
 
-            const Glyph* c = &font.glyphs.at(cp);
-            //assert(c != NULL);
+            const Glyph* c = FindGlyph(font, cp);
             i += (i32) cpLen;
             if(c == nullptr)
                 continue;
 
-            x += c->advance;
+            if(previous != 0)
+                x += GetKerning(font, previous, c->index);
+            previous = c->index;
+            x += (i32) c->advance;
+        }
+        return (u32) std::max(x, 0);
+    }
+
+    const Glyph* FindGlyph(Font& font, u32 cp) {
+        auto it = font.glyphs.find(cp);
+        Glyph* glyph = it != font.glyphs.end() ? &it->second : rasterizeGlyph(font, cp);
+        if(glyph->index == 0)
+            return cp != '?' ? FindGlyph(font, '?') : nullptr;
+        if(glyph->page != GLYPH_NO_PAGE)
+            font.pages[glyph->page].lastUsed = ++font.useTick;
+        return glyph;
+    }
+
+    i32 GetKerning(const Font& font, u32 leftIndex, u32 rightIndex) {
+        if(!font.kerning)
+            return 0;
+        FT_Vector delta;
+        if(FT_Get_Kerning(font.face, leftIndex, rightIndex, FT_KERNING_DEFAULT, &delta) != 0)
+            return 0;
+        return (i32) (delta.x >> 6);
+    }
+
+    void UploadGlyphCache(Font& font) {
+        for(auto& page : font.pages) {
+            if(page.pixels.empty() || page.dirtyTop >= page.dirtyBottom)
+                continue;
+            if(!page.uploaded) {
+                UploadTexture(page.textureId, GLYPH_PAGE_SIZE, GLYPH_PAGE_SIZE, page.pixels.data(),
+                              TextureFormatInternal::R8, TextureFormatData::RED);
+                // distance fields are meant to be interpolated, coverage is drawn texel for pixel
+                SetFilteringTexture(page.textureId, font.sdf ? TextureFiltering::LINEAR : TextureFiltering::NEAREST);
+                page.uploaded = true;
+            } else {
+                UpdateTextureRowsGreyscale(page.textureId, page.dirtyTop, GLYPH_PAGE_SIZE, page.dirtyBottom - page.dirtyTop,
+                                           &page.pixels[(size_t) page.dirtyTop * GLYPH_PAGE_SIZE]);
+            }
+            page.dirtyTop = 0;
+            page.dirtyBottom = 0;
         }
-        return x;
     }
-}
\ No newline at end of file
+}
@@ -8,21 +8,55 @@
 
 #include <defs.h>
 #include <unordered_map>
-#include "TextureAtlas.h"
+#include <vector>
+#include "Vector2.h"
 
 extern "C" {
     #include <ft2build.h>
     #include FT_FREETYPE_H
 };
 
+// Glyphs are rasterized the first time they're looked up and packed into atlas pages with a skyline packer.
+// A font has up to GLYPH_MAX_PAGES pages of GLYPH_PAGE_SIZE squared greyscale pixels, started as they're needed.
+// When every page is full the least recently used page is cleared and all its glyphs are dropped, generation is
+// bumped so anything holding on to glyph uvs (cached text layouts) knows to look them up again. Rasterizing only
+// touches the cpu copy of a page, UploadGlyphCache sends the changed rows to the textures on the GL thread.
+// An sdf font stores signed distance fields instead of coverage, made once at the font's size and drawn at any
+// size (SDF_TEXT commands), so one set of pages serves every text size instead of a font per size.
+
+#define GLYPH_PAGE_SIZE 512
+#define GLYPH_MAX_PAGES 4
+#define GLYPH_NO_PAGE UINT32_MAX
+// pixels of distance stored on each side of the outline in an sdf glyph, the limit for outlines and shadows
+#define SDF_SPREAD 6
+
 namespace Renderer {
     typedef struct                  Glyph Glyph;
 
     struct Glyph {
-        u32                         atlasId;
+        u32                         page;           // GLYPH_NO_PAGE for glyphs without pixels, like space
         u32                         advance;
         i32                         size[2];
         i32                         bearing[2];
+        u32                         index;          // FreeType glyph index, 0 when the font doesn't have it
+        FloatRect                   uv;
+    };
+
+    struct SkylineNode {
+        i32 x;
+        i32 y;
+        i32 width;
+    };
+
+    struct GlyphPage {
+        u32 textureId = 0;
+        std::vector<u8> pixels;                 // empty until the page is started
+        std::vector<SkylineNode> skyline;       // top of the packed area, spans left to right
+        u64 lastUsed = 0;
+        // rows changed since the last upload, none when dirtyTop >= dirtyBottom
+        i32 dirtyTop = 0;
+        i32 dirtyBottom = 0;
+        bool uploaded = false;                  // texture storage allocated
     };
 
     typedef struct                  FT_FaceRec_* FT_Face;
@@ -30,15 +64,30 @@ namespace Renderer {
     struct Font {
         FT_Face face;
         u32 size;
-        TextureAtlas atlas;
         std::unordered_map<u32, Glyph> glyphs;
+        GlyphPage pages[GLYPH_MAX_PAGES];
+        u64 useTick = 0;
+        u32 generation = 0;
+        bool kerning = false;
+        i32 lineHeight = 0;
+        bool sdf = false;
     };
 
     void InitFonts();
     void ShutdownFonts();
-    void CreateFont(Font& font, const std::string& path, u32 size);
+    // printable ascii is rasterized up front. With sdf, size is the size the distance fields are made at,
+    // 32 to 64 holds up well from small text to headlines
+    void CreateFont(Font& font, const std::string& path, u32 size, bool sdf = false);
     void DestroyFont(Font& font);
-    u32 MeasureTextWidth(const Font& font, const std::string& text);
+    u32 MeasureTextWidth(Font& font, const std::string& text);
+    // glyph for cp, rasterized if it's the first use, '?' when the font doesn't have it, nullptr if it has neither.
+    // The pointer is only good until the next lookup, which may evict it
+    const Glyph* FindGlyph(Font& font, u32 cp);
+    // horizontal adjustment in pixels between two glyphs (by FreeType index), 0 when the font has no kerning
+    i32 GetKerning(const Font& font, u32 leftIndex, u32 rightIndex);
+    // GL thread, uploads pages changed since the last call. Call it before drawing text pushed since then, the
+    // pushes and the upload must not run at the same time
+    void UploadGlyphCache(Font& font);
 }
 
 
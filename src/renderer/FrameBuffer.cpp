@@ -34,4 +34,32 @@ namespace Renderer {
     void UnbindFrameBuffer() {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
+
+    u32 AttachDepthBuffer(u32 frameBufferId, i32 width, i32 height) {
+        u32 id;
+        glGenRenderbuffers(1, &id);
+        glBindRenderbuffer(GL_RENDERBUFFER, id);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBufferId);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, id);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("FBO depth attachment could not be completed!!");
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return id;
+    }
+
+    void DestroyDepthBuffer(u32 depthBufferId) {
+        glDeleteRenderbuffers(1, &depthBufferId);
+    }
+
+    void ReadFrameBuffer(u32 frameBufferId, PixelBuffer& pixelBuffer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBufferId);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, (i32) pixelBuffer.width, (i32) pixelBuffer.height, GL_RGBA, GL_UNSIGNED_BYTE, pixelBuffer.pixels);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // gl rows start at the bottom
+        pixelBuffer.verticalFlip();
+    }
 } // Renderer
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include "defs.h"
 #include "Texture.h"
+#include "PixelBuffer.h"
 #include <memory>
 
 namespace Renderer {
@@ -14,6 +15,11 @@ namespace Renderer {
     void DestroyFrameBuffer(u32 frameBufferId);
     void BindFrameBuffer(u32 frameBufferId);
     void UnbindFrameBuffer();
+    // adds a 24 bit depth attachment to the frame buffer, returns the render buffer id
+    u32 AttachDepthBuffer(u32 frameBufferId, i32 width, i32 height);
+    void DestroyDepthBuffer(u32 depthBufferId);
+    // reads the color attachment into an RGBA pixel buffer of the same size, top row first
+    void ReadFrameBuffer(u32 frameBufferId, PixelBuffer& pixelBuffer);
 } // Renderer
 
 #endif //PLATFORMER_FRAMEBUFFER_H
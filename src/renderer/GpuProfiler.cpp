@@ -0,0 +1,80 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <vector>
+#include <SDL_timer.h>
+#include "GpuProfiler.h"
+
+extern "C" {
+#include "glad.h"
+}
+
+namespace Renderer {
+    struct GpuQuery {
+        u32 id;
+        const char* name;
+        u64 frame;
+        u64 cpuStart;
+    };
+
+    static struct {
+        std::vector<u32> freeQueries;
+        std::vector<GpuQuery> pending;  // in submission order
+        GpuQuery current;
+        bool active = false;
+    } gpuProfiler;
+
+    GpuProfileScope::GpuProfileScope(const char *name) : active(false) {
+        if(!IsProfilerEnabled() || gpuProfiler.active)
+            return;
+        u32 query;
+        if(gpuProfiler.freeQueries.empty()) {
+            glGenQueries(1, &query);
+        } else {
+            query = gpuProfiler.freeQueries.back();
+            gpuProfiler.freeQueries.pop_back();
+        }
+        gpuProfiler.current = GpuQuery{query, name, GetProfilerFrameIndex(), SDL_GetPerformanceCounter()};
+        gpuProfiler.active = true;
+        active = true;
+        glBeginQuery(GL_TIME_ELAPSED, query);
+    }
+
+    GpuProfileScope::~GpuProfileScope() {
+        if(!active)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuProfiler.pending.push_back(gpuProfiler.current);
+        gpuProfiler.active = false;
+    }
+
+    void CollectGpuProfileZones() {
+        static double ticksPerNs = (double) SDL_GetPerformanceFrequency() / 1e9;
+        size_t done = 0;
+        for(auto& query : gpuProfiler.pending) {
+            // queries finish in order, stop at the first that isn't ready so we never stall on the gpu
+            GLint available = 0;
+            glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available)
+                break;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &ns);
+            AddProfilerGpuZone(query.frame, query.name, query.cpuStart, query.cpuStart + (u64) ((double) ns * ticksPerNs));
+            gpuProfiler.freeQueries.push_back(query.id);
+            done++;
+        }
+        gpuProfiler.pending.erase(gpuProfiler.pending.begin(), gpuProfiler.pending.begin() + (i64) done);
+    }
+
+    void ShutdownGpuProfiler() {
+        for(auto& query : gpuProfiler.pending) {
+            gpuProfiler.freeQueries.push_back(query.id);
+        }
+        gpuProfiler.pending.clear();
+        if(!gpuProfiler.freeQueries.empty()) {
+            glDeleteQueries((GLsizei) gpuProfiler.freeQueries.size(), gpuProfiler.freeQueries.data());
+        }
+        gpuProfiler.freeQueries.clear();
+    }
+}
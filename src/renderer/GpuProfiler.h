@@ -0,0 +1,30 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_GPUPROFILER_H
+#define CRAWLER_GPUPROFILER_H
+
+#include "defs.h"
+#include "../util/Profiler.h"
+
+namespace Renderer {
+    // Times a block of GL commands with a GL_TIME_ELAPSED query. Only one such query can be active so nested
+    // gpu scopes are ignored. The result is placed at the cpu time the commands were submitted.
+    class GpuProfileScope {
+    public:
+        explicit GpuProfileScope(const char* name);
+        ~GpuProfileScope();
+
+    private:
+        bool active;
+    };
+
+    // call once per frame on the GL thread, hands finished queries to the profiler
+    void CollectGpuProfileZones();
+    void ShutdownGpuProfiler();
+}
+
+#define PROFILE_GPU_SCOPE(name) Renderer::GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+
+#endif //CRAWLER_GPUPROFILER_H
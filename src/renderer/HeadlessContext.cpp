@@ -0,0 +1,113 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <SDL_log.h>
+#include "HeadlessContext.h"
+
+#ifdef CRAWLER_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+extern "C" {
+#include "glad.h"
+}
+
+namespace Renderer {
+    static struct {
+        EGLDisplay display = EGL_NO_DISPLAY;
+        EGLContext context = EGL_NO_CONTEXT;
+    } headless;
+
+    static EGLDisplay getDisplay() {
+        // prefer the mesa surfaceless platform, it doesn't need a gpu or a display server
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(getPlatformDisplay) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if(display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    bool InitHeadlessContext() {
+        headless.display = getDisplay();
+        EGLint major, minor;
+        if(headless.display == EGL_NO_DISPLAY || !eglInitialize(headless.display, &major, &minor)) {
+            SDL_Log("Could not initialize EGL display: 0x%x", eglGetError());
+            return false;
+        }
+        if(!eglBindAPI(EGL_OPENGL_API)) {
+            SDL_Log("EGL does not support desktop OpenGL: 0x%x", eglGetError());
+            ShutdownHeadlessContext();
+            return false;
+        }
+        const EGLint configAttrs[] = {
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_NONE
+        };
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        eglChooseConfig(headless.display, configAttrs, &config, 1, &configCount);
+        const EGLint contextAttrs[] = {
+                EGL_CONTEXT_MAJOR_VERSION, 3,
+                EGL_CONTEXT_MINOR_VERSION, 3,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+        };
+        // surfaceless displays may not have any configs, a context without one is fine since we never create a surface
+        headless.context = eglCreateContext(headless.display, configCount > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttrs);
+        if(headless.context == EGL_NO_CONTEXT) {
+            SDL_Log("Could not create EGL context: 0x%x", eglGetError());
+            ShutdownHeadlessContext();
+            return false;
+        }
+        if(!eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, headless.context)) {
+            SDL_Log("Could not make EGL context current: 0x%x", eglGetError());
+            ShutdownHeadlessContext();
+            return false;
+        }
+        gladLoadGLLoader((GLADloadproc) eglGetProcAddress);
+
+        SDL_Log("EGL:             %d.%d %s\n", major, minor, eglQueryString(headless.display, EGL_VENDOR));
+        SDL_Log("Vendor:          %s\n", glGetString(GL_VENDOR));
+        SDL_Log("Renderer:        %s\n", glGetString(GL_RENDERER));
+        SDL_Log("Version OpenGL:  %s\n", glGetString(GL_VERSION));
+        return true;
+    }
+
+    bool MakeHeadlessContextCurrent(bool current) {
+        if(!eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, current ? headless.context : EGL_NO_CONTEXT)) {
+            SDL_Log("Could not %s EGL context: 0x%x", current ? "make current" : "release", eglGetError());
+            return false;
+        }
+        return true;
+    }
+
+    void ShutdownHeadlessContext() {
+        if(headless.display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(headless.context != EGL_NO_CONTEXT)
+            eglDestroyContext(headless.display, headless.context);
+        eglTerminate(headless.display);
+        headless.context = EGL_NO_CONTEXT;
+        headless.display = EGL_NO_DISPLAY;
+    }
+}
+#else
+namespace Renderer {
+    bool InitHeadlessContext() {
+        SDL_Log("Built without EGL, headless mode is not available");
+        return false;
+    }
+
+    bool MakeHeadlessContextCurrent(bool current) {
+        return false;
+    }
+
+    void ShutdownHeadlessContext() {
+    }
+}
+#endif
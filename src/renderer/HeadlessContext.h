@@ -0,0 +1,20 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_HEADLESSCONTEXT_H
+#define CRAWLER_HEADLESSCONTEXT_H
+
+#include "defs.h"
+
+namespace Renderer {
+    // GL 3.3 core context without a window, through a surfaceless EGL display. Rendering has to go into a
+    // framebuffer object since there is no default framebuffer. Only available when built with EGL
+    // (CRAWLER_HEADLESS), otherwise InitHeadlessContext fails.
+    bool InitHeadlessContext();
+    // binds the context to the calling thread or releases it, it can only be current on one thread at a time
+    bool MakeHeadlessContextCurrent(bool current);
+    void ShutdownHeadlessContext();
+}
+
+#endif //CRAWLER_HEADLESSCONTEXT_H
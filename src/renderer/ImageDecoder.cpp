@@ -0,0 +1,396 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <zlib.h>
+#include "ImageDecoder.h"
+#include "PixelBuffer.h"
+
+namespace Renderer {
+    namespace {
+        const u8 PNG_SIGNATURE[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+        inline u32 readU32BE(const u8* p) {
+            return ((u32) p[0] << 24) | ((u32) p[1] << 16) | ((u32) p[2] << 8) | (u32) p[3];
+        }
+
+        // frees the pixels of a pixelbuffer a decode failed halfway through, leaving it empty
+        void release(PixelBuffer& pb) {
+            if(pb.pixels)
+                free(pb.pixels);
+            pb.pixels = nullptr;
+            pb.width = 0;
+            pb.height = 0;
+        }
+
+        // allocate the pixelbuffer, with room for a 1 pixel border when padding, false when out of memory
+        bool allocate(PixelBuffer& pb, u32 width, u32 height, bool pad, std::string& error) {
+            release(pb);
+            u32 border = pad ? 2 : 0;
+            void* pixels = malloc(((size_t) width + border) * ((size_t) height + border) * sizeof(u32));
+            if(!pixels) {
+                error = "out of memory";
+                return false;
+            }
+            pb.width = width + border;
+            pb.height = height + border;
+            pb.pixelFormat = PixelFormat::RGBA;
+            pb.padding = pad;
+            pb.pixels = pixels;
+            return true;
+        }
+
+        // destination of image row y, skipping the border column when padding
+        inline u32* rowPtr(PixelBuffer& pb, u32 y) {
+            if(pb.padding)
+                return (u32*) pb.pixels + (size_t) (y + 1) * pb.width + 1;
+            return (u32*) pb.pixels + (size_t) y * pb.width;
+        }
+
+        inline void extendRowEdges(PixelBuffer& pb, u32 y) {
+            u32* row = (u32*) pb.pixels + (size_t) (y + 1) * pb.width;
+            row[0] = row[1];
+            row[pb.width - 1] = row[pb.width - 2];
+        }
+
+        // top and bottom border rows are copies of the first and last image rows, corners included
+        void finishPadding(PixelBuffer& pb) {
+            u32* pixels = (u32*) pb.pixels;
+            size_t rowBytes = pb.width * sizeof(u32);
+            memcpy(pixels, pixels + pb.width, rowBytes);
+            memcpy(pixels + (size_t) (pb.height - 1) * pb.width, pixels + (size_t) (pb.height - 2) * pb.width, rowBytes);
+        }
+
+        class LodePngDecoder : public ImageDecoder {
+        public:
+            const char* name() const override { return "lodepng"; }
+
+            bool decode(PixelBuffer& pb, const u8* data, size_t size, bool pad, std::string& error) override {
+                u8* image = nullptr;
+                u32 w, h;
+                unsigned err = lodepng_decode32(&image, &w, &h, data, size);
+                if(err) {
+                    error = lodepng_error_text(err);
+                    free(image);
+                    return false;
+                }
+                if(!pad || w == 0 || h == 0) {
+                    if(pb.pixels)
+                        free(pb.pixels);
+                    pb.width = w;
+                    pb.height = h;
+                    pb.pixelFormat = PixelFormat::RGBA;
+                    pb.padding = false;
+                    pb.pixels = image;
+                    return true;
+                }
+                if(!allocate(pb, w, h, true, error)) {
+                    free(image);
+                    return false;
+                }
+                for(u32 y = 0; y < h; ++y) {
+                    memcpy(rowPtr(pb, y), image + (size_t) y * w * 4, (size_t) w * 4);
+                    extendRowEdges(pb, y);
+                }
+                finishPadding(pb);
+                free(image);
+                return true;
+            }
+        };
+
+        struct PngHeader {
+            u32 width;
+            u32 height;
+            u8 bitDepth;
+            u8 colorType;
+            u8 interlace;
+        };
+
+        class FastPngDecoder : public ImageDecoder {
+        public:
+            const char* name() const override { return "zlib"; }
+
+            bool decode(PixelBuffer& pb, const u8* data, size_t size, bool pad, std::string& error) override {
+                if(size < 8 + 25 || memcmp(data, PNG_SIGNATURE, 8) != 0) {
+                    error = "not a png file";
+                    return false;
+                }
+                // IHDR is always the first chunk
+                const u8* ihdr = data + 8;
+                if(readU32BE(ihdr) != 13 || memcmp(ihdr + 4, "IHDR", 4) != 0) {
+                    error = "missing IHDR chunk";
+                    return false;
+                }
+                PngHeader header{};
+                header.width = readU32BE(ihdr + 8);
+                header.height = readU32BE(ihdr + 12);
+                header.bitDepth = ihdr[16];
+                header.colorType = ihdr[17];
+                header.interlace = ihdr[20];
+
+                if(!isSupported(header))
+                    return GetLodePngDecoder().decode(pb, data, size, pad, error);
+                return decodeRows(pb, header, data, size, pad, error);
+            }
+
+        private:
+            static bool isSupported(const PngHeader& h) {
+                if(h.interlace != 0 || h.width == 0 || h.height == 0)
+                    return false;
+                switch(h.colorType) {
+                    case 0:
+                    case 3:
+                        return h.bitDepth == 1 || h.bitDepth == 2 || h.bitDepth == 4 || h.bitDepth == 8;
+                    case 2:
+                    case 4:
+                    case 6:
+                        return h.bitDepth == 8;
+                    default:
+                        return false;
+                }
+            }
+
+            static u32 channels(u8 colorType) {
+                switch(colorType) {
+                    case 2: return 3;
+                    case 4: return 2;
+                    case 6: return 4;
+                    default: return 1;
+                }
+            }
+
+            static inline u8 paeth(u8 a, u8 b, u8 c) {
+                i32 p = (i32) a + (i32) b - (i32) c;
+                i32 pa = std::abs(p - (i32) a);
+                i32 pb = std::abs(p - (i32) b);
+                i32 pc = std::abs(p - (i32) c);
+                if(pa <= pb && pa <= pc)
+                    return a;
+                return pb <= pc ? b : c;
+            }
+
+            static bool unfilter(u8* row, const u8* prev, size_t rowBytes, u32 bpp) {
+                u8 type = row[0];
+                u8* cur = row + 1;
+                switch(type) {
+                    case 0:
+                        break;
+                    case 1:
+                        for(size_t i = bpp; i < rowBytes; ++i)
+                            cur[i] = (u8) (cur[i] + cur[i - bpp]);
+                        break;
+                    case 2:
+                        for(size_t i = 0; i < rowBytes; ++i)
+                            cur[i] = (u8) (cur[i] + prev[i]);
+                        break;
+                    case 3:
+                        for(size_t i = 0; i < bpp; ++i)
+                            cur[i] = (u8) (cur[i] + (prev[i] >> 1));
+                        for(size_t i = bpp; i < rowBytes; ++i)
+                            cur[i] = (u8) (cur[i] + (((u32) cur[i - bpp] + (u32) prev[i]) >> 1));
+                        break;
+                    case 4:
+                        for(size_t i = 0; i < bpp; ++i)
+                            cur[i] = (u8) (cur[i] + prev[i]);
+                        for(size_t i = bpp; i < rowBytes; ++i)
+                            cur[i] = (u8) (cur[i] + paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+                        break;
+                    default:
+                        return false;
+                }
+                return true;
+            }
+
+            struct Palette {
+                u32 colors[256];
+                u32 count;
+                bool hasKey;
+                u16 key[3];
+            };
+
+            static void convertRow(u32* dst, const u8* src, const PngHeader& h, const Palette& palette) {
+                u32 w = h.width;
+                switch(h.colorType) {
+                    case 6:
+                        memcpy(dst, src, (size_t) w * 4);
+                        break;
+                    case 2:
+                        for(u32 x = 0; x < w; ++x, src += 3) {
+                            u32 a = 255;
+                            if(palette.hasKey && src[0] == palette.key[0] && src[1] == palette.key[1] && src[2] == palette.key[2])
+                                a = 0;
+                            dst[x] = (u32) src[0] | ((u32) src[1] << 8) | ((u32) src[2] << 16) | (a << 24);
+                        }
+                        break;
+                    case 4:
+                        for(u32 x = 0; x < w; ++x, src += 2)
+                            dst[x] = (u32) src[0] * 0x010101u | ((u32) src[1] << 24);
+                        break;
+                    case 0:
+                    case 3: {
+                        u32 depth = h.bitDepth;
+                        u32 mask = (1u << depth) - 1;
+                        u32 perByte = 8 / depth;
+                        for(u32 x = 0; x < w; ++x) {
+                            u32 shift = 8 - depth * (x % perByte + 1);
+                            u32 v = (src[x / perByte] >> shift) & mask;
+                            if(h.colorType == 3) {
+                                dst[x] = v < palette.count ? palette.colors[v] : 0xFF000000u;
+                            } else {
+                                u32 a = (palette.hasKey && v == palette.key[0]) ? 0 : 255;
+                                u32 grey = v * 255 / mask;
+                                dst[x] = grey * 0x010101u | (a << 24);
+                            }
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+
+            // IDAT chunks are inflated straight into a two row window and converted row by row into the pixelbuffer
+            static bool decodeRows(PixelBuffer& pb, const PngHeader& h, const u8* data, size_t size, bool pad, std::string& error) {
+                u32 bitsPerPixel = channels(h.colorType) * h.bitDepth;
+                u32 bpp = std::max(1u, bitsPerPixel / 8);
+                size_t rowBytes = ((size_t) h.width * bitsPerPixel + 7) / 8;
+                std::vector<u8> rows(2 * (rowBytes + 1), 0);
+                std::vector<u8> zeroRow(rowBytes, 0);
+                u8* cur = rows.data();
+                u8* prev = rows.data() + rowBytes + 1;
+                bool first = true;
+
+                Palette palette{};
+                z_stream stream{};
+                if(inflateInit(&stream) != Z_OK) {
+                    error = "inflateInit failed";
+                    return false;
+                }
+                if(!allocate(pb, h.width, h.height, pad, error)) {
+                    inflateEnd(&stream);
+                    return false;
+                }
+
+                u32 y = 0;
+                size_t offset = 8;
+                bool ok = true;
+                bool done = false;
+                stream.next_out = cur;
+                stream.avail_out = (uInt) (rowBytes + 1);
+                while(ok && !done && offset + 12 <= size) {
+                    u32 length = readU32BE(data + offset);
+                    const u8* type = data + offset + 4;
+                    const u8* chunk = data + offset + 8;
+                    if(length > size - offset - 12) {
+                        error = "truncated chunk";
+                        ok = false;
+                        break;
+                    }
+                    if(memcmp(type, "PLTE", 4) == 0) {
+                        palette.count = std::min(256u, length / 3);
+                        for(u32 i = 0; i < palette.count; ++i)
+                            palette.colors[i] = (u32) chunk[i * 3] | ((u32) chunk[i * 3 + 1] << 8) | ((u32) chunk[i * 3 + 2] << 16) | 0xFF000000u;
+                    } else if(memcmp(type, "tRNS", 4) == 0) {
+                        if(h.colorType == 3) {
+                            for(u32 i = 0; i < length && i < palette.count; ++i)
+                                palette.colors[i] = (palette.colors[i] & 0x00FFFFFFu) | ((u32) chunk[i] << 24);
+                        } else if(h.colorType == 0 && length >= 2) {
+                            palette.hasKey = true;
+                            palette.key[0] = (u16) ((chunk[0] << 8) | chunk[1]);
+                        } else if(h.colorType == 2 && length >= 6) {
+                            palette.hasKey = true;
+                            for(u32 i = 0; i < 3; ++i)
+                                palette.key[i] = (u16) ((chunk[i * 2] << 8) | chunk[i * 2 + 1]);
+                        }
+                    } else if(memcmp(type, "IDAT", 4) == 0) {
+                        stream.next_in = (Bytef*) chunk;
+                        stream.avail_in = length;
+                        while(stream.avail_in > 0 && !done) {
+                            int ret = inflate(&stream, Z_NO_FLUSH);
+                            if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                                error = stream.msg ? stream.msg : "inflate failed";
+                                ok = false;
+                                break;
+                            }
+                            if(stream.avail_out == 0) {
+                                if(!unfilter(cur, first ? zeroRow.data() : prev + 1, rowBytes, bpp)) {
+                                    error = "invalid filter type";
+                                    ok = false;
+                                    break;
+                                }
+                                convertRow(rowPtr(pb, y), cur + 1, h, palette);
+                                if(pad)
+                                    extendRowEdges(pb, y);
+                                first = false;
+                                std::swap(cur, prev);
+                                stream.next_out = cur;
+                                stream.avail_out = (uInt) (rowBytes + 1);
+                                if(++y == h.height)
+                                    done = true;
+                            } else if(ret == Z_STREAM_END || ret == Z_BUF_ERROR) {
+                                break;
+                            }
+                        }
+                    } else if(memcmp(type, "IEND", 4) == 0) {
+                        break;
+                    }
+                    offset += 12 + (size_t) length;
+                }
+                inflateEnd(&stream);
+
+                if(ok && y != h.height) {
+                    error = "not enough image data";
+                    ok = false;
+                }
+                if(!ok) {
+                    release(pb);
+                    return false;
+                }
+                if(pad)
+                    finishPadding(pb);
+                return true;
+            }
+        };
+
+        LodePngDecoder lodePngDecoder;
+        FastPngDecoder fastPngDecoder;
+        ImageDecoder* currentDecoder = &fastPngDecoder;
+    }
+
+    ImageDecoder& GetLodePngDecoder() {
+        return lodePngDecoder;
+    }
+
+    ImageDecoder& GetFastPngDecoder() {
+        return fastPngDecoder;
+    }
+
+    ImageDecoder& GetImageDecoder() {
+        return *currentDecoder;
+    }
+
+    void SetImageDecoder(ImageDecoder& decoder) {
+        currentDecoder = &decoder;
+    }
+
+    bool ReadFileBytes(const std::string& filename, std::vector<u8>& bytes) {
+        FILE* f = fopen(filename.c_str(), "rb");
+        if(!f)
+            return false;
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        if(size < 0) {
+            fclose(f);
+            return false;
+        }
+        bytes.resize((size_t) size);
+        bool ok = fread(bytes.data(), 1, bytes.size(), f) == bytes.size();
+        fclose(f);
+        return ok;
+    }
+}
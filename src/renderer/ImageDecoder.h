@@ -0,0 +1,37 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_IMAGEDECODER_H
+#define CRAWLER_IMAGEDECODER_H
+
+#include <string>
+#include <vector>
+#include "defs.h"
+
+namespace Renderer {
+    struct PixelBuffer;
+
+    // Decodes an image file in memory into an RGBA pixelbuffer. With pad the image gets a 1 pixel
+    // border duplicating its edges, written while the rows are copied.
+    class ImageDecoder {
+    public:
+        virtual ~ImageDecoder() = default;
+        virtual const char* name() const = 0;
+        // returns false and fills error if the data could not be decoded
+        virtual bool decode(PixelBuffer& pb, const u8* data, size_t size, bool pad, std::string& error) = 0;
+    };
+
+    // the reference decoder, slow but handles every png
+    ImageDecoder& GetLodePngDecoder();
+    // zlib inflate with row streaming, falls back to lodepng for 16 bit and interlaced images
+    ImageDecoder& GetFastPngDecoder();
+
+    // the decoder used when loading pixelbuffers from files
+    ImageDecoder& GetImageDecoder();
+    void SetImageDecoder(ImageDecoder& decoder);
+
+    bool ReadFileBytes(const std::string& filename, std::vector<u8>& bytes);
+}
+
+#endif //CRAWLER_IMAGEDECODER_H
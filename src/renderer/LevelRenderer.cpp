@@ -3,11 +3,14 @@
 //
 
 #include <SDL_log.h>
+#include <SDL_timer.h>
 #include <algorithm>
+#include <cstring>
 #include "LevelRenderer.h"
 #include "glm/ext.hpp"
 #include <glm/gtx/rotate_vector.hpp>
 #include "Viewport.h"
+#include "GpuProfiler.h"
 
 extern "C" {
 #include "glad.h"
@@ -21,8 +24,40 @@ namespace Renderer {
         const std::string proj = "projection";
     } ShaderUniforms;
 
+    // the model shader's Lights[] uniform names, built once so the frame loop doesn't format strings
+    #define MAX_MODEL_LIGHTS 7
+    struct LightUniformNames {
+        std::string position;
+        std::string ambient;
+        std::string diffuse;
+        std::string constant;
+        std::string linear;
+        std::string quadratic;
+        std::string enabled;
+    };
+    static LightUniformNames LightUniforms[MAX_MODEL_LIGHTS];
+
+    static void setupLightUniforms(ShaderProgram& shader) {
+        for(i32 i = 0; i < MAX_MODEL_LIGHTS; ++i) {
+            auto& names = LightUniforms[i];
+            std::string prefix = "Lights[" + std::to_string(i) + "].";
+            names.position = prefix + "position";
+            names.ambient = prefix + "ambient";
+            names.diffuse = prefix + "diffuse";
+            names.constant = prefix + "constant";
+            names.linear = prefix + "linear";
+            names.quadratic = prefix + "quadratic";
+            names.enabled = prefix + "enabled";
+            for(auto name : {&names.position, &names.ambient, &names.diffuse, &names.constant, &names.linear, &names.quadratic, &names.enabled}) {
+                shader.setupUniform(*name);
+            }
+        }
+    }
+
     void InitLevelRenderer(LevelRenderer &r) {
         r.camera = std::make_unique<Camera>(glm::vec3(0.0f, 0.0f, 0.0f));
+        r.viewCamera = std::make_unique<Camera>(glm::vec3(0.0f, 0.0f, 0.0f));
+        r.previousCameraPose = r.camera->GetPose();
         r.geometryShader = std::make_unique<ShaderProgram>("shaders/geometry_vertex.glsl",
                                                            "shaders/geometry_fragment.glsl");
         r.geometryShader->setupUniform(ShaderUniforms.model);
@@ -34,15 +69,24 @@ namespace Renderer {
 
         r.modelShader = std::make_unique<ShaderProgram>("shaders/model_vertex.glsl",
                                                          "shaders/model_fragment.glsl");
+        setupLightUniforms(*r.modelShader);
 
-        // fbo for later use
+        // offscreen target at the screen resolution
         auto vp = GetViewport();
-        auto width = (i32) vp.screenWidth;
-        auto height = (i32) vp.screenHeight;
+        r.fboWidth = (i32) vp.screenWidth;
+        r.fboHeight = (i32) vp.screenHeight;
         r.fboTexture = CreateTexture();
         SetFilteringTexture(r.fboTexture, TextureFiltering::LINEAR);
-        UploadTexture(r.fboTexture, width, height, nullptr, TextureFormatInternal::RGBA8, TextureFormatData::RGBA);
-        r.fbo = CreateFrameBuffer(r.fboTexture, TextureFormatInternal::RGBA8, TextureFormatData::RGBA, width, height);
+        UploadTexture(r.fboTexture, r.fboWidth, r.fboHeight, nullptr, TextureFormatInternal::RGBA8, TextureFormatData::RGBA);
+        r.fbo = CreateFrameBuffer(r.fboTexture, TextureFormatInternal::RGBA8, TextureFormatData::RGBA, r.fboWidth, r.fboHeight);
+        r.fboDepthBuffer = AttachDepthBuffer(r.fbo, r.fboWidth, r.fboHeight);
+
+        // upscales the part of fbo in use when the resolution is dynamic
+        r.screenShader = std::make_unique<ShaderProgram>("shaders/screen_vertex.glsl", "shaders/screen_fragment.glsl");
+        VertexAttributes screenAttrs;
+        screenAttrs.add(0, 2, VertexAttributeType::Float); // position
+        screenAttrs.add(1, 2, VertexAttributeType::Float); // tex coords
+        r.screenVbo = std::make_unique<VertexBuffer>(screenAttrs);
 
         // geometry texture atlas
         auto builder = Renderer::TextureAtlasBuilder(2048, 2048, Renderer::PixelFormat::RGBA);
@@ -78,12 +122,15 @@ namespace Renderer {
     }
 
     void ShutdownLevelRenderer(LevelRenderer &renderer) {
+        ShutdownDynamicResolution(renderer.resolution);
         DestroyTextureAtlas(renderer.geometryTextureAtlas);
         DestroyTextureAtlas(renderer.spriteTextureAtlas);
         DestroyFrameBuffer(renderer.fbo);
+        DestroyDepthBuffer(renderer.fboDepthBuffer);
+        DestroyTexture(renderer.fboTexture);
     }
 
-    static void renderModel(LevelRenderer &r, RenderBatch& batch) {
+    static void renderModel(LevelRenderer &r, const RenderBatch& batch) {
         float halfSize = CUBE_SIZE / 2.0f;
         glm::mat4 model = glm::mat4(1.0f);
         // set world pos
@@ -132,22 +179,96 @@ namespace Renderer {
         glActiveTexture(GL_TEXTURE0);
         BindTexture(m.textureId);
         m.vbo->bind();
-        if(batch.modelObjName == "*") {
+        if(strcmp(batch.modelObjName, "*") == 0) {
             glDrawArrays(GL_TRIANGLES, 0, (i32) m.vertices.size());
         }
         else {
-            const auto& obj = m.objects[batch.modelObjName];
-            glDrawArrays(GL_TRIANGLES, (i32) obj.offset, (i32) obj.count);
+            // models have a handful of objects, a scan avoids building a std::string key every batch
+            for(const auto& [name, obj] : m.objects) {
+                if(name == batch.modelObjName) {
+                    glDrawArrays(GL_TRIANGLES, (i32) obj.offset, (i32) obj.count);
+                    break;
+                }
+            }
         }
         m.vbo->unbind();
         UnbindTexture();
     }
 
-    void RenderLevel(LevelRenderer &r, float delta) {
-        static float accDelta = 0.0f;
-        accDelta += delta/4.0f;
+    void SetLevelFrameCamera(LevelRenderer &r, LevelFrame &frame) {
+        // pitch the camera down a bit
+        float pitch = 4.0f;
+        r.viewCamera->Pitch -= pitch;
+        r.viewCamera->updateCameraVectors();
+        frame.view = r.viewCamera->GetViewMatrix();
+        r.viewCamera->Pitch += pitch;
+        r.viewCamera->updateCameraVectors();
+        // move the camera back a bit and up
+        frame.view = glm::translate(frame.view, r.viewCamera->Front * 1.25f);
+        frame.view = glm::translate(frame.view, -r.viewCamera->Up * 0.25f);
+
+        auto viewPort = GetViewport();
+        frame.projection = glm::perspective(glm::radians(65.0f), (float) viewPort.screenWidth / (float) viewPort.screenHeight, 0.5f, 100.0f);
+        //projection = glm::perspective(glm::radians(75.0f), (float) 1920 / (float) 1080, 0.1f, 100.0f);
+        frame.viewport = viewPort.current;
+        frame.cameraPosition = r.viewCamera->Position;
+        frame.cameraRight = r.viewCamera->Right;
+        frame.cameraUp = r.viewCamera->Up;
+    }
+
+    // draws the scaledWidth x scaledHeight corner of fbo over the viewport
+    static void presentScaled(LevelRenderer &r, const LevelFrame& frame, i32 scaledWidth, i32 scaledHeight) {
+        if(scaledWidth != r.screenVboWidth || scaledHeight != r.screenVboHeight) {
+            // half a texel in from every edge so linear filtering doesn't pull in pixels outside the scaled area
+            float u0 = 0.5f / (float) r.fboWidth;
+            float v0 = 0.5f / (float) r.fboHeight;
+            float u1 = ((float) scaledWidth - 0.5f) / (float) r.fboWidth;
+            float v1 = ((float) scaledHeight - 0.5f) / (float) r.fboHeight;
+            const float quad[] = {
+                    -1.0f, 1.0f, u0, v1,
+                    -1.0f, -1.0f, u0, v0,
+                    1.0f, -1.0f, u1, v0,
+
+                    -1.0f, 1.0f, u0, v1,
+                    1.0f, -1.0f, u1, v0,
+                    1.0f, 1.0f, u1, v1
+            };
+            r.screenVbo->allocate(quad, sizeof(quad), VertexAccessType::STATIC);
+            r.screenVboWidth = scaledWidth;
+            r.screenVboHeight = scaledHeight;
+        }
+        glViewport(frame.viewport.x, frame.viewport.y, frame.viewport.w, frame.viewport.h);
+        glDisable(GL_DEPTH_TEST);
+        r.screenShader->use();
+        r.screenShader->setInt("screenTexture", 0);
+        glActiveTexture(GL_TEXTURE0);
+        BindTexture(r.fboTexture);
+        r.screenVbo->bind();
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        r.screenVbo->unbind();
+        UnbindTexture();
+    }
 
-        //BindFrameBuffer(r.fbo);
+    void RenderLevel(LevelRenderer &r, const LevelFrame& frame) {
+        PROFILE_SCOPE("RenderLevel");
+        PROFILE_GPU_SCOPE("RenderLevel");
+
+        BeginDynamicResolutionFrame(r.resolution);
+        bool scaled = r.resolution.enabled && !r.renderToFbo;
+        i32 scaledWidth = r.fboWidth;
+        i32 scaledHeight = r.fboHeight;
+        if(r.renderToFbo) {
+            BindFrameBuffer(r.fbo);
+            glViewport(0, 0, r.fboWidth, r.fboHeight);
+        } else if(scaled) {
+            GetDynamicResolutionSize(r.resolution, r.fboWidth, r.fboHeight, scaledWidth, scaledHeight);
+            BindFrameBuffer(r.fbo);
+            glViewport(0, 0, scaledWidth, scaledHeight);
+        } else {
+            glViewport(frame.viewport.x, frame.viewport.y, frame.viewport.w, frame.viewport.h);
+        }
+        auto& quality = GetRenderQualitySettings(r.resolution.quality);
+        i32 fogEnabled = r.fogEnabled && quality.fog ? 1 : 0;
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glEnable(GL_DEPTH_TEST);
@@ -155,37 +276,18 @@ namespace Renderer {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         // create transformations
         glm::mat4 model         = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        glm::mat4 view          = glm::mat4(1.0f);
-        glm::mat4 projection    = glm::mat4(1.0f);
-
-        // little trick with the model matrix
-        //model = glm::translate(glm::mat4(1.0f), r.camera->Front * -2.5f);
-        //model = glm::rotate(model, accDelta, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        // pitch the camera down a bit
-        float pitch = 4.0f;
-        r.camera->Pitch -= pitch;
-        r.camera->updateCameraVectors();
-        view = r.camera->GetViewMatrix();
-        r.camera->Pitch += pitch;
-        r.camera->updateCameraVectors();
-        // move the camera back a bit and up
-        view = glm::translate(view, r.camera->Front * 1.25f);
-        view = glm::translate(view, -r.camera->Up * 0.25f);
-
-        auto viewPort = GetViewport();
-        projection = glm::perspective(glm::radians(65.0f), (float) viewPort.screenWidth / (float) viewPort.screenHeight, 0.5f, 100.0f);
-        //projection = glm::perspective(glm::radians(75.0f), (float) 1920 / (float) 1080, 0.1f, 100.0f);
+        const glm::mat4& view = frame.view;
+        const glm::mat4& projection = frame.projection;
 
         // Setup geometry shader
         r.geometryShader->use();
         r.geometryShader->setUniform(ShaderUniforms.model, model);
         r.geometryShader->setUniform(ShaderUniforms.view, view);
         r.geometryShader->setUniform(ShaderUniforms.proj, projection);
-        r.geometryShader->setVec3("CameraPos", r.camera->Position);
+        r.geometryShader->setVec3("CameraPos", frame.cameraPosition);
         r.geometryShader->setFloat("FogDensity", 0.10f);
         r.geometryShader->setVec3("FogColor", glm::vec3(0.005f, 0.005f, 0.005f));
-        r.geometryShader->setInt("FogEnabled", 0);
+        r.geometryShader->setInt("FogEnabled", fogEnabled);
         r.geometryShader->setInt("texture1", 0);
 
         // Setup sprite shader
@@ -193,12 +295,12 @@ namespace Renderer {
         r.spriteShader->setMat4("model", model);
         r.spriteShader->setMat4("view", view);
         r.spriteShader->setMat4("projection", projection);
-        r.spriteShader->setVec3("CameraPos", r.camera->Position);
-        r.spriteShader->setVec3("CameraRight", r.camera->Right);
-        r.spriteShader->setVec3("CameraUp", r.camera->Up);
+        r.spriteShader->setVec3("CameraPos", frame.cameraPosition);
+        r.spriteShader->setVec3("CameraRight", frame.cameraRight);
+        r.spriteShader->setVec3("CameraUp", frame.cameraUp);
         r.spriteShader->setFloat("FogDensity", 0.10f);
         r.spriteShader->setVec3("FogColor", glm::vec3(0.005f, 0.005f, 0.005f));
-        r.spriteShader->setInt("FogEnabled", 0);
+        r.spriteShader->setInt("FogEnabled", fogEnabled);
         r.spriteShader->setInt("texture1", 0);
 
         // Setup model shader
@@ -206,14 +308,31 @@ namespace Renderer {
         r.modelShader->setMat4("model", model);
         r.modelShader->setMat4("view", view);
         r.modelShader->setMat4("projection", projection);
-        r.modelShader->setVec3("CameraPos", r.camera->Position);
+        r.modelShader->setVec3("CameraPos", frame.cameraPosition);
         r.modelShader->setFloat("FogDensity", 0.10f);
         r.modelShader->setVec3("FogColor", glm::vec3(0.005f, 0.005f, 0.005f));
-        r.modelShader->setInt("FogEnabled", 0);
+        r.modelShader->setInt("FogEnabled", fogEnabled);
         r.modelShader->setInt("texture1", 0);
+        // the lights are the same for every model batch, lower quality levels light with fewer of them
+        i32 lightCount = std::min((i32) frame.lights.size(), std::min(quality.modelLights, MAX_MODEL_LIGHTS));
+        for(i32 i = 0; i < lightCount; ++i) {
+            auto& names = LightUniforms[i];
+            auto& light = frame.lights[i];
+            r.modelShader->setUniform(names.position, light.position);
+            r.modelShader->setUniform(names.ambient, glm::vec3(0.025f, 0.025f, 0.025f));
+            r.modelShader->setUniform(names.diffuse, light.diffuse);
+            // 1.0	0.22	0.20
+            r.modelShader->setUniform(names.constant, 1.0f);
+            r.modelShader->setUniform(names.linear, 0.22f);
+            r.modelShader->setUniform(names.quadratic, 0.20f);
+            r.modelShader->setUniform(names.enabled, 1);
+        }
+        for(i32 i = lightCount; i < MAX_MODEL_LIGHTS; ++i) {
+            r.modelShader->setUniform(LightUniforms[i].enabled, 0);
+        }
 
         // render batches
-        for(auto &batch : r.batches) {
+        for(auto &batch : frame.batches) {
             switch(batch.type) {
                 case BatchType::GEOMETRY: {
                     glEnable(GL_DEPTH_TEST);
@@ -253,58 +372,79 @@ namespace Renderer {
                     glDepthMask(GL_TRUE); // Enable depth buffer writing
                     r.modelShader->use();
                     r.modelShader->setVec3("LightColor", batch.lightColor);
-                    i32 lightIndex = 0;
-                    for(auto &light : r.lights) {
-                        std::string lightIndexStr = std::to_string(lightIndex);
-                        std::string lightPosStr = "Lights[" + lightIndexStr + "].position";
-                        r.modelShader->setVec3(lightPosStr, light.position);
-                        std::string lightAmbientStr = "Lights[" + lightIndexStr + "].ambient";
-                        r.modelShader->setVec3(lightAmbientStr, glm::vec3(0.025f, 0.025f, 0.025f));
-                        std::string lightDiffuseStr = "Lights[" + lightIndexStr + "].diffuse";
-                        r.modelShader->setVec3(lightDiffuseStr, light.diffuse);
-
-                        // 1.0	0.22	0.20
-                        std::string constantStr = "Lights[" + lightIndexStr + "].constant";
-                        r.modelShader->setFloat(constantStr, 1.0f);
-                        std::string linearStr = "Lights[" + lightIndexStr + "].linear";
-                        r.modelShader->setFloat(linearStr, 0.22f);
-                        std::string quadraticStr = "Lights[" + lightIndexStr + "].quadratic";
-                        r.modelShader->setFloat(quadraticStr, 0.20f);
-
-                        std::string lightEnabledStr = "Lights[" + lightIndexStr + "].enabled";
-                        r.modelShader->setInt(lightEnabledStr, 1);
-                        lightIndex++;
-                        if(lightIndex >= 7) {
-                            break;
-                        }
-                    }
                     //r.modelShader->setVec3("Lights[0].position", glm::vec3(4.0f * CUBE_SIZE - 1.5f, 1.5f, 6.0f * CUBE_SIZE));
                     renderModel(r, batch);
                     break;
                 }
             }
         }
-        //SDL_Log("Rendered %d batches", (i32) r.batches.size());
+        //SDL_Log("Rendered %d batches", (i32) frame.batches.size());
+        if(r.renderToFbo) {
+            UnbindFrameBuffer();
+        } else if(scaled) {
+            UnbindFrameBuffer();
+            presentScaled(r, frame, scaledWidth, scaledHeight);
+        }
+        EndDynamicResolutionFrame(r.resolution);
 
         /*
         glActiveTexture(GL_TEXTURE0);
         BindTexture(r.geometryTextureAtlas.textureId);
         r.geometryVbo->bind();
-        glDrawArrays(GL_TRIANGLES, 0, (i32) r.geometryMesh.size());
+        glDrawArrays(GL_TRIANGLES, 0, (i32) frame.geometryMesh.size());
         r.geometryVbo->unbind();
         UnbindTexture();
         */
     }
 
-    void UploadLevelMesh(LevelRenderer &r) {
-        r.geometryVbo->allocate(r.geometryMesh.data(), r.geometryMesh.size() * 8 * sizeof(float), VertexAccessType::STATIC);
-        r.spriteVbo->allocate(r.spriteMesh.data(), r.spriteMesh.size() * 8 * sizeof(float), VertexAccessType::STATIC);
+    void UploadLevelMesh(LevelRenderer &r, const LevelFrame& frame) {
+        PROFILE_SCOPE("UploadLevelMesh");
+        r.geometryVbo->allocate(frame.geometryMesh.data(), frame.geometryMesh.size() * 8 * sizeof(float), VertexAccessType::STATIC);
+        r.spriteVbo->allocate(frame.spriteMesh.data(), frame.spriteMesh.size() * 8 * sizeof(float), VertexAccessType::STATIC);
     }
 
     void UpdateLevelRenderer(LevelRenderer &r, float delta) {
         r.camera->Update(delta);
     }
 
+    static bool endsWith(const std::string& str, const std::string& suffix) {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    bool ReloadLevelRendererFile(LevelRenderer &r, const std::string &filename) {
+        u64 startTime = SDL_GetPerformanceCounter();
+        bool handled = false;
+        if(endsWith(filename, ".glsl")) {
+            for(auto shader : {r.geometryShader.get(), r.spriteShader.get(), r.modelShader.get(), r.screenShader.get()}) {
+                if(shader->usesFile(filename)) {
+                    shader->reload();
+                    handled = true;
+                }
+            }
+        } else if(endsWith(filename, ".png") || endsWith(filename, ".dds")) {
+            handled |= ReloadAtlasRegion(r.geometryTextureAtlas, filename);
+            handled |= ReloadAtlasRegion(r.spriteTextureAtlas, filename);
+            for(auto& model : r.models) {
+                if(ModelUsesTexture(model, filename)) {
+                    ReloadModelTexture(model);
+                    handled = true;
+                }
+            }
+        } else if(endsWith(filename, ".obj")) {
+            for(auto& model : r.models) {
+                if(model.objFile == filename) {
+                    ReloadModelMesh(model);
+                    handled = true;
+                }
+            }
+        }
+        if(handled) {
+            double ms = (double) (SDL_GetPerformanceCounter() - startTime) * 1000.0 / (double) SDL_GetPerformanceFrequency();
+            SDL_Log("Reloaded %s in %.2f ms", filename.c_str(), ms);
+        }
+        return handled;
+    }
+
     u32 LoadModel(LevelRenderer &r, const std::string &filename, const std::string &textureFile) {
         Model model;
         LoadModel(model, filename, textureFile);
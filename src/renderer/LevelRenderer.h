@@ -12,6 +12,10 @@
 #include "TextureAtlas.h"
 #include "Camera.h"
 #include "Model.h"
+#include "RenderThread.h"
+#include "DynamicResolution.h"
+#include "Viewport.h"
+#include "../util/FrameArena.h"
 
 #define CUBE_SIZE 3.0f
 
@@ -53,27 +57,54 @@ namespace Renderer {
         u32 modelIndex;
         float modelScale;
         CubeSide modelAlignSide;
-        std::string modelObjName;
+        const char* modelObjName;   // string literal, "*" draws the whole model
         glm::vec3 lightColor;
         glm::vec3 transform;
         glm::vec3 rotation;
     };
 
+    // Everything RenderLevel needs for one frame. UpdateLevel builds it on the game thread, after that it is only
+    // read by the render thread until the slot comes around again, see RenderThread.h. The vectors live in the
+    // frame arena.
+    struct LevelFrame {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec3 cameraPosition;
+        glm::vec3 cameraRight;
+        glm::vec3 cameraUp;
+        SDL_Rect viewport;      // window area to draw into, the fbo is always drawn whole
+        std::pmr::vector<MeshVertex> geometryMesh;
+        std::pmr::vector<MeshVertex> spriteMesh;
+        std::pmr::vector<RenderBatch> batches;
+        std::pmr::vector<Light> lights;
+    };
+
     struct LevelRenderer {
         std::unique_ptr<ShaderProgram> geometryShader;
         std::unique_ptr<VertexBuffer> geometryVbo;
         TextureAtlas geometryTextureAtlas;
-        std::vector<MeshVertex> geometryMesh;
 
         std::unique_ptr<ShaderProgram> spriteShader;
         std::unique_ptr<VertexBuffer> spriteVbo;
         TextureAtlas spriteTextureAtlas;
-        std::vector<MeshVertex> spriteMesh;
 
         std::unique_ptr<ShaderProgram> modelShader;
 
+        // RenderLevel draws into fbo instead of the default framebuffer when renderToFbo is set (headless mode)
         u32 fbo;
         u32 fboTexture;
+        u32 fboDepthBuffer;
+        i32 fboWidth;
+        i32 fboHeight;
+        bool renderToFbo = false;
+        // with dynamic resolution on (windowed only) the level is drawn into the lower left of fbo at the current
+        // scale and upscaled into the viewport with screenShader
+        DynamicResolution resolution;
+        std::unique_ptr<ShaderProgram> screenShader;
+        std::unique_ptr<VertexBuffer> screenVbo;
+        i32 screenVboWidth = 0;     // scaled size the quad's texture coordinates were made for
+        i32 screenVboHeight = 0;
+        bool fogEnabled = false;    // also needs the quality ladder's current level to allow it
         u32 wallTexture;
         u32 wallEndTexture;
         u32 ceilingTexture;
@@ -81,19 +112,27 @@ namespace Renderer {
         u32 drainTexture;
         u32 doorTexture;
 
-        std::vector<RenderBatch> batches;
+        LevelFrame frames[RENDER_PACKET_SLOTS];
+        // camera is moved by the fixed step simulation, viewCamera is what gets depth sorted and drawn, a blend
+        // of previousCameraPose (start of the last tick) and camera set by UpdateLevel
         std::unique_ptr<Camera> camera;
+        std::unique_ptr<Camera> viewCamera;
+        CameraPose previousCameraPose{};
         std::vector<Model> models;
-        std::vector<Light> lights;
         u32 doorModelIndex;
     };
 
     void InitLevelRenderer(LevelRenderer& r);
     void UpdateLevelRenderer(LevelRenderer& r, float delta);
     void ShutdownLevelRenderer(LevelRenderer& renderer);
-    void RenderLevel(LevelRenderer& r, float delta);
-    void UploadLevelMesh(LevelRenderer &r);
+    // fills in the matrices and viewport of frame from viewCamera
+    void SetLevelFrameCamera(LevelRenderer& r, LevelFrame& frame);
+    // render thread
+    void RenderLevel(LevelRenderer& r, const LevelFrame& frame);
+    void UploadLevelMesh(LevelRenderer &r, const LevelFrame& frame);
     u32 LoadModel(LevelRenderer &r, const std::string &filename, const std::string &textureFile);
+    // reloads whatever uses the changed file in place, returns false if nothing did
+    bool ReloadLevelRendererFile(LevelRenderer &r, const std::string &filename);
 }
 
 #endif //CRAWLER_LEVELRENDERER_H
@@ -3,6 +3,7 @@
 //
 
 #include <iostream>
+#include <stdexcept>
 #include <SDL_log.h>
 #include "Model.h"
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -92,8 +93,8 @@ namespace Renderer {
         }
     }
 
-    void LoadModel(Model &model, const std::string &filename, const std::string &textureFile) {
-        model.vertices.clear();
+    static bool parseObj(const std::string &filename, std::vector<ModelVertex>& vertices,
+                         std::unordered_map<std::string, ModelObject>& objects) {
         reader_config.mtl_search_path = "./assets/models"; // Path to material files
         tinyobj::ObjReader reader;
 
@@ -101,7 +102,7 @@ namespace Renderer {
             if (!reader.Error().empty()) {
                 std::cerr << "TinyObjReader: " << reader.Error();
             }
-            exit(1);
+            return false;
         }
 
         if (!reader.Warning().empty()) {
@@ -122,7 +123,7 @@ namespace Renderer {
         for (size_t s = 0; s < shapes.size(); s++) {
             ModelObject modelObject;
             modelObject.name = shapes[s].name;
-            modelObject.offset = model.vertices.size();
+            modelObject.offset = vertices.size();
             SDL_Log("Shape: %s", shapes[s].name.c_str());
             // Loop over faces(polygon)
             size_t index_offset = 0;
@@ -164,20 +165,20 @@ namespace Renderer {
                     // tinyobj::real_t red   = attrib.colors[3*size_t(idx.vertex_index)+0];
                     // tinyobj::real_t green = attrib.colors[3*size_t(idx.vertex_index)+1];
                     // tinyobj::real_t blue  = attrib.colors[3*size_t(idx.vertex_index)+2];
-                    model.vertices.emplace_back(modelVertex);
+                    vertices.emplace_back(modelVertex);
                 }
                 index_offset += fv;
-                modelObject.count = model.vertices.size() - modelObject.offset;
-                model.objects[shapes[s].name] = modelObject;
+                modelObject.count = vertices.size() - modelObject.offset;
+                objects[shapes[s].name] = modelObject;
             }
         }
-        SDL_Log("Number of vertices in model: %zu", model.vertices.size());
+        SDL_Log("Number of vertices in model: %zu", vertices.size());
         // calculate normals
         /*
-        for (size_t i = 0; i < model.vertices.size(); i += 3) {
-            auto& v1 = model.vertices[i];
-            auto& v2 = model.vertices[i + 1];
-            auto& v3 = model.vertices[i + 2];
+        for (size_t i = 0; i < vertices.size(); i += 3) {
+            auto& v1 = vertices[i];
+            auto& v2 = vertices[i + 1];
+            auto& v3 = vertices[i + 2];
             glm::vec3 normal = calculateNormal(v1, v2, v3);
             v1.normal[0] = normal.x;
             v1.normal[1] = normal.y;
@@ -189,17 +190,28 @@ namespace Renderer {
             v3.normal[1] = normal.y;
             v3.normal[2] = normal.z;
         }
-        smoothNormals(model.vertices);
+        smoothNormals(vertices);
          */
 
-        SDL_Log("Calculated normals for %zu vertices", model.vertices.size());
+        SDL_Log("Calculated normals for %zu vertices", vertices.size());
 
-        model.textureId = CreateTexture();
-        LoadTextureFromPng(model.textureId, textureFile, false);
-        SetFilteringTexture(model.textureId, TextureFiltering::NEAREST);
-        GenerateTextureMipmaps(model.textureId);
+        return true;
+    }
+
+    static void loadModelTexture(Model &model) {
+        // prefer a baked block compressed version of the texture if there is one
+        auto ddsFile = FindCompressedVariant(model.textureFile);
+        if(!ddsFile.empty()) {
+            LoadTextureFromDDS(model.textureId, ddsFile);
+            SetFilteringTexture(model.textureId, TextureFiltering::NEAREST);
+        } else {
+            LoadTextureFromPng(model.textureId, model.textureFile, false);
+            SetFilteringTexture(model.textureId, TextureFiltering::NEAREST);
+            GenerateTextureMipmaps(model.textureId);
+        }
+    }
 
-        // vbo
+    static void uploadModelMesh(Model &model) {
         VertexAttributes attrs;
         attrs.add(0, 3, VertexAttributeType::Float); // position
         attrs.add(1, 2, VertexAttributeType::Float); // tex coords
@@ -208,6 +220,50 @@ namespace Renderer {
         model.vbo->allocate(model.vertices.data(), model.vertices.size() * sizeof(ModelVertex), VertexAccessType::STATIC);
     }
 
+    void LoadModel(Model &model, const std::string &filename, const std::string &textureFile) {
+        model.vertices.clear();
+        model.objects.clear();
+        model.objFile = filename;
+        model.textureFile = textureFile;
+        if(!parseObj(filename, model.vertices, model.objects)) {
+            exit(1);
+        }
+        model.textureId = CreateTexture();
+        loadModelTexture(model);
+        uploadModelMesh(model);
+    }
+
+    bool ReloadModelMesh(Model &model) {
+        std::vector<ModelVertex> vertices;
+        std::unordered_map<std::string, ModelObject> objects;
+        // keep the old mesh if the file is half written or broken
+        if(!parseObj(model.objFile, vertices, objects)) {
+            SDL_Log("Reloading %s failed, keeping the old mesh", model.objFile.c_str());
+            return false;
+        }
+        model.vertices = std::move(vertices);
+        model.objects = std::move(objects);
+        uploadModelMesh(model);
+        return true;
+    }
+
+    bool ReloadModelTexture(Model &model) {
+        try {
+            loadModelTexture(model);
+        } catch(std::runtime_error& e) {
+            SDL_Log("Reloading %s failed (%s), keeping the old texture", model.textureFile.c_str(), e.what());
+            return false;
+        }
+        return true;
+    }
+
+    bool ModelUsesTexture(const Model &model, const std::string &filename) {
+        if(filename == model.textureFile)
+            return true;
+        auto dot = model.textureFile.find_last_of('.');
+        return dot != std::string::npos && filename == model.textureFile.substr(0, dot) + ".dds";
+    }
+
     void DestroyModel(Model &model) {
         DestroyTexture(model.textureId);
     }
@@ -6,6 +6,7 @@
 #define CRAWLER_MODEL_H
 
 #include <vector>
+#include <string>
 #include <memory>
 #include <unordered_map>
 #include "defs.h"
@@ -29,9 +30,16 @@ namespace Renderer {
         std::vector<ModelVertex> vertices;
         std::unordered_map<std::string, ModelObject> objects;
         u32 textureId;
+        std::string objFile;
+        std::string textureFile;
     };
 
     void LoadModel(Model &model, const std::string &filename, const std::string &textureFile);
+    // hot reload, on failure the current mesh or texture is kept and false returned
+    bool ReloadModelMesh(Model &model);
+    bool ReloadModelTexture(Model &model);
+    // true for the texture file and its baked .dds variant
+    bool ModelUsesTexture(const Model &model, const std::string &filename);
     void DestroyModel(Model &model);
 }
 #endif //CRAWLER_MODEL_H
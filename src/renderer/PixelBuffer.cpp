@@ -5,7 +5,10 @@
 #include <SDL_log.h>
 #include <assert.h>
 #include <stdexcept>
+#include <algorithm>
+#include <vector>
 #include "PixelBuffer.h"
+#include "ImageDecoder.h"
 
 namespace Renderer {
 
@@ -22,16 +25,6 @@ namespace Renderer {
             return v;
         }
 
-        inline u32 getPixelWrapAround(PixelBuffer* buf, u32 x, u32 y)
-        {
-            if(x < 0)
-                x += buf->width;
-            if(y < 0)
-                y += buf->height;
-            u32 *data = (u32*) buf->pixels;
-            return data[((y % buf->height)*buf->width)+(x % buf->width)];
-        }
-
         void RGBA_SimpleBlit(const PixelBuffer &src, const UIntRect &src_rect,
                              PixelBuffer &dst, const UIntPos &dst_pos)
         {
@@ -82,53 +75,20 @@ namespace Renderer {
             pixels = calloc(1, width * height);
     }
 
-    PixelBuffer::PixelBuffer(const std::string filename, bool pad) : padding(pad) {
-        unsigned error;
-        if(!pad) {
-            error = lodepng_decode32_file((u8 **) &pixels, &width, &height, filename.c_str());
-            pixelFormat = PixelFormat::RGBA;
-
-            if (error) {
-                SDL_Log("error %u: %s\n", error, lodepng_error_text(error));
-                throw std::runtime_error("Could not load image " + filename);
-            }
-        } else {
-            PixelBuffer orig(0, 0, PixelFormat::RGBA);
-            error = lodepng_decode32_file((u8**) &orig.pixels, &orig.width, &orig.height, filename.c_str());
-            if (error) {
-                SDL_Log("error %u: %s\n", error, lodepng_error_text(error));
-                throw std::runtime_error("Could not load image " + filename);
-            }
-            width = orig.width+2;
-            height = orig.height+2;
-            pixelFormat = orig.pixelFormat;
-            pixels = calloc(1, width * height * sizeof(u32));
-
-            copyFrom(orig, UIntRect(0, 0, orig.width, orig.height), UIntPos(1,1));
-            // blit the four times to duplicate texture edges, this helps avoiding texture bleeding
-            // (supersampling fetching undefined texels) when using textureatlas
-
-
-            // left side
-            copyFrom(orig, UIntRect(0, 0, 1, orig.height), UIntPos(0, 1));
-            // right side
-            copyFrom(orig, UIntRect(orig.width-1, 0, 1, orig.height), UIntPos(width-1, 1));
-            // top side
-            copyFrom(orig, UIntRect(0, 0, orig.width, 1), UIntPos(1, 0));
-            // bottom side
-            copyFrom(orig, UIntRect(0, orig.height-1, orig.width, 1), UIntPos(1, height-1));
-
-            // TODO using memcpy for 1 pixel is overkill, replace with direct 4 byte assignment on calculated buffer indexes
-            // top left corner
-            copyFrom(orig, UIntRect(0, 0, 1, 1), UIntPos(0, 0));
-            // top right corner
-            copyFrom(orig, UIntRect(orig.width-1, 0, 1, 1), UIntPos(width-1, 0));
-
-            // bottom left corner
-            copyFrom(orig, UIntRect(0, orig.height-1, 1, 1), UIntPos(0, height-1));
-
-            // bottom right corner
-            copyFrom(orig, UIntRect(orig.width-1, orig.height-1, 1, 1), UIntPos(width-1, height-1));
+    PixelBuffer::PixelBuffer(const std::string filename, bool pad) : width(0), height(0),
+        pixelFormat(PixelFormat::RGBA), padding(pad), pixels(nullptr) {
+        std::vector<u8> bytes;
+        if(!ReadFileBytes(filename, bytes)) {
+            throw std::runtime_error("Could not read image " + filename);
+        }
+        // padding (duplicated texture edges, avoids bleeding when sampling from an atlas) is written by the decoder
+        std::string error;
+        if(!GetImageDecoder().decode(*this, bytes.data(), bytes.size(), pad, error)) {
+            SDL_Log("error: %s\n", error.c_str());
+            // the destructor doesn't run for a constructor that throws
+            free(pixels);
+            pixels = nullptr;
+            throw std::runtime_error("Could not load image " + filename);
         }
     }
 
@@ -176,7 +136,13 @@ namespace Renderer {
     }
 
     bool PixelBuffer::saveToPNG(std::string filename) {
-        return false;
+        LodePNGColorType colorType = pixelFormat == PixelFormat::GREYSCALE ? LCT_GREY : LCT_RGBA;
+        u32 error = lodepng_encode_file(filename.c_str(), (const u8*) pixels, width, height, colorType, 8);
+        if(error) {
+            SDL_Log("Could not save %s: %s", filename.c_str(), lodepng_error_text(error));
+            return false;
+        }
+        return true;
     }
 
     void PixelBuffer::preMultiplyAlpha() {
@@ -193,53 +159,32 @@ namespace Renderer {
     }
 
     UIntRect PixelBuffer::getTrimmedSize() {
-        u32 left = 0, right = width-1, top = 0, bottom = height-2;
-
-        // right
-        for(u32 x = 0; x < width; x++) {
-            for(u32 y = 0; y < height; ++y) {
-                u8 alpha = ALPHA(getPixelWrapAround(this, x, y));
-                if(alpha > 0) {
-                    right = x;
-                    break;
-                }
-            }
-        }
-
-        // left
-        for(i32 x = width-1; x >= 0; --x) {
-
-            for(u32 y = 0; y < height; ++y) {
-                u8 alpha = ALPHA(getPixelWrapAround(this, (u32) x, y));
-                if(alpha > 0) {
-                    left = (u32) x;
-                    break;
-                }
-            }
-        }
-
-        // bottom
-        for(u32 y = 0; y < height; ++y) {
-            for (u32 x = 0; x < width; x++) {
-                u8 alpha = ALPHA(getPixelWrapAround(this, x, y));
-                if (alpha > 0) {
-                    bottom = y;
-                    break;
-                }
-            }
-        }
+        if(padding)
+            return getTrimmedSize(UIntRect(1, 1, width - 2, height - 2));
+        return getTrimmedSize(UIntRect(0, 0, width, height));
+    }
 
-        // top
-        for(i32 y = height-1; y >= 0; --y) {
-            for (u32 x = 0; x < width; x++) {
-                u8 alpha = ALPHA(getPixelWrapAround(this, x, (u32) y));
-                if (alpha > 0) {
-                    top = (u32) y;
-                    break;
+    UIntRect PixelBuffer::getTrimmedSize(const UIntRect &rect) const {
+        assert(pixelFormat == PixelFormat::RGBA);
+        u32 left = rect.w, right = 0, top = rect.h, bottom = 0;
+        bool found = false;
+        const u32 *data = (const u32*) pixels;
+        for(u32 y = 0; y < rect.h; ++y) {
+            const u32 *row = &data[(rect.y + y) * width + rect.x];
+            for(u32 x = 0; x < rect.w; ++x) {
+                if(ALPHA(row[x]) > 0) {
+                    left = std::min(left, x);
+                    right = std::max(right, x);
+                    top = std::min(top, y);
+                    bottom = std::max(bottom, y);
+                    found = true;
                 }
             }
         }
-        return UIntRect(left-1, top-1, right-left+1, bottom-top+1);
+        // fully transparent, treat the whole rect as used
+        if(!found)
+            return UIntRect(0, 0, rect.w, rect.h);
+        return UIntRect(left, top, right - left + 1, bottom - top + 1);
     }
 
     PixelBuffer::PixelBuffer(const PixelBuffer &other) {
@@ -257,6 +202,29 @@ namespace Renderer {
         }
     }
 
+    PixelBuffer::PixelBuffer(PixelBuffer &&other) noexcept : width(other.width), height(other.height),
+        pixelFormat(other.pixelFormat), padding(other.padding), pixels(other.pixels) {
+        other.pixels = nullptr;
+        other.width = 0;
+        other.height = 0;
+    }
+
+    PixelBuffer &PixelBuffer::operator=(PixelBuffer &&other) noexcept {
+        if(this != &other) {
+            if(pixels)
+                free(pixels);
+            width = other.width;
+            height = other.height;
+            pixelFormat = other.pixelFormat;
+            padding = other.padding;
+            pixels = other.pixels;
+            other.pixels = nullptr;
+            other.width = 0;
+            other.height = 0;
+        }
+        return *this;
+    }
+
     void PixelBuffer::verticalFlip() {
         u32 *data = (u32*) pixels;
         u32 *temp = (u32*) calloc(1, width * height * sizeof(u32));
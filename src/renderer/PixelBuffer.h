@@ -38,6 +38,9 @@ namespace Renderer {
         ~PixelBuffer();
 
         PixelBuffer(const PixelBuffer& other);
+        PixelBuffer(PixelBuffer&& other) noexcept;
+        PixelBuffer& operator=(PixelBuffer&& other) noexcept;
+        PixelBuffer& operator=(const PixelBuffer& other) = delete;
 
         void copyFrom(const PixelBuffer& src, const UIntRect& src_rect, const UIntPos& dst_pos);
         void upscaleNPOT();
@@ -45,6 +48,8 @@ namespace Renderer {
         void preMultiplyAlpha();
         void verticalFlip();
         UIntRect getTrimmedSize();
+        // bounds of the non transparent pixels inside rect, relative to rect
+        UIntRect getTrimmedSize(const UIntRect& rect) const;
     };
 
 }
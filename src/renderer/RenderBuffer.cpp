@@ -6,6 +6,11 @@
 #include "../util/string_util.h"
 #include <SDL_log.h>
 #include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
 
 extern "C" {
 #include "glad.h"
@@ -13,32 +18,63 @@ extern "C" {
 
 
 namespace Renderer {
-    namespace {
-        const size_t FLOATS_PER_VERTEX = 8;
-        const size_t VERTS_PER_QUAD = 6;
+    static_assert(RENDER_COMMAND_ALIGN % sizeof(void*) == 0, "posix_memalign needs a multiple of the pointer size");
+
+    // malloc only promises max_align_t, which is 8 bytes on some platforms, the command structs want
+    // RENDER_COMMAND_ALIGN. nullptr when out of memory, freed with free()
+    static u8* allocCommands(size_t size) {
+        void* commands = nullptr;
+        if(posix_memalign(&commands, RENDER_COMMAND_ALIGN, size) != 0)
+            return nullptr;
+        return static_cast<u8 *>(commands);
     }
 
     void CreateRenderBuffer(RenderBuffer &buffer, size_t size) {
-        buffer.commands = static_cast<uint8_t *>(calloc(1, size));
+        buffer.commands = allocCommands(size);
+        if(buffer.commands == nullptr)
+            throw std::runtime_error("Could not allocate render command stream");
         buffer.size = size;
-        buffer.cmdOffset = buffer.commands;
+        buffer.cmdOffset = 0;
         buffer.cmdCount = 0;
-        buffer.lastCmdOffset = nullptr;
+        buffer.lastCmd = nullptr;
     }
 
     void DestroyRenderBuffer(RenderBuffer &buffer) {
         free(buffer.commands);
         buffer.commands = nullptr;
         buffer.size = 0;
-        buffer.cmdOffset = nullptr;
+        buffer.cmdOffset = 0;
+        buffer.lastCmd = nullptr;
+    }
+
+    // reserves size bytes at the end of the command stream, doubling it when full
+    static void pushCommand(RenderBuffer &buffer, const void* cmd, size_t size) {
+        assert(size % RENDER_COMMAND_ALIGN == 0);
+        if(buffer.cmdOffset + size > buffer.size) {
+            size_t newSize = std::max(buffer.size * 2, buffer.cmdOffset + size);
+            // realloc doesn't keep the alignment, the stream is copied over instead
+            u8* commands = allocCommands(newSize);
+            if(commands == nullptr)
+                throw std::runtime_error("Could not grow render command stream");
+            memcpy(commands, buffer.commands, buffer.cmdOffset);
+            free(buffer.commands);
+            SDL_Log("Render command stream grown to %zu bytes", newSize);
+            buffer.commands = commands;
+            buffer.size = newSize;
+        }
+        u8* dst = buffer.commands + buffer.cmdOffset;
+        memcpy(dst, cmd, size);
+        buffer.lastCmd = dst;
+        buffer.cmdOffset += size;
+        buffer.cmdCount++;
     }
 
     inline static void addDrawCommand(RenderBuffer &buffer, u32 textureId, CommandType type, Primitive primitive, i32 offset, i32 count) {
         // if command is the same as the last one, just increase the vertex count
-        if(buffer.lastCmdOffset != nullptr) {
-            auto* lastCmdType = (CommandType*) buffer.lastCmdOffset;
+        if(buffer.lastCmd != nullptr) {
+            auto* lastCmdType = (CommandType*) buffer.lastCmd;
             if(*lastCmdType == type) {
-                auto* lastCmd = (DrawCommand*) buffer.lastCmdOffset;
+                auto* lastCmd = (DrawCommand*) buffer.lastCmd;
                 if(lastCmd->textureId == textureId && lastCmd->primitive == primitive) {
                     lastCmd->count += count;
                     return;
@@ -54,54 +90,53 @@ namespace Renderer {
                 .count = count
         };
 
-        memcpy(buffer.cmdOffset, &cmd, sizeof(DrawCommand));
-        buffer.lastCmdOffset = buffer.cmdOffset;
-        buffer.cmdOffset += sizeof(DrawCommand);
-        assert(buffer.cmdOffset - buffer.commands > 0);
-        buffer.cmdCount++;
+        pushCommand(buffer, &cmd, sizeof(DrawCommand));
+    }
+
+    static inline void pushQuadVertices(RenderBuffer &buffer, float left, float top, float right, float bottom,
+                                        PackedColor c, u16 uvLeft, u16 uvTop, u16 uvRight, u16 uvBottom) {
+        size_t offset = buffer.vertices.size();
+        buffer.vertices.resize(offset + 4);
+        WriteQuadVertices(buffer.vertices.data() + offset, left, top, right, bottom, c, uvLeft, uvTop, uvRight, uvBottom);
+    }
+
+    void BuildQuadIndices(u16* indices) {
+        for(u32 i = 0; i < RENDER_MAX_QUADS_PER_DRAW; ++i) {
+            auto v = (u16) (i * 4);
+            *indices++ = v;
+            *indices++ = v + 1;
+            *indices++ = v + 2;
+            *indices++ = v + 1;
+            *indices++ = v + 3;
+            *indices++ = v + 2;
+        }
     }
 
     void PushQuad(RenderBuffer& buffer, const Quad& q) {
         i32 offset = (i32) buffer.vertices.size();
-        buffer.vertices.emplace_back(Vertex{ q.right, q.top, q.color.r, q.color.g, q.color.b, q.color.a, 1.0f,0.0f }); // top right
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, 1.0f,1.0f }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, 0.0f,0.0f }); // top left
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, 1.0f,1.0f }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, 0.0f,1.0f }); // bottom left
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, 0.0f,0.0f }); // top left
-        i32 count = (i32) buffer.vertices.size() - offset;
-        addDrawCommand(buffer, 0, CommandType::PRIMITIVES, Primitive::TRIANGLES, offset, count);
+        pushQuadVertices(buffer, q.left, q.top, q.right, q.bottom, PackColor(q.color), 0, 0, 65535, 65535);
+        addDrawCommand(buffer, 0, CommandType::PRIMITIVES, Primitive::QUADS, offset, 4);
     }
 
     void PushTexturedQuad(RenderBuffer &buffer, const Quad &q, u32 textureId) {
         i32 offset = (i32) buffer.vertices.size();
-        buffer.vertices.emplace_back(Vertex{ q.right, q.top, q.color.r, q.color.g, q.color.b, q.color.a, 1.0f,0.0f }); // top right
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, 1.0f,1.0f }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, 0.0f,0.0f }); // top left
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, 1.0f,1.0f }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, 0.0f,1.0f }); // bottom left
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, 0.0f,0.0f }); // top left
-        i32 count = (i32) buffer.vertices.size() - offset;
-        addDrawCommand(buffer, textureId, CommandType::TEXTURED_PRIMITIVES, Primitive::TRIANGLES, offset, count);
+        pushQuadVertices(buffer, q.left, q.top, q.right, q.bottom, PackColor(q.color), 0, 0, 65535, 65535);
+        addDrawCommand(buffer, textureId, CommandType::TEXTURED_PRIMITIVES, Primitive::QUADS, offset, 4);
     }
 
     void PushAtlasQuad(RenderBuffer &buffer, const AtlasQuad &q, const TextureAtlas& atlas) {
         i32 offset = (i32) buffer.vertices.size();
         FloatRect uv = atlas.uvRects.at(q.atlasId);
-        buffer.vertices.emplace_back(Vertex{ q.right, q.top, q.color.r, q.color.g, q.color.b, q.color.a, uv.right, uv.top }); // top right
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, uv.right, uv.bottom }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, uv.left, uv.top }); // top left
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, uv.right, uv.bottom }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, uv.left, uv.bottom }); // bottom left
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, uv.left, uv.top }); // top left
-        i32 count = (i32) buffer.vertices.size() - offset;
-        addDrawCommand(buffer, atlas.textureId, CommandType::TEXTURED_PRIMITIVES, Primitive::TRIANGLES, offset, count);
+        pushQuadVertices(buffer, q.left, q.top, q.right, q.bottom, PackColor(q.color),
+                         PackUV(uv.left), PackUV(uv.top), PackUV(uv.right), PackUV(uv.bottom));
+        addDrawCommand(buffer, atlas.textureId, CommandType::TEXTURED_PRIMITIVES, Primitive::QUADS, offset, 4);
     }
 
     void PushTriangleMesh(RenderBuffer &buffer, const std::vector<Vector2> &verts, const Color &color) {
         i32 offset = (i32) buffer.vertices.size();
+        PackedColor c = PackColor(color);
         for(auto& v : verts) {
-            buffer.vertices.emplace_back(Vertex{ v.x, v.y, color.r, color.g, color.b, color.a, 0.0f,0.0f }); // top right
+            buffer.vertices.emplace_back(Vertex{ v.x, v.y, 0, 0, c.r, c.g, c.b, c.a });
         }
         i32 count = (i32) buffer.vertices.size() - offset;
         addDrawCommand(buffer, 0, CommandType::PRIMITIVES, Primitive::TRIANGLES, offset, count);
@@ -109,62 +144,73 @@ namespace Renderer {
 
     void PushLine(RenderBuffer &buffer, const Vector2& from, const Vector2& to, const Color& color) {
         i32 offset = (i32) buffer.vertices.size();
-        buffer.vertices.emplace_back(Vertex{ from.x, from.y, color.r, color.g, color.b, color.a, 0.0f,0.0f }); // from
-        buffer.vertices.emplace_back(Vertex{ to.x, to.y, color.r, color.g, color.b, color.a, 0.0f,0.0f }); // to
+        PackedColor c = PackColor(color);
+        buffer.vertices.emplace_back(Vertex{ from.x, from.y, 0, 0, c.r, c.g, c.b, c.a }); // from
+        buffer.vertices.emplace_back(Vertex{ to.x, to.y, 0, 0, c.r, c.g, c.b, c.a }); // to
         i32 count = (i32) buffer.vertices.size() - offset;
         addDrawCommand(buffer, 0, CommandType::PRIMITIVES, Primitive::LINES, offset, count);
     }
 
-    static void drawTextAtlasQuad(RenderBuffer &buffer, const AtlasQuad &q, const TextureAtlas& atlas) {
-        i32 offset = (i32) buffer.vertices.size();
-        FloatRect uv = atlas.uvRects.at(q.atlasId);
-        buffer.vertices.emplace_back(Vertex{ q.right, q.top, q.color.r, q.color.g, q.color.b, q.color.a, uv.right, uv.top }); // top right
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, uv.right, uv.bottom }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, uv.left, uv.top }); // top left
-        buffer.vertices.emplace_back(Vertex{ q.right, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, uv.right, uv.bottom }); // bottom right
-        buffer.vertices.emplace_back(Vertex{ q.left, q.bottom, q.color.r, q.color.g, q.color.b, q.color.a, uv.left, uv.bottom }); // bottom left
-        buffer.vertices.emplace_back(Vertex{ q.left, q.top, q.color.r, q.color.g, q.color.b, q.color.a, uv.left, uv.top }); // top left
-        i32 count = (i32) buffer.vertices.size() - offset;
-        addDrawCommand(buffer, atlas.textureId, CommandType::TEXT, Primitive::TRIANGLES, offset, count);
-    }
-
-    void PushText(RenderBuffer& buffer, const std::string& text, const Font& font, float x, float y,
-                  const Color& color) {
+    void PushText(RenderBuffer& buffer, const std::string& text, Font& font, float x, float y,
+                  const Color& color, float size) {
         size_t len = text.size();
-        std::vector<AtlasQuad> quads;
+        float scale = size > 0 ? size / (float) font.size : 1.0f;
+        CommandType type = font.sdf ? CommandType::SDF_TEXT : CommandType::TEXT;
+        PackedColor c = PackColor(color);
+        i32 offset = (i32) buffer.vertices.size();
+        // room for a quad per byte, more than the code points need, trimmed to what was written at the end
+        buffer.vertices.resize(offset + len * 4);
+        Vertex* start = buffer.vertices.data();
+        Vertex* v = start + offset;
+        // glyphs on the same page share a draw command, it's flushed when the page changes
+        Vertex* runStart = v;
+        u32 runPage = GLYPH_NO_PAGE;
+        // kerned the same as LayoutText, so a string lands where PushCachedText would put it
+        u32 previous = 0;
 
         for (size_t i = 0; i < len;) {
-            // TODO(Brett): if the character is null, attempt to fetch it from the font
             u32 cpLen;
             u32 cp = DecodeCodePoint(&cpLen, &text[i]);
 
-            const Glyph *c = &font.glyphs.at(cp);
-
-            //assert(c != NULL);
+            const Glyph *g = FindGlyph(font, cp);
             i += cpLen;
-            if (c == nullptr)
+            if (g == nullptr)
                 continue;
-            float xp, yp, h, w;
-            xp = x + c->bearing[0];
-            yp = y - c->bearing[1];
-            w = c->size[0];
-            h = c->size[1];
-            AtlasQuad quad = {
-                    .color      = {color.r, color.g, color.b, color.a},
-                    .atlasId    = c->atlasId,
-                    .left       = xp,
-                    .top        = yp,
-                    .right      = xp + w,
-                    .bottom     = yp + h
-            };
-            quads.emplace_back(quad);
-            x += (float) c->advance;
+            if (previous != 0)
+                x += (float) GetKerning(font, previous, g->index) * scale;
+            previous = g->index;
+            if (g->page != GLYPH_NO_PAGE) {
+                if (g->page != runPage) {
+                    if (v != runStart) {
+                        addDrawCommand(buffer, font.pages[runPage].textureId, type, Primitive::QUADS,
+                                       (i32) (runStart - start), (i32) (v - runStart));
+                    }
+                    runStart = v;
+                    runPage = g->page;
+                }
+                float xp = x + (float) g->bearing[0] * scale;
+                float yp = y - (float) g->bearing[1] * scale;
+                // glyph quads go straight into the vertex stream
+                v = WriteQuadVertices(v, xp, yp, xp + (float) g->size[0] * scale, yp + (float) g->size[1] * scale, c,
+                                      PackUV(g->uv.left), PackUV(g->uv.top), PackUV(g->uv.right), PackUV(g->uv.bottom));
+            }
+            x += (float) g->advance * scale;
         }
-
-        //SDL_Log("Generated %d glyph quads", quadStore.noItems);
-        for(auto& q : quads) {
-            drawTextAtlasQuad(buffer, q, font.atlas);
+        if (v != runStart) {
+            addDrawCommand(buffer, font.pages[runPage].textureId, type, Primitive::QUADS,
+                           (i32) (runStart - start), (i32) (v - runStart));
         }
+        buffer.vertices.resize(v - start);
+    }
+
+    void PushVertices(RenderBuffer &buffer, const Vertex* vertices, size_t count, u32 textureId, CommandType type,
+                      Primitive primitive) {
+        if(count == 0)
+            return;
+        i32 offset = (i32) buffer.vertices.size();
+        buffer.vertices.resize(offset + count);
+        memcpy(buffer.vertices.data() + offset, vertices, count * sizeof(Vertex));
+        addDrawCommand(buffer, textureId, type, primitive, offset, (i32) count);
     }
 
     void PushTransform(RenderBuffer& buffer, const glm::mat4& matrix) {
@@ -172,11 +218,7 @@ namespace Renderer {
                 .type = CommandType::TRANSFORM,
                 .matrix = matrix
         };
-        memcpy(buffer.cmdOffset, &cmd, sizeof(TransformCommand));
-        buffer.lastCmdOffset = buffer.cmdOffset;
-        buffer.cmdOffset += sizeof(TransformCommand);
-        assert(buffer.cmdOffset - buffer.commands > 0);
-        buffer.cmdCount++;
+        pushCommand(buffer, &cmd, sizeof(TransformCommand));
     }
 
     void PushBlendMode(RenderBuffer& buffer, BlendMode mode) {
@@ -184,11 +226,7 @@ namespace Renderer {
                 .type = CommandType::BLEND_MODE,
                 .mode = mode
         };
-        memcpy(buffer.cmdOffset, &cmd, sizeof(BlendModeCommand));
-        buffer.lastCmdOffset = buffer.cmdOffset;
-        buffer.cmdOffset += sizeof(BlendModeCommand);
-        assert(buffer.cmdOffset - buffer.commands > 0);
-        buffer.cmdCount++;
+        pushCommand(buffer, &cmd, sizeof(BlendModeCommand));
     }
 
     void CopyToVertexBuffer(RenderBuffer &buffer, VertexBuffer &vertexBuffer) {
@@ -199,10 +237,9 @@ namespace Renderer {
     }
 
     void Clear(RenderBuffer &buffer) {
-        buffer.vertices.clear();
-        memset(buffer.commands, 0, buffer.size);
-        buffer.cmdOffset = buffer.commands;
+        ResetFrameVector(buffer.vertices);
+        buffer.cmdOffset = 0;
         buffer.cmdCount = 0;
-        buffer.lastCmdOffset = nullptr;
+        buffer.lastCmd = nullptr;
     }
 }
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 #include "glm/glm.hpp"
 
 #include "VertexBuffer.h"
@@ -17,7 +18,12 @@
 #include "PixelBuffer.h"
 #include "TextureAtlas.h"
 #include "Font.h"
+#include "../util/FrameArena.h"
 
+// quads per draw call the shared index buffer covers, u16 indices reach 65536 vertices
+#define RENDER_MAX_QUADS_PER_DRAW 16384
+// every command struct is padded to this so the next one starts aligned and Render can read them in place
+#define RENDER_COMMAND_ALIGN 16
 
 namespace Renderer {
 
@@ -50,9 +56,40 @@ namespace Renderer {
         }
     };
 
+    // uv is normalized to 0-65535 and the color to 0-255, the vertex attributes turn them back into floats
     struct Vertex {
-        float x, y, r, g, b, a, u, v;
+        float x, y;
+        u16 u, v;
+        u8 r, g, b, a;
     };
+    static_assert(sizeof(Vertex) == 16, "2D vertex is expected to be 16 bytes");
+
+    struct PackedColor {
+        u8 r, g, b, a;
+    };
+
+    inline u8 PackColorChannel(float c) {
+        return (u8) (std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    inline PackedColor PackColor(const Color& c) {
+        return {PackColorChannel(c.r), PackColorChannel(c.g), PackColorChannel(c.b), PackColorChannel(c.a)};
+    }
+
+    inline u16 PackUV(float t) {
+        return (u16) (std::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    // top right, bottom right, top left, bottom left, BuildQuadIndices turns them into the two triangles.
+    // returns the vertex after the quad
+    inline Vertex* WriteQuadVertices(Vertex* v, float left, float top, float right, float bottom, PackedColor c,
+                                     u16 uvLeft, u16 uvTop, u16 uvRight, u16 uvBottom) {
+        *v++ = Vertex{ right, top, uvRight, uvTop, c.r, c.g, c.b, c.a };
+        *v++ = Vertex{ right, bottom, uvRight, uvBottom, c.r, c.g, c.b, c.a };
+        *v++ = Vertex{ left, top, uvLeft, uvTop, c.r, c.g, c.b, c.a };
+        *v++ = Vertex{ left, bottom, uvLeft, uvBottom, c.r, c.g, c.b, c.a };
+        return v;
+    }
 
     struct AtlasQuad {
         Color                           color;
@@ -68,13 +105,15 @@ namespace Renderer {
         TEXTURED_PRIMITIVES = 2,
         BLEND_MODE = 3,
         TRANSFORM = 4,
-        TEXT = 5
+        TEXT = 5,
+        SDF_TEXT = 6,       // glyphs from an sdf font
     };
 
     enum class Primitive: u16 {
         TRIANGLES = 1,
         LINES = 2,
         TRIANGLE_STRIP = 3,
+        QUADS = 4,          // 4 vertices per quad, drawn through the shared quad index buffer
     };
 
     enum class BlendMode: u16 {
@@ -83,16 +122,16 @@ namespace Renderer {
         PREMULTIPLIED_ALPHA,
     };
 
-    struct Command {
+    struct alignas(RENDER_COMMAND_ALIGN) Command {
         CommandType type;
     };
 
-    struct ClearCommand {
+    struct alignas(RENDER_COMMAND_ALIGN) ClearCommand {
         CommandType type;
         Color color;
     };
 
-    struct DrawCommand {
+    struct alignas(RENDER_COMMAND_ALIGN) DrawCommand {
         CommandType type;
         u32 textureId;
         Primitive primitive;
@@ -100,27 +139,28 @@ namespace Renderer {
         i32 count; // in vertices
     };
 
-    struct TransformCommand {
+    struct alignas(RENDER_COMMAND_ALIGN) TransformCommand {
         CommandType type;
         glm::mat4 matrix;
     };
 
-    struct BlendModeCommand {
+    struct alignas(RENDER_COMMAND_ALIGN) BlendModeCommand {
         CommandType type;
         BlendMode mode;
     };
 
     struct RenderBuffer {
-        std::vector<Vertex> vertices;
+        std::pmr::vector<Vertex> vertices;  // frame arena, rebuilt by Clear
         u8* commands;
-        u8* cmdOffset;
-        size_t size;
+        size_t cmdOffset;                   // write cursor, bytes used
+        size_t size;                        // capacity
         size_t cmdCount;
-        u8* lastCmdOffset;
+        u8* lastCmd;                        // for merging draws, nullptr after a clear
     };
 
     // merge to previous buffer if identical data, for instance to successive calls to PushTexturedQuad
 
+    // size is the initial capacity of the command stream, it grows as needed
     void CreateRenderBuffer(RenderBuffer& buffer, size_t size);
     void DestroyRenderBuffer(RenderBuffer& buffer);
 
@@ -128,11 +168,20 @@ namespace Renderer {
     void PushTexturedQuad(RenderBuffer& buffer, const Quad& q, u32 textureId);
     void PushAtlasQuad(RenderBuffer &buffer, const AtlasQuad &q, const TextureAtlas& atlas);
     void PushLine(RenderBuffer &buffer, const Vector2& from, const Vector2& to, const Color& color);
-    void PushText(RenderBuffer& buffer, const std::string& text, const Font& font, float x, float y, const Color& color);
+    // size is the pixel size to draw at, 0 for the font's own size. Sdf fonts stay sharp at any size, others are
+    // stretched
+    void PushText(RenderBuffer& buffer, const std::string& text, Font& font, float x, float y, const Color& color,
+                  float size = 0);
+    // copies a prebuilt vertex block (for instance a cached text layout) into the buffer as one draw
+    void PushVertices(RenderBuffer& buffer, const Vertex* vertices, size_t count, u32 textureId, CommandType type,
+                      Primitive primitive);
     void PushTransform(RenderBuffer& buffer, const glm::mat4& matrix);
     void PushBlendMode(RenderBuffer& buffer, BlendMode mode);
     void PushTriangleMesh(RenderBuffer &buffer, const std::vector<Vector2> &verts, const Color &color);
     void CopyToVertexBuffer(RenderBuffer& buffer, VertexBuffer& vertexBuffer);
+    // fills indices (RENDER_MAX_QUADS_PER_DRAW * 6 of them) with two triangles per 4 vertex quad
+    void BuildQuadIndices(u16* indices);
+    // only rewinds the command stream, the memory is kept for the next frame
     void Clear(RenderBuffer &buffer);
 }
 
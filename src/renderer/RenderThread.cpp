@@ -0,0 +1,95 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include "RenderThread.h"
+#include "../util/Profiler.h"
+
+#define RENDER_PACKET_FRESH 0x4u
+#define RENDER_PACKET_INDEX 0x3u
+
+namespace Renderer {
+    static bool acquirePacket(RenderThread& rt) {
+        if(!(rt.readySlot.load(std::memory_order_acquire) & RENDER_PACKET_FRESH))
+            return false;
+        rt.readSlot = rt.readySlot.exchange(rt.readSlot, std::memory_order_acq_rel) & RENDER_PACKET_INDEX;
+        return true;
+    }
+
+    static void renderLoop(RenderThread* rt) {
+        if(rt->callbacks.start != nullptr)
+            rt->callbacks.start(rt->callbacks.userData);
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(rt->mutex);
+                rt->wake.wait(lock, [rt] {
+                    return rt->submitted.load() > rt->taken.load() || !rt->running.load();
+                });
+            }
+            if(!acquirePacket(*rt)) {
+                // stopped with nothing left to draw
+                if(!rt->running.load())
+                    break;
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(rt->mutex);
+                rt->taken.fetch_add(1);
+            }
+            rt->wake.notify_all();
+            rt->callbacks.render(rt->readSlot, rt->callbacks.userData);
+        }
+        if(rt->callbacks.stop != nullptr)
+            rt->callbacks.stop(rt->callbacks.userData);
+    }
+
+    void StartRenderThread(RenderThread &rt, const RenderThreadCallbacks &callbacks, bool threaded) {
+        rt.callbacks = callbacks;
+        rt.threaded = threaded;
+        if(!threaded)
+            return;
+        rt.running = true;
+        rt.thread = std::thread(renderLoop, &rt);
+    }
+
+    void StopRenderThread(RenderThread &rt) {
+        if(!rt.threaded)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(rt.mutex);
+            rt.running = false;
+        }
+        rt.wake.notify_all();
+        rt.thread.join();
+        rt.threaded = false;
+    }
+
+    u32 GetRenderPacketSlot(RenderThread &rt) {
+        return rt.writeSlot;
+    }
+
+    void SubmitRenderPacket(RenderThread &rt) {
+        u32 published = rt.writeSlot | RENDER_PACKET_FRESH;
+        rt.writeSlot = rt.readySlot.exchange(published, std::memory_order_acq_rel) & RENDER_PACKET_INDEX;
+        if(!rt.threaded) {
+            rt.submitted.fetch_add(1);
+            acquirePacket(rt);
+            rt.taken.fetch_add(1);
+            rt.callbacks.render(rt.readSlot, rt.callbacks.userData);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(rt.mutex);
+            rt.submitted.fetch_add(1);
+        }
+        rt.wake.notify_all();
+    }
+
+    void WaitForRenderThread(RenderThread &rt) {
+        if(rt.taken.load() == rt.submitted.load())
+            return;
+        PROFILE_SCOPE("WaitForRenderThread");
+        std::unique_lock<std::mutex> lock(rt.mutex);
+        rt.wake.wait(lock, [&rt] { return rt.taken.load() == rt.submitted.load(); });
+    }
+}
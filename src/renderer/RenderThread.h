@@ -0,0 +1,61 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_RENDERTHREAD_H
+#define CRAWLER_RENDERTHREAD_H
+
+#include "defs.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// Runs GL submission on its own thread. The game thread fills the packet slot returned by GetRenderPacketSlot
+// (level frame, ImGui draw data, whatever the render callback reads) and publishes it with SubmitRenderPacket,
+// the render thread then draws it while the game thread builds the next one. Slots are handed over through a
+// lock-free triple buffer: the writer and reader each own a slot and swap theirs with the ready slot.
+// WaitForRenderThread caps latency at one frame, call it before building a packet so the render thread has
+// taken the previous one. That also means the packet before that is done, so frame arena memory from two
+// frames ago can be reused.
+//
+// Started with threaded false the packet is rendered on the calling thread inside SubmitRenderPacket and the
+// start/stop callbacks are not called, the GL context stays with the game thread.
+
+#define RENDER_PACKET_SLOTS 3
+
+namespace Renderer {
+    struct RenderThreadCallbacks {
+        // on the render thread before the first and after the last packet, makes the GL context current/releases it
+        void (*start)(void* userData) = nullptr;
+        void (*stop)(void* userData) = nullptr;
+        void (*render)(u32 slot, void* userData) = nullptr;
+        void* userData = nullptr;
+    };
+
+    struct RenderThread {
+        RenderThreadCallbacks callbacks;
+        bool threaded = false;
+        std::thread thread;
+        std::atomic<bool> running{false};
+        u32 writeSlot = 0;
+        // slot index, RENDER_PACKET_FRESH is set while it holds a packet the render thread hasn't taken
+        std::atomic<u32> readySlot{1};
+        u32 readSlot = 2;
+        std::atomic<u64> submitted{0};
+        std::atomic<u64> taken{0};
+        // only used to sleep while there is nothing to do, never held while a packet is built or drawn
+        std::mutex mutex;
+        std::condition_variable wake;
+    };
+
+    void StartRenderThread(RenderThread& rt, const RenderThreadCallbacks& callbacks, bool threaded);
+    // renders the packets still queued, then joins the thread
+    void StopRenderThread(RenderThread& rt);
+    // the slot the game thread writes the next packet into
+    u32 GetRenderPacketSlot(RenderThread& rt);
+    void SubmitRenderPacket(RenderThread& rt);
+    void WaitForRenderThread(RenderThread& rt);
+}
+
+#endif //CRAWLER_RENDERTHREAD_H
@@ -6,6 +6,7 @@
 #include "Renderer.h"
 #include "Viewport.h"
 #include "glm/ext.hpp"
+#include <algorithm>
 
 extern "C" {
 #include "glad.h"
@@ -128,12 +129,15 @@ namespace Renderer {
         renderer.screenVBO->allocate((void *) &screenQuadVertices, sizeof(screenQuadVertices),
                                      VertexAccessType::STATIC);
 
-        // setup primitive rendering VertexBuffer
+        // setup primitive rendering VertexBuffer, laid out like Vertex
         VertexAttributes attrs2;
         attrs2.add(0, 2, VertexAttributeType::Float); // position
-        attrs2.add(1, 4, VertexAttributeType::Float); // color
-        attrs2.add(2, 2, VertexAttributeType::Float); // tex coords
+        attrs2.add(2, 2, VertexAttributeType::UnsignedShort, true); // tex coords
+        attrs2.add(1, 4, VertexAttributeType::UnsignedByte, true); // color
         renderer.primitiveVBO = std::make_unique<VertexBuffer>(attrs2);
+        std::vector<u16> quadIndices(RENDER_MAX_QUADS_PER_DRAW * 6);
+        BuildQuadIndices(quadIndices.data());
+        renderer.primitiveVBO->allocateIndices(quadIndices.data(), quadIndices.size() * sizeof(u16));
     }
 
     
@@ -141,7 +145,7 @@ namespace Renderer {
         loadShaderPrograms(r);
         setupFrameBuffers(r);
         setupVertexBuffers(r);
-        CreateRenderBuffer(r.renderBuffer, KILOBYTES(128));
+        CreateRenderBuffer(r.renderBuffer, KILOBYTES(16));
     }
 
     inline static void enableRegularAlpha() {
@@ -269,6 +273,15 @@ namespace Renderer {
             case Primitive::TRIANGLE_STRIP:
                 glDrawArrays(GL_TRIANGLE_STRIP, offset, count);
                 break;
+            case Primitive::QUADS: {
+                // the index buffer only covers RENDER_MAX_QUADS_PER_DRAW quads, longer runs take several draws
+                i32 quads = count / 4;
+                for(i32 first = 0; first < quads; first += RENDER_MAX_QUADS_PER_DRAW) {
+                    i32 n = std::min(quads - first, RENDER_MAX_QUADS_PER_DRAW);
+                    glDrawElementsBaseVertex(GL_TRIANGLES, n * 6, GL_UNSIGNED_SHORT, nullptr, offset + first * 4);
+                }
+                break;
+            }
         }
     }
 
@@ -278,7 +291,8 @@ namespace Renderer {
         //SDL_Log("Renderer: %zu vertices, %zu commands", buffer.vertices.size(), buffer.cmdCount);
 
         u8 *cur_ptr = buffer.commands;
-        while(cur_ptr < buffer.cmdOffset) {
+        u8 *end_ptr = buffer.commands + buffer.cmdOffset;
+        while(cur_ptr < end_ptr) {
             auto* command = (Command*) cur_ptr;
             switch (command->type) {
                 case CommandType::TEXT: {
@@ -287,7 +301,16 @@ namespace Renderer {
                     glBindTexture(GL_TEXTURE_2D, cmd->textureId);
                     r.primitiveShader->setUniform(PrimitiveShaderUniforms.USE_TEXTURE, 1);
                     r.primitiveShader->setUniform(PrimitiveShaderUniforms.IS_FONT, 1);
-                    glDrawArrays(GL_TRIANGLES, cmd->offset, cmd->count);
+                    drawPrimitives(cmd->primitive, cmd->offset, cmd->count);
+                    break;
+                }
+                case CommandType::SDF_TEXT: {
+                    auto* cmd = (DrawCommand*) cur_ptr;
+                    cur_ptr += sizeof(DrawCommand);
+                    glBindTexture(GL_TEXTURE_2D, cmd->textureId);
+                    r.primitiveShader->setUniform(PrimitiveShaderUniforms.USE_TEXTURE, 1);
+                    r.primitiveShader->setUniform(PrimitiveShaderUniforms.IS_FONT, 2);
+                    drawPrimitives(cmd->primitive, cmd->offset, cmd->count);
                     break;
                 }
                 case CommandType::PRIMITIVES: {
@@ -332,10 +355,11 @@ namespace Renderer {
                     }
                     break;
                 }
-                default:
-                    auto* cmd = (Command*) cur_ptr;
-                    SDL_Log("Unknown command %hu", cmd->type);
-                    break;
+                default: {
+                    // sizes are unknown so the rest of the stream can't be walked
+                    SDL_Log("Unknown command %hu", (u16) command->type);
+                    return;
+                }
             }
         }
     }
@@ -0,0 +1,186 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <filesystem>
+#include <SDL_log.h>
+#include <SDL_video.h>
+#include "ShaderCache.h"
+
+extern "C" {
+#include "glad.h"
+}
+
+// program binaries are core in 4.1, glad is generated for 3.3 so the entry points are loaded here
+#define CACHE_GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define CACHE_GL_PROGRAM_BINARY_LENGTH 0x8741
+#define CACHE_GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (APIENTRYP PFN_GETPROGRAMBINARY)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFN_PROGRAMBINARY)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFN_PROGRAMPARAMETERI)(GLuint program, GLenum pname, GLint value);
+
+namespace Renderer {
+    static const u32 CacheMagic = 0x42535243; // "CRSB"
+    static const u32 CacheVersion = 1;
+
+    struct CacheFileHeader {
+        u32 magic;
+        u32 version;
+        u64 key;
+        u32 format;
+        u32 length;
+    };
+
+    static struct {
+        bool enabled = false;
+        std::string directory;
+        std::string driver;
+        PFN_GETPROGRAMBINARY getProgramBinary = nullptr;
+        PFN_PROGRAMBINARY programBinary = nullptr;
+        PFN_PROGRAMPARAMETERI programParameteri = nullptr;
+        ShaderCacheStats stats;
+    } cache;
+
+    static u64 fnv1a(u64 hash, const char* str) {
+        for(; *str; ++str) {
+            hash ^= (u8) *str;
+            hash *= 1099511628211ULL;
+        }
+        // separator so "ab"+"c" and "a"+"bc" differ
+        hash ^= 0xff;
+        hash *= 1099511628211ULL;
+        return hash;
+    }
+
+    static std::string cacheFilename(u64 key) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+        return cache.directory + "/" + name;
+    }
+
+    void InitShaderCache(const std::string &directory, bool enabled) {
+        cache.enabled = false;
+        cache.directory = directory;
+        auto renderer = (const char*) glGetString(GL_RENDERER);
+        auto version = (const char*) glGetString(GL_VERSION);
+        cache.driver = std::string(renderer ? renderer : "") + "|" + (version ? version : "");
+        if(!enabled) {
+            SDL_Log("Shader cache disabled");
+            return;
+        }
+
+        GLint formats = 0;
+        glGetIntegerv(CACHE_GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        // clear the invalid enum error on drivers without program binaries
+        while(glGetError() != GL_NO_ERROR) {}
+        cache.getProgramBinary = (PFN_GETPROGRAMBINARY) SDL_GL_GetProcAddress("glGetProgramBinary");
+        cache.programBinary = (PFN_PROGRAMBINARY) SDL_GL_GetProcAddress("glProgramBinary");
+        cache.programParameteri = (PFN_PROGRAMPARAMETERI) SDL_GL_GetProcAddress("glProgramParameteri");
+        if(formats <= 0 || !cache.getProgramBinary || !cache.programBinary || !cache.programParameteri) {
+            SDL_Log("Program binaries not supported by driver, shader cache disabled");
+            return;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if(ec) {
+            SDL_Log("Could not create shader cache directory %s: %s", directory.c_str(), ec.message().c_str());
+            return;
+        }
+        cache.enabled = true;
+        SDL_Log("Shader cache enabled in %s (%d binary formats)", directory.c_str(), formats);
+    }
+
+    bool IsShaderCacheEnabled() {
+        return cache.enabled;
+    }
+
+    u64 GetShaderCacheKey(const char *vertexSrc, const char *fragmentSrc) {
+        u64 hash = 14695981039346656037ULL;
+        hash = fnv1a(hash, cache.driver.c_str());
+        hash = fnv1a(hash, vertexSrc);
+        hash = fnv1a(hash, fragmentSrc);
+        return hash;
+    }
+
+    u32 LoadCachedProgram(u64 key) {
+        if(!cache.enabled)
+            return 0;
+        auto filename = cacheFilename(key);
+        FILE* f = fopen(filename.c_str(), "rb");
+        if(!f)
+            return 0;
+        CacheFileHeader header = {};
+        std::vector<u8> binary;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == CacheMagic &&
+                  header.version == CacheVersion && header.key == key && header.length > 0;
+        if(ok) {
+            binary.resize(header.length);
+            ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+        }
+        fclose(f);
+        if(!ok) {
+            SDL_Log("Ignoring corrupt shader cache file %s", filename.c_str());
+            return 0;
+        }
+
+        u32 program = glCreateProgram();
+        cache.programBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if(!success) {
+            // the driver may refuse binaries from another build even with the same strings
+            SDL_Log("Driver rejected cached program %s, recompiling", filename.c_str());
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void StoreCachedProgram(u64 key, u32 program) {
+        if(!cache.enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, CACHE_GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+            return;
+        std::vector<u8> binary((size_t) length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        cache.getProgramBinary(program, length, &written, &format, binary.data());
+        if(written <= 0)
+            return;
+
+        CacheFileHeader header = {CacheMagic, CacheVersion, key, format, (u32) written};
+        auto filename = cacheFilename(key);
+        // write next to it and rename so a crash never leaves a truncated binary behind
+        auto tmpFilename = filename + ".tmp";
+        FILE* f = fopen(tmpFilename.c_str(), "wb");
+        if(!f) {
+            SDL_Log("Could not write shader cache file %s", tmpFilename.c_str());
+            return;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(binary.data(), 1, (size_t) written, f) == (size_t) written;
+        ok = fclose(f) == 0 && ok;
+        std::error_code ec;
+        if(ok)
+            std::filesystem::rename(tmpFilename, filename, ec);
+        if(!ok || ec) {
+            SDL_Log("Could not write shader cache file %s", filename.c_str());
+            std::filesystem::remove(tmpFilename, ec);
+        }
+    }
+
+    void SetProgramBinaryRetrievable(u32 program) {
+        if(cache.enabled)
+            cache.programParameteri(program, CACHE_GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    ShaderCacheStats &GetShaderCacheStats() {
+        return cache.stats;
+    }
+}
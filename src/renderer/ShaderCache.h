@@ -0,0 +1,32 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_SHADERCACHE_H
+#define CRAWLER_SHADERCACHE_H
+
+#include <string>
+#include "defs.h"
+
+namespace Renderer {
+    struct ShaderCacheStats {
+        u32 hits = 0;
+        u32 misses = 0;
+        double ms = 0;
+    };
+
+    // Linked programs are stored with glGetProgramBinary under directory/<key>.bin. The key hashes both
+    // sources together with GL_RENDERER and GL_VERSION, so driver updates and edits simply miss the cache.
+    // Needs a current GL context, without InitShaderCache every program is compiled from source.
+    void InitShaderCache(const std::string& directory, bool enabled);
+    bool IsShaderCacheEnabled();
+    u64 GetShaderCacheKey(const char* vertexSrc, const char* fragmentSrc);
+    // returns 0 on a miss or when the driver rejects the stored binary
+    u32 LoadCachedProgram(u64 key);
+    void StoreCachedProgram(u64 key, u32 program);
+    // must be set before linking for the driver to keep a retrievable binary around
+    void SetProgramBinaryRetrievable(u32 program);
+    ShaderCacheStats& GetShaderCacheStats();
+}
+
+#endif //CRAWLER_SHADERCACHE_H
@@ -5,8 +5,10 @@
 #include <cstring>
 #include <stdexcept>
 #include <SDL_log.h>
+#include <SDL_timer.h>
 #include "glm/ext.hpp"
 #include "ShaderProgram.h"
+#include "ShaderCache.h"
 
 extern "C" {
 #include "glad.h"
@@ -59,33 +61,95 @@ namespace Renderer {
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vertexsrc, nullptr);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fragmentsrc, nullptr);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
 
         // geometryShader Program
         GLuint id = glCreateProgram();
-        glAttachShader(id, vertex);
-        glAttachShader(id, fragment);
-        glLinkProgram(id);
-        checkCompileErrors(id, "PROGRAM");
+        SetProgramBinaryRetrievable(id);
+        try {
+            checkCompileErrors(vertex, "VERTEX");
+            checkCompileErrors(fragment, "FRAGMENT");
+            glAttachShader(id, vertex);
+            glAttachShader(id, fragment);
+            glLinkProgram(id);
+            checkCompileErrors(id, "PROGRAM");
+        } catch(std::runtime_error&) {
+            // don't leak the objects, reload keeps running with the previous program
+            glDeleteShader(vertex);
+            glDeleteShader(fragment);
+            glDeleteProgram(id);
+            throw;
+        }
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
         return id;
     }
 
-    ShaderProgram::ShaderProgram(const std::string& vertFilename, const std::string& fragFilename) {
+    // takes the linked binary from the cache when the sources and driver match, otherwise compiles and stores it
+    static u32 buildShaderProgram(const char *vertexsrc, const char *fragmentsrc) {
+        u64 startTime = SDL_GetPerformanceCounter();
+        auto& stats = GetShaderCacheStats();
+        u64 key = GetShaderCacheKey(vertexsrc, fragmentsrc);
+        u32 id = LoadCachedProgram(key);
+        if(id != 0) {
+            stats.hits++;
+        } else {
+            id = createShaderProgram(vertexsrc, fragmentsrc);
+            StoreCachedProgram(key, id);
+            stats.misses++;
+        }
+        stats.ms += (double) (SDL_GetPerformanceCounter() - startTime) * 1000.0 / (double) SDL_GetPerformanceFrequency();
+        return id;
+    }
+
+    ShaderProgram::ShaderProgram(const std::string& vertFilename, const std::string& fragFilename) :
+        vertFilename(vertFilename), fragFilename(fragFilename) {
         char *vertSrc = loadFile(vertFilename.c_str());
         char *fragSrc = loadFile(fragFilename.c_str());
-        id = createShaderProgram(vertSrc, fragSrc);
+        try {
+            id = buildShaderProgram(vertSrc, fragSrc);
+        } catch(std::runtime_error&) {
+            free(vertSrc);
+            free(fragSrc);
+            throw;
+        }
         free(vertSrc);
         free(fragSrc);
     }
 
+    bool ShaderProgram::reload() {
+        char *vertSrc = nullptr;
+        char *fragSrc = nullptr;
+        u32 newId = 0;
+        try {
+            vertSrc = loadFile(vertFilename.c_str());
+            fragSrc = loadFile(fragFilename.c_str());
+            newId = buildShaderProgram(vertSrc, fragSrc);
+        } catch(std::runtime_error& e) {
+            SDL_Log("Reloading %s/%s failed (%s), keeping the old program", vertFilename.c_str(), fragFilename.c_str(), e.what());
+        }
+        free(vertSrc);
+        free(fragSrc);
+        if(newId == 0)
+            return false;
+
+        glDeleteProgram(id);
+        id = newId;
+        // locations can change between compiles
+        for(auto& [name, location] : uniforms) {
+            location = glGetUniformLocation(id, name.c_str());
+        }
+        return true;
+    }
+
+    bool ShaderProgram::usesFile(const std::string &filename) const {
+        return filename == vertFilename || filename == fragFilename;
+    }
+
     ShaderProgram::~ShaderProgram() {
         glDeleteProgram(id);
     }
@@ -17,6 +17,9 @@ namespace Renderer {
         ShaderProgram(const std::string& vertFilename, const std::string& fragFilename);
         ~ShaderProgram();
         void use() const;
+        // recompile from the source files, on errors the current program is kept and false returned
+        bool reload();
+        bool usesFile(const std::string& filename) const;
         void setupUniform(const std::string& name);
         void setUniform(const std::string& name, float value);
         void setUniform(const std::string& name, i32 value);
@@ -39,6 +42,8 @@ namespace Renderer {
 
     private:
         u32 id = 0;
+        std::string vertFilename;
+        std::string fragFilename;
         std::unordered_map<std::string, i32> uniforms;
     };
 
@@ -0,0 +1,202 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <cstring>
+#include <algorithm>
+#include "TextLayout.h"
+#include "../util/string_util.h"
+
+namespace Renderer {
+    void LayoutText(TextLayout& layout, Font& font, const std::string& text, float wrapWidth, float size) {
+        layout.glyphs.clear();
+        layout.width = 0;
+        layout.lines = 1;
+        layout.pageMask = 0;
+        // taken before any lookups, an eviction while laying out leaves the layout stale for its next use
+        layout.generation = font.generation;
+        float scale = size > 0 ? size / (float) font.size : 1.0f;
+        float lineHeight = (float) (font.lineHeight > 0 ? font.lineHeight : (i32) font.size) * scale;
+        float x = 0;
+        float y = 0;
+        u32 previous = 0;
+        // where the current line can be broken: the first glyph after its last space, the pen position there
+        // and the width of the line up to the space
+        bool canBreak = false;
+        size_t breakGlyph = 0;
+        float breakX = 0;
+        float breakWidth = 0;
+
+        size_t len = text.size();
+        for(size_t i = 0; i < len;) {
+            u32 cpLen;
+            u32 cp = DecodeCodePoint(&cpLen, &text[i]);
+            i += cpLen;
+            if(cp == '\n') {
+                layout.width = std::max(layout.width, x);
+                x = 0;
+                y += lineHeight;
+                layout.lines++;
+                previous = 0;
+                canBreak = false;
+                continue;
+            }
+            const Glyph* g = FindGlyph(font, cp);
+            if(g == nullptr)
+                continue;
+            if(previous != 0)
+                x += (float) GetKerning(font, previous, g->index) * scale;
+            previous = g->index;
+            auto advance = (float) g->advance * scale;
+            if(cp == ' ') {
+                breakWidth = x;
+                x += advance;
+                breakGlyph = layout.glyphs.size();
+                breakX = x;
+                canBreak = true;
+                continue;
+            }
+            if(wrapWidth > 0 && canBreak && x + advance > wrapWidth) {
+                // the word that didn't fit moves to the start of the next line
+                layout.width = std::max(layout.width, breakWidth);
+                y += lineHeight;
+                for(size_t k = breakGlyph; k < layout.glyphs.size(); ++k) {
+                    auto& moved = layout.glyphs[k];
+                    moved.left -= breakX;
+                    moved.right -= breakX;
+                    moved.top += lineHeight;
+                    moved.bottom += lineHeight;
+                }
+                x -= breakX;
+                layout.lines++;
+                canBreak = false;
+            }
+            if(g->page != GLYPH_NO_PAGE) {
+                float left = x + (float) g->bearing[0] * scale;
+                float top = y - (float) g->bearing[1] * scale;
+                layout.glyphs.push_back(LaidOutGlyph{
+                        left, top, left + (float) g->size[0] * scale, top + (float) g->size[1] * scale,
+                        PackUV(g->uv.left), PackUV(g->uv.top), PackUV(g->uv.right), PackUV(g->uv.bottom), g->page
+                });
+                layout.pageMask |= 1u << g->page;
+            }
+            x += advance;
+        }
+        layout.width = std::max(layout.width, x);
+        layout.height = (float) layout.lines * lineHeight;
+    }
+
+    void InitTextLayoutCache(TextLayoutCache& cache, size_t capacity) {
+        ClearTextLayoutCache(cache);
+        cache.capacity = std::max(capacity, (size_t) 1);
+        cache.index.reserve(cache.capacity);
+    }
+
+    void ClearTextLayoutCache(TextLayoutCache& cache) {
+        cache.entries.clear();
+        cache.index.clear();
+        cache.stats = {};
+    }
+
+    static u64 cacheKey(const Font& font, const std::string& text, float wrapWidth, float size) {
+        u64 h = std::hash<std::string>{}(text);
+        auto mix = [&h](u64 v) { h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2); };
+        u32 wrapBits, sizeBits;
+        memcpy(&wrapBits, &wrapWidth, sizeof(wrapBits));
+        memcpy(&sizeBits, &size, sizeof(sizeBits));
+        mix((u64) (uintptr_t) &font);
+        mix(font.size);
+        mix(wrapBits);
+        mix(sizeBits);
+        return h;
+    }
+
+    // a layout drawn from the cache keeps its pages from looking unused to the glyph cache
+    static void touchPages(Font& font, const TextLayout& layout) {
+        u64 tick = ++font.useTick;
+        for(u32 page = 0; page < GLYPH_MAX_PAGES; ++page) {
+            if(layout.pageMask & (1u << page))
+                font.pages[page].lastUsed = tick;
+        }
+    }
+
+    static CachedText& findOrLayout(TextLayoutCache& cache, Font& font, const std::string& text, float wrapWidth,
+                                    float size) {
+        u64 key = cacheKey(font, text, wrapWidth, size);
+        auto& entries = cache.entries;
+        auto it = cache.index.find(key);
+        std::list<CachedText>::iterator entry;
+        if(it != cache.index.end()) {
+            entry = it->second;
+            entries.splice(entries.begin(), entries, entry);
+            if(entry->text == text && entry->font == &font && entry->wrapWidth == wrapWidth &&
+               entry->size == size) {
+                if(entry->layout.generation == font.generation) {
+                    touchPages(font, entry->layout);
+                    return *entry;
+                }
+                // glyphs were evicted since it was laid out, shape it again
+            }
+            // or a hash collision, the new string takes over the slot
+        } else {
+            if(entries.size() >= cache.capacity) {
+                // reuse the least recently used entry, its vectors keep their capacity
+                entry = std::prev(entries.end());
+                cache.index.erase(entry->key);
+                entries.splice(entries.begin(), entries, entry);
+            } else {
+                entries.emplace_front();
+                entry = entries.begin();
+            }
+            cache.index[key] = entry;
+        }
+        entry->key = key;
+        entry->text = text;
+        entry->font = &font;
+        entry->wrapWidth = wrapWidth;
+        entry->size = size;
+        entry->built = false;
+        LayoutText(entry->layout, font, text, wrapWidth, size);
+        cache.stats.misses++;
+        return *entry;
+    }
+
+    const TextLayout& GetCachedTextLayout(TextLayoutCache& cache, Font& font, const std::string& text,
+                                          float wrapWidth, float size) {
+        return findOrLayout(cache, font, text, wrapWidth, size).layout;
+    }
+
+    void PushCachedText(RenderBuffer& buffer, TextLayoutCache& cache, const std::string& text, Font& font,
+                        float x, float y, const Color& color, float wrapWidth, float size) {
+        CachedText& entry = findOrLayout(cache, font, text, wrapWidth, size);
+        PackedColor c = PackColor(color);
+        bool moved = entry.x != x || entry.y != y || memcmp(&entry.color, &c, sizeof(PackedColor)) != 0;
+        if(!entry.built || moved) {
+            if(entry.built)
+                cache.stats.rebuilds++;
+            entry.vertices.resize(entry.layout.glyphs.size() * 4);
+            Vertex* v = entry.vertices.data();
+            for(auto& g : entry.layout.glyphs) {
+                v = WriteQuadVertices(v, x + g.left, y + g.top, x + g.right, y + g.bottom, c,
+                                      g.uvLeft, g.uvTop, g.uvRight, g.uvBottom);
+            }
+            entry.x = x;
+            entry.y = y;
+            entry.color = c;
+            entry.built = true;
+        } else {
+            cache.stats.hits++;
+        }
+        // one copy per run of glyphs on the same page, usually the whole string
+        auto& glyphs = entry.layout.glyphs;
+        for(size_t first = 0; first < glyphs.size();) {
+            size_t last = first + 1;
+            while(last < glyphs.size() && glyphs[last].page == glyphs[first].page) {
+                last++;
+            }
+            PushVertices(buffer, &entry.vertices[first * 4], (last - first) * 4, font.pages[glyphs[first].page].textureId,
+                         font.sdf ? CommandType::SDF_TEXT : CommandType::TEXT, Primitive::QUADS);
+            first = last;
+        }
+    }
+}
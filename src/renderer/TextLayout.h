@@ -0,0 +1,83 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_TEXTLAYOUT_H
+#define CRAWLER_TEXTLAYOUT_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "defs.h"
+#include "Font.h"
+#include "RenderBuffer.h"
+
+// Shapes a string once: code points are decoded and looked up, kerning is applied and lines are wrapped, the result
+// is a list of glyph quads relative to the layout origin. TextLayoutCache keeps the laid out strings together with
+// the vertex block they were last drawn with, keyed by (string hash, font, draw size, wrap width) and evicted least
+// recently used first. Drawing an unchanged label at the same spot and color is a single copy into the
+// RenderBuffer, a new position or color only rewrites the cached vertices, only a new string is shaped again. The same
+// string drawn at several places in a frame shares an entry and rewrites its vertices every time. A layout made
+// before the font evicted a glyph page is shaped again on its next use.
+
+#define TEXT_LAYOUT_CACHE_SIZE 256
+
+namespace Renderer {
+    struct LaidOutGlyph {
+        float left, top, right, bottom;         // relative to the layout origin, the baseline of the first line
+        u16 uvLeft, uvTop, uvRight, uvBottom;
+        u32 page;
+    };
+
+    struct TextLayout {
+        std::vector<LaidOutGlyph> glyphs;
+        float width = 0;
+        float height = 0;
+        i32 lines = 0;
+        u32 pageMask = 0;                       // glyph pages the layout uses
+        u32 generation = 0;                     // font generation the uvs are from
+    };
+
+    struct CachedText {
+        u64 key;
+        std::string text;
+        const Font* font;
+        float wrapWidth;
+        float size;
+        TextLayout layout;
+        // the vertices as last drawn, rebuilt when the origin or color changes
+        std::vector<Vertex> vertices;
+        float x, y;
+        PackedColor color;
+        bool built;
+    };
+
+    struct TextLayoutCacheStats {
+        u64 hits = 0;           // vertices copied as they were
+        u64 rebuilds = 0;       // same layout, moved or recolored
+        u64 misses = 0;         // shaped
+    };
+
+    struct TextLayoutCache {
+        size_t capacity = TEXT_LAYOUT_CACHE_SIZE;
+        // most recently used first
+        std::list<CachedText> entries;
+        std::unordered_map<u64, std::list<CachedText>::iterator> index;
+        TextLayoutCacheStats stats;
+    };
+
+    // wrapWidth 0 only breaks at '\n', otherwise lines are broken at the last space that fits. size is the pixel size
+    // to lay out at like PushText, wrapWidth is in those pixels
+    void LayoutText(TextLayout& layout, Font& font, const std::string& text, float wrapWidth = 0, float size = 0);
+    void InitTextLayoutCache(TextLayoutCache& cache, size_t capacity);
+    void ClearTextLayoutCache(TextLayoutCache& cache);
+    // the layout is owned by the cache, it stays valid until the next call that may evict it
+    const TextLayout& GetCachedTextLayout(TextLayoutCache& cache, Font& font, const std::string& text,
+                                          float wrapWidth = 0, float size = 0);
+    // like PushText but through the cache, x and y is the baseline of the first line
+    void PushCachedText(RenderBuffer& buffer, TextLayoutCache& cache, const std::string& text, Font& font,
+                        float x, float y, const Color& color, float wrapWidth = 0, float size = 0);
+}
+
+#endif //CRAWLER_TEXTLAYOUT_H
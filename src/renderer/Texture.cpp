@@ -4,12 +4,19 @@
 
 #include <stdexcept>
 #include <memory>
+#include <cstring>
+#include <SDL_log.h>
 #include "Texture.h"
 
 extern "C" {
 #include "glad.h"
 }
 
+// not part of the core 3.3 glad profile
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_ARB 0x8E8C
+
 namespace Renderer {
     static i32 getGLInternalFormat(TextureFormatInternal format) {
         switch(format) {
@@ -31,6 +38,16 @@ namespace Renderer {
         }
     }
 
+    static GLenum getGLCompressedFormat(CompressedFormat format) {
+        switch(format) {
+            case CompressedFormat::BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case CompressedFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case CompressedFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+            default:
+                throw std::runtime_error("Unknown compressed texture format");
+        }
+    }
+
     u32 CreateTexture() {
         u32 id;
         glGenTextures(1, &id);
@@ -86,8 +103,67 @@ namespace Renderer {
         UploadTexture(textureId, (i32) pb.width, (i32) pb.height, (u8*) pb.pixels, TextureFormatInternal::R8, TextureFormatData::RED);
     }
 
+    void UpdateTextureRegion(u32 textureId, i32 x, i32 y, const PixelBuffer &pb) {
+        BindTexture(textureId);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, (i32) pb.width, (i32) pb.height, GL_RGBA, GL_UNSIGNED_BYTE, (const void*) pb.pixels);
+    }
+
+    void UpdateTextureRowsGreyscale(u32 textureId, i32 y, i32 w, i32 h, const u8 *pixels) {
+        BindTexture(textureId);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, w, h, GL_RED, GL_UNSIGNED_BYTE, (const void*) pixels);
+    }
+
     void GenerateTextureMipmaps(u32 textureId) {
         glBindTexture(GL_TEXTURE_2D, textureId);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
-} // Renderer
\ No newline at end of file
+
+    bool IsCompressedFormatSupported(CompressedFormat format) {
+        static bool queried = false;
+        static bool s3tc = false;
+        static bool bptc = false;
+        if(!queried) {
+            i32 count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for(i32 i = 0; i < count; ++i) {
+                auto ext = (const char*) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+                if(strcmp(ext, "GL_EXT_texture_compression_s3tc") == 0)
+                    s3tc = true;
+                if(strcmp(ext, "GL_ARB_texture_compression_bptc") == 0)
+                    bptc = true;
+            }
+            queried = true;
+            SDL_Log("Compressed textures: s3tc %s, bptc %s", s3tc ? "yes" : "no", bptc ? "yes" : "no");
+        }
+        return format == CompressedFormat::BC7 ? bptc : s3tc;
+    }
+
+    void UploadCompressedTexture(u32 textureId, const CompressedImage& image) {
+        BindTexture(textureId);
+        bool native = IsCompressedFormatSupported(image.format);
+        for(u32 i = 0; i < image.levels.size(); ++i) {
+            auto& level = image.levels[i];
+            if(native) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint) i, getGLCompressedFormat(image.format),
+                                       (GLsizei) level.width, (GLsizei) level.height, 0,
+                                       (GLsizei) level.data.size(), level.data.data());
+            } else {
+                PixelBuffer pb(level.width, level.height, PixelFormat::RGBA);
+                DecompressLevel(pb, image, i);
+                glTexImage2D(GL_TEXTURE_2D, (GLint) i, GL_RGBA8, (GLsizei) level.width, (GLsizei) level.height, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, pb.pixels);
+            }
+        }
+        // only the levels present in the file, the driver can't generate mips for compressed data
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) image.levels.size() - 1);
+    }
+
+    void LoadTextureFromDDS(u32 textureId, const std::string &filename) {
+        CompressedImage image;
+        LoadDDS(image, filename);
+        UploadCompressedTexture(textureId, image);
+        SDL_Log("Loaded %s (%ux%u, %zu levels%s)", filename.c_str(), image.levels[0].width, image.levels[0].height,
+                image.levels.size(), IsCompressedFormatSupported(image.format) ? "" : ", decoded to RGBA8");
+    }
+} // Renderer
@@ -7,6 +7,7 @@
 
 #include "defs.h"
 #include "PixelBuffer.h"
+#include "CompressedTexture.h"
 
 namespace Renderer {
 
@@ -37,8 +38,18 @@ namespace Renderer {
     void LoadTextureFromPng(u32 textureId, const std::string& filename, bool padding);
     void LoadTexture(u32 textureId, const PixelBuffer &pb);
     void LoadTextureGreyscale(u32 textureId, const PixelBuffer &pb);
+    // overwrites a region of an already uploaded RGBA texture
+    void UpdateTextureRegion(u32 textureId, i32 x, i32 y, const PixelBuffer &pb);
+    // overwrites rows [y, y + h) of an uploaded greyscale texture w pixels wide, pixels holds just those rows.
+    // Rows are unpacked 4 byte aligned, keep w a multiple of 4
+    void UpdateTextureRowsGreyscale(u32 textureId, i32 y, i32 w, i32 h, const u8 *pixels);
     void GenerateTextureMipmaps(u32 textureId);
 
+    // true when the driver can sample the format directly, otherwise uploads decode to RGBA8 on the CPU
+    bool IsCompressedFormatSupported(CompressedFormat format);
+    void UploadCompressedTexture(u32 textureId, const CompressedImage& image);
+    void LoadTextureFromDDS(u32 textureId, const std::string& filename);
+
 } // Renderer
 
 #endif //PLATFORMER_TEXTURE_H
@@ -3,6 +3,8 @@
 //
 
 #include <SDL_log.h>
+#include <SDL_timer.h>
+#include <stdexcept>
 #include "TextureAtlas.h"
 #include "Texture.h"
 
@@ -15,89 +17,157 @@ namespace Renderer {
         nextEntryId = 1;
     }
 
-    u32 TextureAtlasBuilder::add(const PixelBuffer &pb) {
+    u32 TextureAtlasBuilder::addImage(u32 source, const UIntRect &rect, AtlasPadding padding) {
         auto id = nextEntryId++;
-        auto newPb = PixelBuffer(pb);
-        stbrp_rect rect = {};
-        rect.id = (i32) id;
-        rect.w = (stbrp_coord) newPb.width;
-        rect.h = (stbrp_coord) newPb.height;
-        rect.was_packed = 0;
-        images.emplace_back(TextureAtlasBuilderImage{id, newPb});
-        rects.emplace_back(rect);
+        u32 border = padding == AtlasPadding::NONE ? 0 : 2;
+        stbrp_rect packRect = {};
+        packRect.id = (i32) id;
+        packRect.w = (stbrp_coord) (rect.w + border);
+        packRect.h = (stbrp_coord) (rect.h + border);
+        packRect.was_packed = 0;
+        images.emplace_back(TextureAtlasBuilderImage{id, source, rect, padding});
+        rects.emplace_back(packRect);
         noRects++;
         return id;
     }
 
+    u32 TextureAtlasBuilder::add(const PixelBuffer &pb) {
+        return add(PixelBuffer(pb));
+    }
+
+    u32 TextureAtlasBuilder::add(PixelBuffer &&pb) {
+        // an already padded buffer has its border re-created from the edges at build time
+        auto rect = pb.padding ? UIntRect(1, 1, pb.width - 2, pb.height - 2) : UIntRect(0, 0, pb.width, pb.height);
+        auto padding = pb.padding ? AtlasPadding::EXTEND : AtlasPadding::NONE;
+        auto sheet = addSheet(std::move(pb));
+        return addImage(sheet, rect, padding);
+    }
+
     u32 TextureAtlasBuilder::addFromPng(const std::string &filename, bool pad) {
-        auto id = nextEntryId++;
-        auto newPb = PixelBuffer(filename, pad);
-        stbrp_rect rect = {};
-        rect.id = (i32) id;
-        rect.w = (stbrp_coord) newPb.width;
-        rect.h = (stbrp_coord) newPb.height;
-        rect.was_packed = 0;
-        images.emplace_back(TextureAtlasBuilderImage{id, newPb});
-        rects.emplace_back(rect);
-        noRects++;
-        return id;
+        i32 w, h;
+        return addFromPngSize(filename, pad, w, h);
     }
 
     u32 TextureAtlasBuilder::addFromPngSize(const std::string &filename, bool pad, i32& w, i32& h) {
-        auto id = nextEntryId++;
-        auto newPb = PixelBuffer(filename, pad);
-        w = (i32) newPb.width;
-        h = (i32) newPb.height;
-        stbrp_rect rect = {};
-        rect.id = (i32) id;
-        rect.w = (stbrp_coord) newPb.width;
-        rect.h = (stbrp_coord) newPb.height;
-        rect.was_packed = 0;
-        images.emplace_back(TextureAtlasBuilderImage{id, newPb});
-        rects.emplace_back(rect);
-        noRects++;
-        return id;
+        // decode unpadded, the padding is blitted straight into the atlas
+        auto sheet = addSheet(PixelBuffer(filename, false));
+        sourceFiles[sheet] = filename;
+        auto& pb = sources[sheet];
+        u32 border = pad ? 2 : 0;
+        w = (i32) (pb.width + border);
+        h = (i32) (pb.height + border);
+        return addImage(sheet, UIntRect(0, 0, pb.width, pb.height), pad ? AtlasPadding::EXTEND : AtlasPadding::NONE);
+    }
+
+    u32 TextureAtlasBuilder::addSheet(PixelBuffer &&pb) {
+        if(pb.pixelFormat != format) {
+            throw std::runtime_error("Pixel format does not match texture atlas");
+        }
+        sources.emplace_back(std::move(pb));
+        sourceFiles.emplace_back();
+        return (u32) sources.size() - 1;
+    }
+
+    u32 TextureAtlasBuilder::addSheetFromPng(const std::string &filename) {
+        auto sheet = addSheet(PixelBuffer(filename, false));
+        sourceFiles[sheet] = filename;
+        return sheet;
+    }
+
+    const PixelBuffer &TextureAtlasBuilder::getSheet(u32 sheet) const {
+        return sources.at(sheet);
+    }
+
+    u32 TextureAtlasBuilder::addSubImage(u32 sheet, const UIntRect &rect, AtlasPadding padding) {
+        auto& pb = sources.at(sheet);
+        if(rect.x + rect.w > pb.width || rect.y + rect.h > pb.height) {
+            throw std::runtime_error("Sub image rect outside of sheet");
+        }
+        return addImage(sheet, rect, padding);
+    }
+
+    static void blitExtendedEdges(PixelBuffer &dst, const PixelBuffer &src, const UIntRect &r, u32 x, u32 y) {
+        u32 right = r.x + r.w - 1;
+        u32 bottom = r.y + r.h - 1;
+        // left, right, top and bottom side
+        dst.copyFrom(src, UIntRect(r.x, r.y, 1, r.h), UIntPos(x, y + 1));
+        dst.copyFrom(src, UIntRect(right, r.y, 1, r.h), UIntPos(x + r.w + 1, y + 1));
+        dst.copyFrom(src, UIntRect(r.x, r.y, r.w, 1), UIntPos(x + 1, y));
+        dst.copyFrom(src, UIntRect(r.x, bottom, r.w, 1), UIntPos(x + 1, y + r.h + 1));
+        // corners
+        dst.copyFrom(src, UIntRect(r.x, r.y, 1, 1), UIntPos(x, y));
+        dst.copyFrom(src, UIntRect(right, r.y, 1, 1), UIntPos(x + r.w + 1, y));
+        dst.copyFrom(src, UIntRect(r.x, bottom, 1, 1), UIntPos(x, y + r.h + 1));
+        dst.copyFrom(src, UIntRect(right, bottom, 1, 1), UIntPos(x + r.w + 1, y + r.h + 1));
     }
 
     void TextureAtlasBuilder::build(TextureAtlas &atlas) {
+        u64 startTime = SDL_GetPerformanceCounter();
         atlas.uvRects.clear();
+        atlas.fileRegions.clear();
         stbrp_context context;
         memset(&context, 0, sizeof(stbrp_context));
 
-        // TODO this might overflow the stack
         i32 nodeCount = width * 2;
-        struct stbrp_node nodes[nodeCount];
+        std::vector<stbrp_node> nodes((size_t) nodeCount);
 
-        stbrp_init_target(&context, width, height, nodes, nodeCount);
+        stbrp_init_target(&context, width, height, nodes.data(), nodeCount);
         stbrp_pack_rects(&context, rects.data(), (i32) rects.size());
 
         auto buffer = PixelBuffer((u32) width, (u32) height, format);
         auto atlasWidth = (float) width;
         auto atlasHeight = (float) height;
 
+        // free each source as soon as its last view has been blitted to keep the peak down
+        std::vector<u32> remaining(sources.size(), 0);
+        for(auto& image : images) {
+            remaining[image.source]++;
+        }
+
+        size_t sourceBytes = 0;
+        size_t pixelSize = format == PixelFormat::RGBA ? sizeof(u32) : 1;
+        for(auto& source : sources) {
+            sourceBytes += (size_t) source.width * source.height * pixelSize;
+        }
+
         for(i32 i = 0; i < (i32) rects.size(); ++i) {
             auto &curRect = rects[i];
             auto &curImage = images[i];
+            auto &src = sources[curImage.source];
             auto uvRect = FloatRect();
             if (!curRect.was_packed) {
                 SDL_Log("Failed to pack image %d", curRect.id);
-                continue;
-            }
-            if (!curImage.pb.padding) {
+            } else if (curImage.padding == AtlasPadding::NONE) {
                 uvRect.left = ((curRect.x) / atlasWidth);
                 uvRect.right = ((curRect.x + curRect.w) / atlasWidth);
                 uvRect.top = ((curRect.y) / atlasHeight);
                 uvRect.bottom = ((curRect.y + curRect.h) / atlasHeight);
+                atlas.uvRects[curRect.id] = uvRect;
+                buffer.copyFrom(src, curImage.rect, UIntPos((u32) curRect.x, (u32) curRect.y));
             } else {
                 uvRect.left = ((curRect.x + 1.0f) / atlasWidth);
                 uvRect.right = ((curRect.x + curRect.w - 1.0f) / atlasWidth);
                 uvRect.top = ((curRect.y + 1.0f) / atlasHeight);
                 uvRect.bottom = ((curRect.y + curRect.h - 1.0f) / atlasHeight);
+                atlas.uvRects[curRect.id] = uvRect;
+                buffer.copyFrom(src, curImage.rect, UIntPos((u32) curRect.x + 1, (u32) curRect.y + 1));
+                if (curImage.padding == AtlasPadding::EXTEND && curImage.rect.w > 0 && curImage.rect.h > 0) {
+                    blitExtendedEdges(buffer, src, curImage.rect, (u32) curRect.x, (u32) curRect.y);
+                }
+            }
+            // frames cut from a sheet can't be reloaded from its file, only whole images
+            bool wholeSheet = curImage.rect.x == 0 && curImage.rect.y == 0 && curImage.rect.w == src.width &&
+                              curImage.rect.h == src.height;
+            if (curRect.was_packed && wholeSheet && !sourceFiles[curImage.source].empty()) {
+                atlas.fileRegions.emplace_back(TextureAtlasFileRegion{sourceFiles[curImage.source], curRect.x, curRect.y,
+                                                                      curRect.w, curRect.h, curImage.padding != AtlasPadding::NONE});
+            }
+            if (--remaining[curImage.source] == 0) {
+                src = PixelBuffer(0, 0, format);
             }
-            atlas.uvRects[curRect.id] = uvRect;
-            buffer.copyFrom(curImage.pb, UIntRect(0, 0, curImage.pb.width, curImage.pb.height),
-                             UIntPos((u32) curRect.x, (u32) curRect.y));
         }
+        sources.clear();
+        sourceFiles.clear();
         atlas.textureId = CreateTexture();
 
         if (format == PixelFormat::RGBA) {
@@ -106,6 +176,33 @@ namespace Renderer {
             LoadTextureGreyscale(atlas.textureId, buffer);
         }
         SetFilteringTexture(atlas.textureId, TextureFiltering::NEAREST);
+
+        double ms = (double) (SDL_GetPerformanceCounter() - startTime) * 1000.0 / (double) SDL_GetPerformanceFrequency();
+        SDL_Log("Built %dx%d atlas from %d images (%zu KB source pixels) in %.2f ms", width, height, noRects,
+                sourceBytes / 1024, ms);
+    }
+
+    bool ReloadAtlasRegion(TextureAtlas &atlas, const std::string &filename) {
+        bool found = false;
+        for(auto& region : atlas.fileRegions) {
+            if(region.filename != filename)
+                continue;
+            found = true;
+            PixelBuffer pb(0, 0, PixelFormat::RGBA);
+            try {
+                pb = PixelBuffer(filename, region.padded);
+            } catch(std::runtime_error& e) {
+                SDL_Log("Reloading %s failed (%s), keeping the old image", filename.c_str(), e.what());
+                return false;
+            }
+            if((i32) pb.width != region.width || (i32) pb.height != region.height) {
+                SDL_Log("%s changed size to %ux%u, restart to repack the atlas", filename.c_str(),
+                        region.padded ? pb.width - 2 : pb.width, region.padded ? pb.height - 2 : pb.height);
+                return false;
+            }
+            UpdateTextureRegion(atlas.textureId, region.x, region.y, pb);
+        }
+        return found;
     }
 
     void DestroyTextureAtlas(TextureAtlas &atlas) {
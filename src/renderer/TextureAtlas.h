@@ -9,19 +9,40 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <string>
 #include "Vector2.h"
 #include "PixelBuffer.h"
 #include <stb_rect_pack.h>
 
 namespace Renderer {
+    // where an image loaded from a file ended up, so it can be patched in place when the file changes
+    struct TextureAtlasFileRegion {
+        std::string filename;
+        i32 x;
+        i32 y;
+        i32 width;
+        i32 height;
+        bool padded;
+    };
+
     struct TextureAtlas {
         u32 textureId;
         std::unordered_map<u32, FloatRect> uvRects;
+        std::vector<TextureAtlasFileRegion> fileRegions;
     };
 
+    enum class AtlasPadding {
+        NONE,
+        EMPTY,      // 1 pixel transparent border
+        EXTEND,     // 1 pixel border duplicating the image edges, avoids bleeding when filtering
+    };
+
+    // a view into one of the builders source buffers, pixels are only copied once when the atlas is built
     struct TextureAtlasBuilderImage {
         u32 id;
-        PixelBuffer pb;
+        u32 source;
+        UIntRect rect;
+        AtlasPadding padding;
     };
 
     class TextureAtlasBuilder {
@@ -29,11 +50,22 @@ namespace Renderer {
         TextureAtlasBuilder(i32 width, i32 height, PixelFormat format);
         ~TextureAtlasBuilder() = default;
         u32 add(const PixelBuffer& pb);
+        u32 add(PixelBuffer&& pb);
         u32 addFromPng(const std::string& filename, bool pad);
         u32 addFromPngSize(const std::string &filename, bool pad, i32& w, i32& h);
+        // sheets are owned by the builder but not added to the atlas themselves, use addSubImage to add regions
+        u32 addSheet(PixelBuffer&& pb);
+        // a sheet decoded from a file, a sub image covering all of it is reloaded with the file like addFromPng
+        u32 addSheetFromPng(const std::string& filename);
+        const PixelBuffer& getSheet(u32 sheet) const;
+        u32 addSubImage(u32 sheet, const UIntRect& rect, AtlasPadding padding);
         void build(TextureAtlas& atlas);
 
     private:
+        u32 addImage(u32 source, const UIntRect& rect, AtlasPadding padding);
+
+        std::vector<PixelBuffer> sources;
+        std::vector<std::string> sourceFiles;
         std::vector<TextureAtlasBuilderImage> images;
         std::vector<stbrp_rect> rects;
         PixelFormat format;
@@ -43,6 +75,9 @@ namespace Renderer {
         u32 nextEntryId;
     };
 
+    // re-decodes the file and uploads it over its old region, returns false if the file is not in the atlas,
+    // can't be decoded or changed size (the atlas would need to be repacked)
+    bool ReloadAtlasRegion(TextureAtlas& atlas, const std::string& filename);
     void DestroyTextureAtlas(TextureAtlas& atlas);
 }
 
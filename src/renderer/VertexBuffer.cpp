@@ -18,6 +18,10 @@ namespace Renderer {
                 return sizeof(double);
             case VertexAttributeType::Int:
                 return sizeof(int);
+            case VertexAttributeType::UnsignedByte:
+                return sizeof(u8);
+            case VertexAttributeType::UnsignedShort:
+                return sizeof(u16);
             default:
                 throw std::runtime_error("Unknown vertex attribute type");
         }
@@ -31,13 +35,17 @@ namespace Renderer {
                 return GL_DOUBLE;
             case VertexAttributeType::Int:
                 return GL_INT;
+            case VertexAttributeType::UnsignedByte:
+                return GL_UNSIGNED_BYTE;
+            case VertexAttributeType::UnsignedShort:
+                return GL_UNSIGNED_SHORT;
             default:
                 throw std::runtime_error("Unknown vertex attribute type");
         }
     }
 
-    void VertexAttributes::add(uint32_t index, int32_t size, Renderer::VertexAttributeType type) {
-        VertexAttribute attr = {.index = index, .size = size, .type = type};
+    void VertexAttributes::add(uint32_t index, int32_t size, Renderer::VertexAttributeType type, bool normalized) {
+        VertexAttribute attr = {.index = index, .size = size, .type = type, .normalized = normalized};
         attributes.push_back(attr);
         stride += size * getAttributeSize(type);
     }
@@ -50,7 +58,7 @@ namespace Renderer {
         size_t offset = 0;
         for(auto& attr : attributes.attributes) {
             glEnableVertexAttribArray(attr.index);
-            glVertexAttribPointer(attr.index, attr.size, getAttributeGLType(attr.type), GL_FALSE, attributes.stride, (void*) offset);
+            glVertexAttribPointer(attr.index, attr.size, getAttributeGLType(attr.type), attr.normalized ? GL_TRUE : GL_FALSE, attributes.stride, (void*) offset);
             offset += attr.size * getAttributeSize(attr.type);
         }
         unbind();
@@ -59,6 +67,8 @@ namespace Renderer {
     VertexBuffer::~VertexBuffer() {
         glDeleteVertexArrays(1, &arrayId);
         glDeleteBuffers(1, &bufferId);
+        if(indexBufferId != 0)
+            glDeleteBuffers(1, &indexBufferId);
     }
 
     void VertexBuffer::bind() const {
@@ -71,15 +81,25 @@ namespace Renderer {
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
-    void VertexBuffer::update(void *data, size_t offset, size_t size) const {
+    void VertexBuffer::update(const void *data, size_t offset, size_t size) const {
         bind();
         glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) offset, (GLsizeiptr) size, data);
     }
 
-    void VertexBuffer::allocate(void *data, size_t size, VertexAccessType accessType) const {
+    void VertexBuffer::allocate(const void *data, size_t size, VertexAccessType accessType) const {
         bind();
         glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) size, data, accessType == VertexAccessType::STATIC ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
     }
 
+    void VertexBuffer::allocateIndices(const void *data, size_t size) {
+        if(indexBufferId == 0)
+            glGenBuffers(1, &indexBufferId);
+        // the element array binding is part of the vertex array state
+        glBindVertexArray(arrayId);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) size, data, GL_STATIC_DRAW);
+        unbind();
+    }
+
 }
 
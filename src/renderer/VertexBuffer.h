@@ -13,6 +13,8 @@ namespace Renderer {
         Float,
         Double,
         Int,
+        UnsignedByte,
+        UnsignedShort,
     };
 
     enum class VertexAccessType {
@@ -24,12 +26,14 @@ namespace Renderer {
         u32 index;
         i32 size;
         VertexAttributeType type;
+        bool normalized;
     };
 
     class VertexAttributes {
     public:
         VertexAttributes() : stride(0) {}
-        void add(u32 index, i32 size, VertexAttributeType type);
+        // attributes are laid out in the order they're added, normalized maps integer types to 0-1
+        void add(u32 index, i32 size, VertexAttributeType type, bool normalized = false);
 
     private:
         std::vector<VertexAttribute> attributes;
@@ -45,13 +49,16 @@ namespace Renderer {
         ~VertexBuffer();
         void bind() const;
         static void unbind();
-        void update(void *data, size_t offset, size_t size) const;
-        void allocate(void *data, size_t size, VertexAccessType accessType) const;
+        void update(const void *data, size_t offset, size_t size) const;
+        void allocate(const void *data, size_t size, VertexAccessType accessType) const;
+        // attaches a static index buffer to the vertex array, it stays bound with it
+        void allocateIndices(const void *data, size_t size);
 
     private:
         VertexAttributes attributes;
         u32 arrayId = 0;
         u32 bufferId = 0;
+        u32 indexBufferId = 0;
     };
 }
 
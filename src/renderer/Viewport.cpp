@@ -2,10 +2,7 @@
 // Created by bison on 02-10-23.
 //
 
-extern "C" {
-#include <glad.h>
-}
-
+#include <SDL_stdinc.h>
 #include "Viewport.h"
 
 namespace Renderer {
@@ -20,6 +17,7 @@ namespace Renderer {
         viewport.current.h = (i32) height;
     }
 
+    // only updates the rect, it's applied by whoever draws next (RenderLevel on the render thread)
     void SizeChangedViewport(u32 newWidth, u32 newHeight) {
         u32 realWidth = newWidth;
         u32 realHeight = newHeight;
@@ -38,7 +36,6 @@ namespace Renderer {
             viewport.current.y = 0;
             viewport.current.w = (i32) realWidth;
             viewport.current.h = (i32) realHeight;
-            glViewport(viewport.current.x, viewport.current.y, viewport.current.w, viewport.current.h);
             //SDL_Log("Same aspect ratio");
         } else if (want_aspect > real_aspect) {
             /* We want a wider aspect ratio than is available - letterbox it */
@@ -47,7 +44,6 @@ namespace Renderer {
             viewport.current.w = (i32) newWidth;
             viewport.current.h = (i32) SDL_ceil((float) viewport.screenHeight * scale);
             viewport.current.y = ((i32) newHeight - viewport.current.h) / 2;
-            glViewport(viewport.current.x, viewport.current.y, viewport.current.w, viewport.current.h);
             //SDL_Log("letterbox");
         } else {
             /* We want a narrower aspect ratio than is available - use sidebars */
@@ -56,7 +52,6 @@ namespace Renderer {
             viewport.current.h = (i32) newHeight;
             viewport.current.w = (i32) SDL_ceil((float) viewport.screenWidth * scale);
             viewport.current.x = ((i32) newWidth - viewport.current.w) / 2;
-            glViewport(viewport.current.x, viewport.current.y, viewport.current.w, viewport.current.h);
             //SDL_Log("sidebars");
         }
     }
@@ -0,0 +1,121 @@
+//
+// Created by bison on 19-10-26.
+//
+
+// Offline asset bake step: encodes a png into a block compressed .dds next to it, which the
+// renderer then prefers over the png. Prints the round trip PSNR of the top level so bad encodes
+// can be caught in the bake script with --min-psnr.
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include "../renderer/PixelBuffer.h"
+#include "../renderer/CompressedTexture.h"
+
+using namespace Renderer;
+
+static double computePSNR(const PixelBuffer& a, const PixelBuffer& b, bool alpha) {
+    auto pa = (const u8*) a.pixels;
+    auto pb = (const u8*) b.pixels;
+    u32 channels = alpha ? 4 : 3;
+    double sum = 0;
+    size_t count = (size_t) a.width * a.height;
+    for(size_t i = 0; i < count; ++i) {
+        // fully transparent texels don't contribute, BC1 punch through stores them as black
+        if(pa[i * 4 + 3] == 0 && pb[i * 4 + 3] == 0)
+            continue;
+        for(u32 c = 0; c < channels; ++c) {
+            double d = (double) pa[i * 4 + c] - (double) pb[i * 4 + c];
+            sum += d * d;
+        }
+    }
+    double mse = sum / (double) (count * channels);
+    if(mse == 0)
+        return 99.0;
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+static void usage() {
+    fprintf(stderr, "usage: texbake [--bc1|--bc3] [--no-mips] [--min-psnr dB] input.png [output.dds]\n");
+}
+
+int main(int argc, char** argv) {
+    bool forceFormat = false;
+    CompressedFormat format = CompressedFormat::BC1;
+    bool mipmaps = true;
+    double minPSNR = 0;
+    std::string input, output;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--bc1") == 0) {
+            forceFormat = true;
+            format = CompressedFormat::BC1;
+        } else if(strcmp(argv[i], "--bc3") == 0) {
+            forceFormat = true;
+            format = CompressedFormat::BC3;
+        } else if(strcmp(argv[i], "--no-mips") == 0) {
+            mipmaps = false;
+        } else if(strcmp(argv[i], "--min-psnr") == 0 && i + 1 < argc) {
+            minPSNR = atof(argv[++i]);
+        } else if(input.empty()) {
+            input = argv[i];
+        } else if(output.empty()) {
+            output = argv[i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if(input.empty()) {
+        usage();
+        return 2;
+    }
+    if(output.empty()) {
+        auto dot = input.find_last_of('.');
+        output = (dot == std::string::npos ? input : input.substr(0, dot)) + ".dds";
+    }
+
+    try {
+        PixelBuffer pb(input, false);
+        // stored bottom up like LoadTextureFromPng uploads
+        pb.verticalFlip();
+
+        // BC1 punch through alpha covers opaque and cut out textures, anything blended needs BC3
+        if(!forceFormat) {
+            auto pixels = (const u8*) pb.pixels;
+            for(size_t i = 0; i < (size_t) pb.width * pb.height; ++i) {
+                u8 a = pixels[i * 4 + 3];
+                if(a != 0 && a != 255) {
+                    format = CompressedFormat::BC3;
+                    break;
+                }
+            }
+        }
+
+        CompressedImage image;
+        CompressPixelBuffer(image, pb, format, mipmaps);
+        SaveDDS(image, output);
+
+        PixelBuffer decoded(pb.width, pb.height, PixelFormat::RGBA);
+        DecompressLevel(decoded, image, 0);
+        double psnr = computePSNR(pb, decoded, format == CompressedFormat::BC3);
+
+        size_t bytes = 0;
+        for(auto& level : image.levels)
+            bytes += level.data.size();
+        size_t rawBytes = (size_t) pb.width * pb.height * 4;
+        printf("%s -> %s: %ux%u %s, %zu levels, %zu bytes (%.1f%% of RGBA8 top level), PSNR %.2f dB\n",
+               input.c_str(), output.c_str(), pb.width, pb.height, format == CompressedFormat::BC1 ? "BC1" : "BC3",
+               image.levels.size(), bytes, 100.0 * (double) bytes / (double) rawBytes, psnr);
+        if(psnr < minPSNR) {
+            fprintf(stderr, "PSNR %.2f dB is below the required %.2f dB\n", psnr, minPSNR);
+            return 1;
+        }
+    } catch(std::exception& e) {
+        fprintf(stderr, "texbake: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include "AllocTracker.h"
+
+#ifdef CRAWLER_TRACK_ALLOCS
+
+static std::atomic<u64> allocCount{0};
+static std::atomic<u64> allocBytes{0};
+
+static void* trackedAlloc(size_t size) {
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add(size, std::memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(size_t size) {
+    if(void* p = trackedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    if(void* p = trackedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return trackedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return trackedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+// over-aligned types and std::pmr::new_delete_resource come through here, the block keeps the malloc pointer
+// just before the aligned address
+static void* trackedAlignedAlloc(size_t size, std::align_val_t alignment) {
+    auto align = static_cast<size_t>(alignment);
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add(size, std::memory_order_relaxed);
+    void* block = malloc(size + align + sizeof(void*));
+    if(block == nullptr)
+        return nullptr;
+    auto address = (reinterpret_cast<uintptr_t>(block) + sizeof(void*) + align - 1) & ~(uintptr_t) (align - 1);
+    reinterpret_cast<void**>(address)[-1] = block;
+    return reinterpret_cast<void*>(address);
+}
+
+static void trackedAlignedFree(void* p) {
+    if(p != nullptr)
+        free(static_cast<void**>(p)[-1]);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if(void* p = trackedAlignedAlloc(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    if(void* p = trackedAlignedAlloc(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackedAlignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    trackedAlignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    trackedAlignedFree(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    trackedAlignedFree(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+    trackedAlignedFree(p);
+}
+
+bool IsAllocTrackingEnabled() {
+    return true;
+}
+
+AllocStats GetAllocStats() {
+    AllocStats stats;
+    stats.count = allocCount.load(std::memory_order_relaxed);
+    stats.bytes = allocBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+#else
+
+bool IsAllocTrackingEnabled() {
+    return false;
+}
+
+AllocStats GetAllocStats() {
+    return AllocStats{};
+}
+
+#endif
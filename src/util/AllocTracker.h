@@ -0,0 +1,23 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_ALLOCTRACKER_H
+#define CRAWLER_ALLOCTRACKER_H
+
+#include <defs.h>
+
+// Global heap allocation counter. Built with CRAWLER_TRACK_ALLOCS (debug and benchmark builds) the global
+// operator new is replaced with one that counts calls and bytes, otherwise the counters stay at zero.
+// Allocations that bypass operator new (malloc, ImGui's allocator) are not seen.
+
+struct AllocStats {
+    u64 count = 0;
+    u64 bytes = 0;
+};
+
+bool IsAllocTrackingEnabled();
+// totals since startup over all threads
+AllocStats GetAllocStats();
+
+#endif //CRAWLER_ALLOCTRACKER_H
@@ -0,0 +1,90 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <SDL_log.h>
+#include <algorithm>
+#include "FileWatcher.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+
+static void watchLoop(FileWatcher* watcher) {
+    alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    pollfd pfd = {watcher->fd, POLLIN, 0};
+    while(watcher->running) {
+        // wake up regularly to notice when we should stop
+        if(poll(&pfd, 1, 100) <= 0)
+            continue;
+        ssize_t len = read(watcher->fd, buffer, sizeof(buffer));
+        if(len <= 0)
+            continue;
+        std::lock_guard<std::mutex> lock(watcher->mutex);
+        for(char* ptr = buffer; ptr < buffer + len; ) {
+            auto event = (const struct inotify_event*) ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+            if(event->len == 0 || (event->mask & IN_ISDIR))
+                continue;
+            auto dir = watcher->directories.find(event->wd);
+            if(dir == watcher->directories.end())
+                continue;
+            std::string path = dir->second + "/" + event->name;
+            if(std::find(watcher->changed.begin(), watcher->changed.end(), path) == watcher->changed.end())
+                watcher->changed.emplace_back(std::move(path));
+        }
+    }
+}
+
+bool StartFileWatcher(FileWatcher& watcher, const std::vector<std::string>& directories) {
+    watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher.fd < 0) {
+        SDL_Log("Could not initialize inotify, hot reload disabled");
+        return false;
+    }
+    for(auto& dir : directories) {
+        // editors often save by writing a temp file and renaming it over the original
+        i32 wd = inotify_add_watch(watcher.fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(wd < 0) {
+            SDL_Log("Could not watch %s", dir.c_str());
+            continue;
+        }
+        watcher.directories[wd] = dir;
+    }
+    watcher.running = true;
+    watcher.thread = std::thread(watchLoop, &watcher);
+    SDL_Log("Watching %zu directories for changes", watcher.directories.size());
+    return true;
+}
+
+void StopFileWatcher(FileWatcher& watcher) {
+    if(!watcher.running)
+        return;
+    watcher.running = false;
+    watcher.thread.join();
+    close(watcher.fd);
+    watcher.fd = -1;
+    watcher.directories.clear();
+}
+
+#else
+
+bool StartFileWatcher(FileWatcher& watcher, const std::vector<std::string>& directories) {
+    SDL_Log("File watching is only supported on Linux, hot reload disabled");
+    return false;
+}
+
+void StopFileWatcher(FileWatcher& watcher) {
+}
+
+#endif
+
+void PollFileChanges(FileWatcher& watcher, std::vector<std::string>& changed) {
+    changed.clear();
+    if(!watcher.running)
+        return;
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+    changed.swap(watcher.changed);
+}
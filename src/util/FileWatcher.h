@@ -0,0 +1,33 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_FILEWATCHER_H
+#define CRAWLER_FILEWATCHER_H
+
+#include <defs.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+// Watches directories (not recursively) with inotify on a background thread. Paths of files that were
+// written or moved into place are queued as "dir/filename" using the directory string passed in,
+// so they compare equal to the asset paths used when loading.
+struct FileWatcher {
+    i32 fd = -1;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::vector<std::string> changed;
+    std::unordered_map<i32, std::string> directories;
+};
+
+bool StartFileWatcher(FileWatcher& watcher, const std::vector<std::string>& directories);
+void StopFileWatcher(FileWatcher& watcher);
+// moves the queued paths into changed, each path only once
+void PollFileChanges(FileWatcher& watcher, std::vector<std::string>& changed);
+
+#endif //CRAWLER_FILEWATCHER_H
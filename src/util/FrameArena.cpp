@@ -0,0 +1,116 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <SDL_log.h>
+#include "FrameArena.h"
+
+struct FrameArenaBuffer {
+    u8* memory = nullptr;
+    std::atomic<size_t> offset{0};
+    std::atomic<size_t> overflowBytes{0};
+};
+
+struct FrameArenaState {
+    FrameArenaBuffer buffers[FRAME_ARENA_BUFFERS];
+    size_t capacity = 0;
+    u32 current = 0;
+    size_t lastUsed = 0;
+    size_t highWater = 0;
+    std::atomic<u64> overflowCount{0};
+    std::atomic<size_t> overflowBytes{0};
+};
+
+static FrameArenaState state;
+
+static bool ownsMemory(void* p) {
+    for(auto& buffer : state.buffers) {
+        if(buffer.memory != nullptr && p >= buffer.memory && p < buffer.memory + state.capacity)
+            return true;
+    }
+    return false;
+}
+
+static size_t bufferUsed(FrameArenaBuffer& buffer) {
+    return std::min(buffer.offset.load(std::memory_order_relaxed), state.capacity) +
+           buffer.overflowBytes.load(std::memory_order_relaxed);
+}
+
+class FrameArenaResource : public std::pmr::memory_resource {
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return AllocateFrameMemory(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if(!ownsMemory(p))
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+static FrameArenaResource resource;
+
+void InitFrameArena(size_t bytesPerFrame) {
+    if(state.capacity != 0) {
+        SDL_Log("Frame arena already initialized");
+        return;
+    }
+    for(auto& buffer : state.buffers) {
+        buffer.memory = static_cast<u8*>(malloc(bytesPerFrame));
+        if(buffer.memory == nullptr)
+            throw std::bad_alloc();
+        buffer.offset = 0;
+        buffer.overflowBytes = 0;
+    }
+    state.capacity = bytesPerFrame;
+    SDL_Log("Frame arena: %d x %zu KB", FRAME_ARENA_BUFFERS, bytesPerFrame / 1024);
+}
+
+void BeginFrameArena() {
+    state.lastUsed = bufferUsed(state.buffers[state.current]);
+    state.highWater = std::max(state.highWater, state.lastUsed);
+    state.current = (state.current + 1) % FRAME_ARENA_BUFFERS;
+    auto& buffer = state.buffers[state.current];
+    buffer.offset.store(0, std::memory_order_relaxed);
+    buffer.overflowBytes.store(0, std::memory_order_relaxed);
+}
+
+void* AllocateFrameMemory(size_t bytes, size_t alignment) {
+    auto& buffer = state.buffers[state.current];
+    if(buffer.memory != nullptr) {
+        size_t offset = buffer.offset.load(std::memory_order_relaxed);
+        while(true) {
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            size_t end = start + bytes;
+            if(end > state.capacity)
+                break;
+            if(buffer.offset.compare_exchange_weak(offset, end, std::memory_order_relaxed))
+                return buffer.memory + start;
+        }
+    }
+    state.overflowCount.fetch_add(1, std::memory_order_relaxed);
+    state.overflowBytes.fetch_add(bytes, std::memory_order_relaxed);
+    buffer.overflowBytes.fetch_add(bytes, std::memory_order_relaxed);
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+FrameArenaStats GetFrameArenaStats() {
+    FrameArenaStats stats;
+    stats.capacity = state.capacity;
+    stats.used = state.lastUsed;
+    stats.highWater = state.highWater;
+    stats.overflowCount = state.overflowCount.load(std::memory_order_relaxed);
+    stats.overflowBytes = state.overflowBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::pmr::memory_resource* GetFrameArenaResource() {
+    return &resource;
+}
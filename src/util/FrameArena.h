@@ -0,0 +1,53 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_FRAMEARENA_H
+#define CRAWLER_FRAMEARENA_H
+
+#include <defs.h>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <type_traits>
+
+// Linear allocator for data that only lives for a frame. There are two buffers so the data built in one frame
+// stays valid while the next one is being recorded, BeginFrameArena flips buffers and resets the new one by
+// setting its offset back to zero. Allocation is a bump of an atomic offset so any thread may allocate.
+// Requests that don't fit in the buffer go to the heap and are counted as overflow.
+//
+// Containers use the arena through GetFrameArenaResource, a std::pmr::memory_resource. Deallocating arena memory
+// is a no-op, the memory comes back when the buffer is reused two frames later. A container holding arena
+// memory must therefore be rebuilt with ResetFrameVector every frame before it is filled.
+
+#define FRAME_ARENA_BUFFERS 2
+
+struct FrameArenaStats {
+    size_t capacity = 0;        // per buffer
+    size_t used = 0;            // bytes used by the last completed frame
+    size_t highWater = 0;       // most bytes any frame has used since startup, overflow included
+    u64 overflowCount = 0;      // heap allocations the arena couldn't serve since startup
+    size_t overflowBytes = 0;
+};
+
+// allocates the buffers, without it every request overflows to the heap. Call once, the buffers are kept until
+// the process exits since frame containers may still be destroyed after the main loop
+void InitFrameArena(size_t bytesPerFrame);
+// call at the start of the frame, before anything allocates from the arena
+void BeginFrameArena();
+void* AllocateFrameMemory(size_t bytes, size_t alignment = alignof(std::max_align_t));
+FrameArenaStats GetFrameArenaStats();
+std::pmr::memory_resource* GetFrameArenaResource();
+
+// drops the storage of v without touching the (possibly already reused) memory and rebinds it to the arena,
+// reserving the size it had last frame so it doesn't grow through the arena
+template<typename T>
+void ResetFrameVector(std::pmr::vector<T>& v) {
+    static_assert(std::is_trivially_destructible<T>::value, "frame vectors can't run destructors on stale memory");
+    size_t expected = v.size();
+    std::destroy_at(&v);
+    new (&v) std::pmr::vector<T>(GetFrameArenaResource());
+    v.reserve(expected);
+}
+
+#endif //CRAWLER_FRAMEARENA_H
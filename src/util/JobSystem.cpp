@@ -0,0 +1,131 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <SDL_log.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "JobSystem.h"
+#include "Profiler.h"
+
+static const char* workerNames[JOB_SYSTEM_MAX_WORKERS] = {
+        "Worker 1", "Worker 2", "Worker 3", "Worker 4", "Worker 5", "Worker 6", "Worker 7", "Worker 8",
+        "Worker 9", "Worker 10", "Worker 11", "Worker 12", "Worker 13", "Worker 14", "Worker 15", "Worker 16",
+        "Worker 17", "Worker 18", "Worker 19", "Worker 20", "Worker 21", "Worker 22", "Worker 23", "Worker 24",
+        "Worker 25", "Worker 26", "Worker 27", "Worker 28", "Worker 29", "Worker 30", "Worker 31",
+};
+
+static struct {
+    std::thread workers[JOB_SYSTEM_MAX_WORKERS];
+    u32 workerCount = 0;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool quit = false;
+    // bumped for every loop, workers compare it to the last one they joined
+    u64 generation = 0;
+    // workers inside runRanges, a new loop waits for them to leave the previous one
+    u32 busy = 0;
+    // the current loop, only written under mutex while busy is 0
+    JobRangeFunc func = nullptr;
+    void* userData = nullptr;
+    u32 count = 0;
+    u32 grain = 1;
+    std::atomic<u32> next{0};
+    std::atomic<u32> completed{0};
+} jobs;
+
+static thread_local bool insideJob = false;
+
+static void runRanges() {
+    insideJob = true;
+    while(true) {
+        u32 begin = jobs.next.fetch_add(jobs.grain, std::memory_order_relaxed);
+        if(begin >= jobs.count)
+            break;
+        u32 end = std::min(begin + jobs.grain, jobs.count);
+        jobs.func(begin, end, jobs.userData);
+        jobs.completed.fetch_add(end - begin, std::memory_order_release);
+    }
+    insideJob = false;
+}
+
+static void workerLoop(u32 index) {
+    SetProfilerThreadName(workerNames[index]);
+    u64 seen = 0;
+    std::unique_lock<std::mutex> lock(jobs.mutex);
+    while(true) {
+        jobs.wake.wait(lock, [&seen] { return jobs.quit || jobs.generation != seen; });
+        if(jobs.quit)
+            break;
+        seen = jobs.generation;
+        jobs.busy++;
+        lock.unlock();
+        runRanges();
+        lock.lock();
+        jobs.busy--;
+        jobs.done.notify_all();
+    }
+}
+
+void InitJobSystem(u32 workerCount) {
+    if(workerCount == JOB_WORKERS_PER_CORE) {
+        u32 hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+    workerCount = std::min(workerCount, (u32) JOB_SYSTEM_MAX_WORKERS);
+    jobs.quit = false;
+    for(u32 i = 0; i < workerCount; ++i) {
+        jobs.workers[i] = std::thread(workerLoop, i);
+    }
+    jobs.workerCount = workerCount;
+    SDL_Log("Job system running %u workers", workerCount);
+}
+
+void ShutdownJobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(jobs.mutex);
+        jobs.quit = true;
+    }
+    jobs.wake.notify_all();
+    for(u32 i = 0; i < jobs.workerCount; ++i) {
+        jobs.workers[i].join();
+    }
+    jobs.workerCount = 0;
+}
+
+u32 GetJobWorkerCount() {
+    return jobs.workerCount;
+}
+
+void ParallelFor(u32 count, u32 grain, JobRangeFunc func, void* userData) {
+    if(count == 0)
+        return;
+    grain = std::max(grain, 1u);
+    if(jobs.workerCount == 0 || insideJob || count <= grain) {
+        func(0, count, userData);
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(jobs.mutex);
+        // a worker that woke up late may still be looking at the previous loop
+        jobs.done.wait(lock, [] { return jobs.busy == 0; });
+        jobs.func = func;
+        jobs.userData = userData;
+        jobs.count = count;
+        jobs.grain = grain;
+        jobs.next.store(0, std::memory_order_relaxed);
+        jobs.completed.store(0, std::memory_order_relaxed);
+        jobs.generation++;
+    }
+    jobs.wake.notify_all();
+    runRanges();
+    if(jobs.completed.load(std::memory_order_acquire) == count)
+        return;
+    PROFILE_SCOPE("WaitForJobs");
+    std::unique_lock<std::mutex> lock(jobs.mutex);
+    jobs.done.wait(lock, [count] { return jobs.completed.load(std::memory_order_acquire) == count; });
+}
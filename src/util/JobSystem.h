@@ -0,0 +1,35 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_JOBSYSTEM_H
+#define CRAWLER_JOBSYSTEM_H
+
+#include <defs.h>
+
+// Fork-join worker pool for data parallel loops. ParallelFor splits [0, count) into ranges of grain items that
+// the workers and the calling thread take from a shared counter, it returns when every range is done. Only one
+// loop runs at a time, a ParallelFor started from inside a range (or before InitJobSystem) runs inline on the
+// calling thread. Starting a loop doesn't allocate.
+
+#define JOB_SYSTEM_MAX_WORKERS 31
+// InitJobSystem worker count for one worker per hardware thread besides the calling one
+#define JOB_WORKERS_PER_CORE UINT32_MAX
+
+typedef void (*JobRangeFunc)(u32 begin, u32 end, void* userData);
+
+// with 0 workers every loop runs inline on the calling thread
+void InitJobSystem(u32 workerCount);
+void ShutdownJobSystem();
+u32 GetJobWorkerCount();
+void ParallelFor(u32 count, u32 grain, JobRangeFunc func, void* userData);
+
+// func is called as func(begin, end), it must be safe to call concurrently for different ranges
+template<typename F>
+void ParallelFor(u32 count, u32 grain, const F& func) {
+    ParallelFor(count, grain, [](u32 begin, u32 end, void* userData) {
+        (*(const F*) userData)(begin, end);
+    }, (void*) &func);
+}
+
+#endif //CRAWLER_JOBSYSTEM_H
@@ -0,0 +1,188 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <SDL_timer.h>
+#include <mutex>
+#include <memory>
+#include "Profiler.h"
+#include "AllocTracker.h"
+
+struct ProfileRing {
+    ProfileZone zones[PROFILER_RING_SIZE];
+    std::atomic<u64> head{0};   // written by the owning thread
+    std::atomic<u64> tail{0};   // written by the main thread when draining
+    std::atomic<u64> dropped{0};
+    u32 thread = 0;
+    u32 depth = 0;
+};
+
+static struct {
+    std::atomic<bool> enabled{false};
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ProfileRing>> rings;
+    std::vector<const char*> threadNames;
+    u32 gpuThread = UINT32_MAX;
+    std::vector<ProfileFrame> frames = std::vector<ProfileFrame>(PROFILER_FRAME_HISTORY);
+    std::atomic<u64> frameIndex{0};
+    // gpu zones come from whichever thread owns the GL context, EndProfilerFrame moves them into their frames
+    std::mutex gpuMutex;
+    std::vector<std::pair<u64, ProfileZone>> gpuZones;
+    std::vector<std::pair<u64, ProfileZone>> gpuZonesDrain;
+    u64 frameStart = 0;
+    AllocStats frameAllocs;
+    ProfileFrameListener listener = nullptr;
+    void* listenerData = nullptr;
+} profiler;
+
+// rings outlive their threads, they are owned by the profiler
+static thread_local ProfileRing* threadRing = nullptr;
+
+static ProfileRing* getThreadRing() {
+    if(threadRing == nullptr) {
+        std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+        auto ring = std::make_unique<ProfileRing>();
+        ring->thread = (u32) profiler.threadNames.size();
+        profiler.threadNames.push_back("Thread");
+        threadRing = ring.get();
+        profiler.rings.emplace_back(std::move(ring));
+    }
+    return threadRing;
+}
+
+void SetProfilerEnabled(bool enabled) {
+    profiler.enabled = enabled;
+}
+
+bool IsProfilerEnabled() {
+    return profiler.enabled.load(std::memory_order_relaxed);
+}
+
+void SetProfilerThreadName(const char *name) {
+    auto ring = getThreadRing();
+    std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+    profiler.threadNames[ring->thread] = name;
+}
+
+void GetProfilerThreadNames(std::vector<const char*>& names) {
+    std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+    names.assign(profiler.threadNames.begin(), profiler.threadNames.end());
+}
+
+void BeginProfilerFrame() {
+    profiler.frameStart = SDL_GetPerformanceCounter();
+    profiler.frameAllocs = GetAllocStats();
+}
+
+void EndProfilerFrame() {
+    u64 index = profiler.frameIndex++;
+    if(!IsProfilerEnabled())
+        return;
+    auto allocs = GetAllocStats();
+    auto& frame = profiler.frames[index % PROFILER_FRAME_HISTORY];
+    frame.index = index;
+    frame.start = profiler.frameStart;
+    frame.end = SDL_GetPerformanceCounter();
+    frame.allocs = allocs.count - profiler.frameAllocs.count;
+    frame.allocBytes = allocs.bytes - profiler.frameAllocs.bytes;
+    // clear keeps the capacity, after a few frames this doesn't allocate
+    frame.zones.clear();
+    {
+        std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+        for(auto& ring : profiler.rings) {
+            u64 head = ring->head.load(std::memory_order_acquire);
+            u64 tail = ring->tail.load(std::memory_order_relaxed);
+            for(; tail < head; ++tail) {
+                frame.zones.push_back(ring->zones[tail & (PROFILER_RING_SIZE - 1)]);
+            }
+            ring->tail.store(tail, std::memory_order_release);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(profiler.gpuMutex);
+        profiler.gpuZones.swap(profiler.gpuZonesDrain);
+    }
+    for(auto& gpu : profiler.gpuZonesDrain) {
+        auto& measured = profiler.frames[gpu.first % PROFILER_FRAME_HISTORY];
+        if(measured.index == gpu.first && measured.end != 0)
+            measured.zones.push_back(gpu.second);
+    }
+    profiler.gpuZonesDrain.clear();
+
+    if(profiler.listener != nullptr && index >= PROFILER_GPU_LATENCY) {
+        auto& done = profiler.frames[(index - PROFILER_GPU_LATENCY) % PROFILER_FRAME_HISTORY];
+        if(done.index == index - PROFILER_GPU_LATENCY && done.end != 0) {
+            profiler.listener(done, profiler.listenerData);
+        }
+    }
+}
+
+void AddProfilerGpuZone(u64 frameIndex, const char *name, u64 start, u64 end) {
+    if(frameIndex + PROFILER_FRAME_HISTORY <= profiler.frameIndex.load(std::memory_order_relaxed))
+        return;
+    std::lock_guard<std::mutex> lock(profiler.gpuMutex);
+    if(profiler.gpuThread == UINT32_MAX) {
+        std::lock_guard<std::mutex> threadsLock(profiler.threadsMutex);
+        profiler.gpuThread = (u32) profiler.threadNames.size();
+        profiler.threadNames.push_back("GPU");
+    }
+    profiler.gpuZones.emplace_back(frameIndex, ProfileZone{name, start, end, profiler.gpuThread, 0, true});
+}
+
+u64 GetProfilerFrameIndex() {
+    return profiler.frameIndex.load(std::memory_order_relaxed);
+}
+
+double ProfilerTicksToMs(u64 ticks) {
+    static double msPerTick = 1000.0 / (double) SDL_GetPerformanceFrequency();
+    return (double) ticks * msPerTick;
+}
+
+void GetProfilerFrames(std::vector<const ProfileFrame*> &frames) {
+    frames.clear();
+    u64 end = profiler.frameIndex.load(std::memory_order_relaxed);
+    u64 count = end < PROFILER_FRAME_HISTORY ? end : PROFILER_FRAME_HISTORY;
+    for(u64 i = end - count; i < end; ++i) {
+        auto& frame = profiler.frames[i % PROFILER_FRAME_HISTORY];
+        // frames recorded while disabled are skipped
+        if(frame.index == i && frame.end != 0)
+            frames.push_back(&frame);
+    }
+}
+
+void SetProfileFrameListener(ProfileFrameListener listener, void *userData) {
+    profiler.listener = listener;
+    profiler.listenerData = userData;
+}
+
+u64 GetProfilerDroppedZones() {
+    std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+    u64 dropped = 0;
+    for(auto& ring : profiler.rings) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+ProfileScope::ProfileScope(const char *name) : name(name), start(0), ring(nullptr) {
+    if(!IsProfilerEnabled())
+        return;
+    ring = getThreadRing();
+    ring->depth++;
+    start = SDL_GetPerformanceCounter();
+}
+
+ProfileScope::~ProfileScope() {
+    if(ring == nullptr)
+        return;
+    u64 end = SDL_GetPerformanceCounter();
+    ring->depth--;
+    u64 head = ring->head.load(std::memory_order_relaxed);
+    // the main thread hasn't drained in a while, drop rather than block
+    if(head - ring->tail.load(std::memory_order_acquire) >= PROFILER_RING_SIZE) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring->zones[head & (PROFILER_RING_SIZE - 1)] = ProfileZone{name, start, end, ring->thread, ring->depth, false};
+    ring->head.store(head + 1, std::memory_order_release);
+}
@@ -0,0 +1,78 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_PROFILER_H
+#define CRAWLER_PROFILER_H
+
+#include <defs.h>
+#include <vector>
+#include <atomic>
+
+// Scoped zone profiler. PROFILE_SCOPE records a zone into a ring owned by the calling thread, the rings are
+// single producer/single consumer so recording never takes a lock. The main thread drains all rings in
+// EndProfilerFrame and keeps the last PROFILER_FRAME_HISTORY frames for the overlay.
+
+#define PROFILER_FRAME_HISTORY 240
+#define PROFILER_RING_SIZE 4096
+#define PROFILER_GPU_LATENCY 4
+
+struct ProfileZone {
+    const char* name;       // must be a string literal or otherwise outlive the profiler
+    u64 start;              // performance counter ticks
+    u64 end;
+    u32 thread;             // index into GetProfilerThreadNames
+    u32 depth;
+    bool gpu;
+};
+
+struct ProfileFrame {
+    u64 index = 0;
+    u64 start = 0;
+    u64 end = 0;
+    // heap allocations between BeginProfilerFrame and EndProfilerFrame, see AllocTracker.h
+    u64 allocs = 0;
+    u64 allocBytes = 0;
+    std::vector<ProfileZone> zones;
+};
+
+struct ProfileRing;
+
+// called with each completed frame PROFILER_GPU_LATENCY frames after it ended, when its gpu zones are in
+typedef void (*ProfileFrameListener)(const ProfileFrame& frame, void* userData);
+
+void SetProfilerEnabled(bool enabled);
+bool IsProfilerEnabled();
+// optional, names the calling thread in the overlay and traces
+void SetProfilerThreadName(const char* name);
+void GetProfilerThreadNames(std::vector<const char*>& names);
+
+void BeginProfilerFrame();
+void EndProfilerFrame();
+// gpu timings arrive a few frames late, they are added to the frame they were measured in if it's still in the history.
+// Safe to call from any thread, the zones are queued and moved into their frames by EndProfilerFrame
+void AddProfilerGpuZone(u64 frameIndex, const char* name, u64 start, u64 end);
+// index of the frame being recorded
+u64 GetProfilerFrameIndex();
+double ProfilerTicksToMs(u64 ticks);
+// completed frames, oldest first
+void GetProfilerFrames(std::vector<const ProfileFrame*>& frames);
+void SetProfileFrameListener(ProfileFrameListener listener, void* userData);
+u64 GetProfilerDroppedZones();
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name);
+    ~ProfileScope();
+
+private:
+    const char* name;
+    u64 start;
+    ProfileRing* ring;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#endif //CRAWLER_PROFILER_H
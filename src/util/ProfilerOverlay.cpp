@@ -0,0 +1,250 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <cstdio>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include "imgui.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "TraceWriter.h"
+#include "AllocTracker.h"
+#include "FrameArena.h"
+
+struct ZoneStats {
+    std::vector<float> frameMs;     // summed per frame
+    float frameSum = 0;
+    bool inFrame = false;
+    u32 calls = 0;
+    bool gpu = false;
+};
+
+// everything is kept between frames so an open overlay doesn't add to the allocation count
+static struct {
+    std::vector<const ProfileFrame*> frames;
+    ProfileFrame frozen;
+    bool paused = false;
+    // by zone name, cpu zones in the first and gpu zones in the second, a cpu and a gpu zone can share a name
+    std::unordered_map<std::string_view, ZoneStats> stats[2];
+    std::vector<std::pair<std::string_view, ZoneStats*>> sorted;
+    std::vector<float> sortBuffer;
+    std::vector<const char*> threadNames;
+    std::vector<u32> laneDepth;
+    std::vector<float> laneY;
+} overlay;
+
+static float frameMsGetter(void* data, int idx) {
+    auto frames = (const std::vector<const ProfileFrame*>*) data;
+    auto frame = (*frames)[(size_t) idx];
+    return (float) ProfilerTicksToMs(frame->end - frame->start);
+}
+
+static ImU32 zoneColor(const char* name, bool gpu) {
+    // stable color per zone name
+    u32 hash = 2166136261u;
+    for(const char* c = name; *c; ++c) {
+        hash = (hash ^ (u8) *c) * 16777619u;
+    }
+    float hue = (float) (hash % 360) / 360.0f;
+    float r, g, b;
+    ImGui::ColorConvertHSVtoRGB(hue, gpu ? 0.35f : 0.55f, 0.85f, r, g, b);
+    return ImGui::GetColorU32(ImVec4(r, g, b, 1.0f));
+}
+
+static void drawTimeline(const ProfileFrame& frame, const std::vector<const char*>& threadNames) {
+    u64 end = frame.end;
+    for(auto& zone : frame.zones) {
+        end = std::max(end, zone.end);
+    }
+    double frameMs = ProfilerTicksToMs(end - frame.start);
+    const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+
+    // lanes ordered by thread, each as deep as its deepest zone
+    auto& laneDepth = overlay.laneDepth;
+    laneDepth.assign(threadNames.size(), 0);
+    for(auto& zone : frame.zones) {
+        if(zone.thread < laneDepth.size())
+            laneDepth[zone.thread] = std::max(laneDepth[zone.thread], zone.depth + 1);
+    }
+    auto& laneY = overlay.laneY;
+    laneY.assign(threadNames.size(), 0);
+    float height = 0;
+    for(size_t i = 0; i < laneDepth.size(); ++i) {
+        laneY[i] = height;
+        if(laneDepth[i] > 0)
+            height += (float) (laneDepth[i] + 1) * rowHeight;
+    }
+
+    ImGui::Text("Frame %llu: %.2f ms, %llu allocs", (unsigned long long) frame.index, frameMs, (unsigned long long) frame.allocs);
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+    ImGui::InvisibleButton("timeline", ImVec2(width, std::max(height, rowHeight)));
+    auto drawList = ImGui::GetWindowDrawList();
+    auto mouse = ImGui::GetIO().MousePos;
+    bool hovered = ImGui::IsItemHovered();
+
+    for(size_t i = 0; i < laneDepth.size(); ++i) {
+        if(laneDepth[i] > 0)
+            drawList->AddText(ImVec2(origin.x, origin.y + laneY[i]), ImGui::GetColorU32(ImGuiCol_TextDisabled), threadNames[i]);
+    }
+    for(auto& zone : frame.zones) {
+        if(zone.thread >= laneDepth.size() || zone.start < frame.start)
+            continue;
+        float x0 = origin.x + (float) (ProfilerTicksToMs(zone.start - frame.start) / frameMs) * width;
+        float x1 = origin.x + (float) (ProfilerTicksToMs(zone.end - frame.start) / frameMs) * width;
+        x1 = std::max(x1, x0 + 1.0f);
+        float y0 = origin.y + laneY[zone.thread] + (float) (zone.depth + 1) * rowHeight;
+        float y1 = y0 + rowHeight - 1.0f;
+        drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), zoneColor(zone.name, zone.gpu));
+        if(x1 - x0 > ImGui::CalcTextSize(zone.name).x + 4.0f) {
+            drawList->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32(0, 0, 0, 255), zone.name);
+        }
+        if(hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1) {
+            ImGui::SetTooltip("%s%s\n%.3f ms", zone.name, zone.gpu ? " (gpu)" : "", ProfilerTicksToMs(zone.end - zone.start));
+        }
+    }
+}
+
+static void updateStats() {
+    for(auto& byName : overlay.stats) {
+        for(auto& [name, stats] : byName) {
+            stats.frameMs.clear();
+            stats.calls = 0;
+        }
+    }
+    for(auto frame : overlay.frames) {
+        for(auto& zone : frame->zones) {
+            auto& stats = overlay.stats[zone.gpu ? 1 : 0][zone.name];
+            stats.calls++;
+            stats.gpu = zone.gpu;
+            stats.frameSum += (float) ProfilerTicksToMs(zone.end - zone.start);
+            stats.inFrame = true;
+        }
+        for(auto& byName : overlay.stats) {
+            for(auto& [name, stats] : byName) {
+                if(stats.inFrame)
+                    stats.frameMs.push_back(stats.frameSum);
+                stats.frameSum = 0;
+                stats.inFrame = false;
+            }
+        }
+    }
+    overlay.sorted.clear();
+    for(auto& byName : overlay.stats) {
+        for(auto& [name, stats] : byName) {
+            if(!stats.frameMs.empty())
+                overlay.sorted.emplace_back(name, &stats);
+        }
+    }
+    // the gpu row of a zone right after its cpu row
+    std::sort(overlay.sorted.begin(), overlay.sorted.end(), [](auto& a, auto& b) {
+        return a.first != b.first ? a.first < b.first : !a.second->gpu && b.second->gpu;
+    });
+}
+
+static void drawStats() {
+    updateStats();
+    if(!ImGui::BeginTable("zones", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit))
+        return;
+    ImGui::TableSetupColumn("Zone", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Calls/frame");
+    ImGui::TableSetupColumn("Min ms");
+    ImGui::TableSetupColumn("Avg ms");
+    ImGui::TableSetupColumn("P99 ms");
+    ImGui::TableSetupColumn("Max ms");
+    ImGui::TableHeadersRow();
+    for(auto& [name, stats] : overlay.sorted) {
+        auto& sorted = overlay.sortBuffer;
+        sorted.assign(stats->frameMs.begin(), stats->frameMs.end());
+        std::sort(sorted.begin(), sorted.end());
+        float sum = 0;
+        for(float ms : sorted) {
+            sum += ms;
+        }
+        size_t p99 = std::min(sorted.size() - 1, (size_t) ((double) sorted.size() * 0.99));
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%.*s%s", (int) name.size(), name.data(), stats->gpu ? " (gpu)" : "");
+        ImGui::TableNextColumn();
+        ImGui::Text("%.1f", (double) stats->calls / (double) sorted.size());
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", sorted.front());
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", sum / (float) sorted.size());
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", sorted[p99]);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", sorted.back());
+    }
+    ImGui::EndTable();
+}
+
+void DrawProfilerOverlay(bool *open) {
+    ImGui::SetNextWindowSize(ImVec2(720, 480), ImGuiCond_FirstUseEver);
+    if(!ImGui::Begin("Profiler", open)) {
+        ImGui::End();
+        return;
+    }
+    GetProfilerFrames(overlay.frames);
+    if(overlay.frames.empty()) {
+        ImGui::TextUnformatted("No frames recorded yet");
+        ImGui::End();
+        return;
+    }
+
+    float avg = 0;
+    for(size_t i = 0; i < overlay.frames.size(); ++i) {
+        avg += frameMsGetter(&overlay.frames, (int) i);
+    }
+    avg /= (float) overlay.frames.size();
+    char overlayText[64];
+    snprintf(overlayText, sizeof(overlayText), "avg %.2f ms (%.0f fps)", avg, avg > 0 ? 1000.0f / avg : 0.0f);
+    ImGui::PlotHistogram("##frames", frameMsGetter, &overlay.frames, (int) overlay.frames.size(), 0, overlayText,
+                         0.0f, 33.3f, ImVec2(-1, 60));
+    ImGui::Checkbox("Pause timeline", &overlay.paused);
+    ImGui::SameLine();
+    if(IsTraceRecording()) {
+        if(ImGui::Button("Stop trace"))
+            StopTraceRecording();
+    } else if(ImGui::Button("Record trace")) {
+        StartTraceRecording(MakeTraceFilename());
+    }
+    ImGui::SameLine();
+    ImGui::Text("dropped zones: %llu", (unsigned long long) GetProfilerDroppedZones());
+    if(IsAllocTrackingEnabled()) {
+        u64 maxAllocs = 0, totalAllocs = 0, totalBytes = 0;
+        for(auto frame : overlay.frames) {
+            maxAllocs = std::max(maxAllocs, frame->allocs);
+            totalAllocs += frame->allocs;
+            totalBytes += frame->allocBytes;
+        }
+        auto count = (double) overlay.frames.size();
+        ImGui::Text("allocs/frame: avg %.1f, max %llu, %.0f bytes avg", (double) totalAllocs / count,
+                    (unsigned long long) maxAllocs, (double) totalBytes / count);
+    } else {
+        ImGui::TextUnformatted("allocs/frame: tracking off (build with CRAWLER_TRACK_ALLOCS)");
+    }
+    auto arena = GetFrameArenaStats();
+    ImGui::Text("frame arena: %.0f KB used, %.0f KB high water of %.0f KB, %llu overflows (%.0f KB)",
+                (double) arena.used / 1024.0, (double) arena.highWater / 1024.0, (double) arena.capacity / 1024.0,
+                (unsigned long long) arena.overflowCount, (double) arena.overflowBytes / 1024.0);
+
+    // show a frame old enough for its gpu timings to have arrived
+    if(!overlay.paused) {
+        size_t latest = overlay.frames.size() - 1;
+        auto frame = overlay.frames[latest - std::min(latest, (size_t) PROFILER_GPU_LATENCY)];
+        overlay.frozen.index = frame->index;
+        overlay.frozen.start = frame->start;
+        overlay.frozen.end = frame->end;
+        overlay.frozen.allocs = frame->allocs;
+        overlay.frozen.allocBytes = frame->allocBytes;
+        overlay.frozen.zones.assign(frame->zones.begin(), frame->zones.end());
+    }
+    GetProfilerThreadNames(overlay.threadNames);
+    drawTimeline(overlay.frozen, overlay.threadNames);
+    ImGui::Separator();
+    drawStats();
+    ImGui::End();
+}
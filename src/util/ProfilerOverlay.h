@@ -0,0 +1,12 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_PROFILEROVERLAY_H
+#define CRAWLER_PROFILEROVERLAY_H
+
+// ImGui window with frame times, a timeline of the zones of one frame per thread and min/avg/p99 per zone
+// over the profiler history. Must be called between ImGui::NewFrame and ImGui::Render.
+void DrawProfilerOverlay(bool* open);
+
+#endif //CRAWLER_PROFILEROVERLAY_H
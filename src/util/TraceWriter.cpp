@@ -0,0 +1,143 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#include <cstdio>
+#include <ctime>
+#include <vector>
+#include <unordered_map>
+#include <SDL_log.h>
+#include <json.hpp>
+#include "Profiler.h"
+#include "TraceWriter.h"
+
+// tid of the frame boundary track, kept apart from the real threads
+#define TRACE_FRAME_TID 1000
+
+static struct {
+    FILE* file = nullptr;
+    std::string filename;
+    u64 origin = 0;
+    u64 firstFrame = 0;
+    u64 lastFrame = 0;
+    bool firstEvent = true;
+    size_t namedThreads = 0;
+    u64 frames = 0;
+    u64 events = 0;
+    std::unordered_map<const char*, std::string> escapedNames;
+    std::vector<const char*> threadNames;
+} trace;
+
+static const std::string& escapedName(const char* name) {
+    // zone names are literals so the pointer is a good key, escape each name once
+    auto it = trace.escapedNames.find(name);
+    if(it == trace.escapedNames.end()) {
+        it = trace.escapedNames.emplace(name, nlohmann::json(name).dump()).first;
+    }
+    return it->second;
+}
+
+static void beginEvent() {
+    fputs(trace.firstEvent ? "\n" : ",\n", trace.file);
+    trace.firstEvent = false;
+    trace.events++;
+}
+
+static double toMicros(u64 ticks) {
+    return ProfilerTicksToMs(ticks - trace.origin) * 1000.0;
+}
+
+static void writeMetadata(const char* type, u32 tid, const char* value) {
+    nlohmann::json event = {{"name", type}, {"ph", "M"}, {"pid", 1}, {"tid", tid}, {"args", {{"name", value}}}};
+    beginEvent();
+    fputs(event.dump().c_str(), trace.file);
+}
+
+static void writeThreadNames() {
+    auto& names = trace.threadNames;
+    GetProfilerThreadNames(names);
+    for(; trace.namedThreads < names.size(); ++trace.namedThreads) {
+        writeMetadata("thread_name", (u32) trace.namedThreads, names[trace.namedThreads]);
+    }
+}
+
+static void writeFrame(const ProfileFrame& frame) {
+    if(frame.index < trace.firstFrame || (frame.index <= trace.lastFrame && trace.frames > 0))
+        return;
+    if(trace.origin == 0)
+        trace.origin = frame.start;
+    writeThreadNames();
+    beginEvent();
+    fprintf(trace.file, R"({"name":"Frame","cat":"frame","ph":"X","ts":%.3f,"dur":%.3f,"pid":1,"tid":%d,"args":{"frame":%llu,"allocs":%llu,"alloc_bytes":%llu}})",
+            toMicros(frame.start), ProfilerTicksToMs(frame.end - frame.start) * 1000.0, TRACE_FRAME_TID,
+            (unsigned long long) frame.index, (unsigned long long) frame.allocs, (unsigned long long) frame.allocBytes);
+    for(auto& zone : frame.zones) {
+        if(zone.start < trace.origin)
+            continue;
+        beginEvent();
+        fprintf(trace.file, R"({"name":%s,"cat":"%s","ph":"X","ts":%.3f,"dur":%.3f,"pid":1,"tid":%u})",
+                escapedName(zone.name).c_str(), zone.gpu ? "gpu" : "cpu", toMicros(zone.start),
+                ProfilerTicksToMs(zone.end - zone.start) * 1000.0, zone.thread);
+    }
+    trace.lastFrame = frame.index;
+    trace.frames++;
+}
+
+static void frameListener(const ProfileFrame& frame, void* userData) {
+    writeFrame(frame);
+}
+
+bool StartTraceRecording(const std::string &filename) {
+    if(trace.file != nullptr)
+        StopTraceRecording();
+    trace.file = fopen(filename.c_str(), "wb");
+    if(trace.file == nullptr) {
+        SDL_Log("Could not open trace file %s", filename.c_str());
+        return false;
+    }
+    // large buffer, the file is written in a few big chunks per second instead of per event
+    setvbuf(trace.file, nullptr, _IOFBF, 1 << 16);
+    trace.filename = filename;
+    trace.origin = 0;
+    trace.firstFrame = GetProfilerFrameIndex();
+    trace.lastFrame = 0;
+    trace.firstEvent = true;
+    trace.namedThreads = 0;
+    trace.frames = 0;
+    trace.events = 0;
+    fputs("[", trace.file);
+    writeMetadata("process_name", 0, "crawler");
+    writeMetadata("thread_name", TRACE_FRAME_TID, "Frames");
+    SetProfileFrameListener(frameListener, nullptr);
+    SetProfilerEnabled(true);
+    SDL_Log("Recording trace to %s", filename.c_str());
+    return true;
+}
+
+void StopTraceRecording() {
+    if(trace.file == nullptr)
+        return;
+    SetProfileFrameListener(nullptr, nullptr);
+    // the listener lags behind for the gpu timings, write what's left without waiting for them
+    std::vector<const ProfileFrame*> frames;
+    GetProfilerFrames(frames);
+    for(auto frame : frames) {
+        writeFrame(*frame);
+    }
+    fputs("\n]\n", trace.file);
+    fclose(trace.file);
+    trace.file = nullptr;
+    SDL_Log("Wrote %llu frames (%llu events) to %s", (unsigned long long) trace.frames,
+            (unsigned long long) trace.events, trace.filename.c_str());
+}
+
+bool IsTraceRecording() {
+    return trace.file != nullptr;
+}
+
+std::string MakeTraceFilename() {
+    time_t now = time(nullptr);
+    char name[64];
+    strftime(name, sizeof(name), "trace_%Y%m%d_%H%M%S.json", localtime(&now));
+    return name;
+}
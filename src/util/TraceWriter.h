@@ -0,0 +1,19 @@
+//
+// Created by bison on 19-10-26.
+//
+
+#ifndef CRAWLER_TRACEWRITER_H
+#define CRAWLER_TRACEWRITER_H
+
+#include <string>
+
+// Streams profiler frames to a Chrome Trace Event JSON file (chrome://tracing, ui.perfetto.dev) while
+// recording. Every frame is written as it completes so memory stays flat over long sessions, the closing
+// bracket is optional in the format so a crashed session still loads.
+bool StartTraceRecording(const std::string& filename);
+void StopTraceRecording();
+bool IsTraceRecording();
+// trace_<date>_<time>.json in the working directory
+std::string MakeTraceFilename();
+
+#endif //CRAWLER_TRACEWRITER_H